@@ -0,0 +1,743 @@
+//==========================================================================================
+//
+//    File Name:      archive.c
+//    Description:    A columnar, compressed archive of the station logs' samples, see
+//                    archive.h
+//
+//==========================================================================================
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+
+// Most bytes a column stream of a chunk can take: 69 bits a sample at worst, and the
+// first sample's 64
+#define STREAM_MAX		(ARCHIVE_CHUNK * 9 + 16)
+
+struct ArchiveSeries
+{
+	uint32_t				rows;
+	uint64_t				values[ARCHIVE_COLUMNS][ARCHIVE_CHUNK];	// floats as their bits
+};
+
+// Where each column comes from in a LogRecord: the plan of a station with every input
+static LogPlan fullPlan;
+static ArchiveColumnInfo columnInfo[ARCHIVE_COLUMNS];
+static int timeColumn;
+
+static void initColumns( void )
+{
+	const char *name = LOGPLAN_HEADER, *end;
+	int i;
+
+	if( fullPlan.count )
+		return;
+
+	logPlanBuild( &fullPlan, TRUE, ISD_MAX_AUX_INPUTS );
+	memset( columnInfo, 0, sizeof(columnInfo) );
+	for( i = 0; i < LOGPLAN_COLUMNS; i++ )
+	{
+		const LogColumn *c = &fullPlan.columns[i];
+
+		end = name + strcspn( name, ",\n" );
+		memcpy( columnInfo[i].name, name, end - name < ARCHIVE_NAME ? end - name : ARCHIVE_NAME - 1 );
+		name = end + 1;
+
+		columnInfo[i].decimals = c->decimals;
+		columnInfo[i].type = c->kind == LOGCOL_FLOAT ? ARCCOL_FLOAT :
+							 c->kind == LOGCOL_TIME || c->kind == LOGCOL_OSTIME ? ARCCOL_TIME : ARCCOL_INT;
+		if( c->kind == LOGCOL_TIME )
+			timeColumn = i;
+	}
+	strcpy( columnInfo[LOGPLAN_COLUMNS].name, "LogPlan" );
+	columnInfo[LOGPLAN_COLUMNS].type = ARCCOL_INT;
+}
+
+static uint64_t getField( int column, const LogRecord *r )
+{
+	const LogColumn *c = &fullPlan.columns[column];
+	const char *base = (const char *) r;
+	uint32_t bits;
+
+	if( column == LOGPLAN_COLUMNS )
+		return logPlanIndex( r );
+
+	switch( c->kind )
+	{
+	case LOGCOL_ANALOG:
+		return (uint64_t) (int64_t) *(const short *)(base + c->offset);
+	case LOGCOL_FLOAT:
+		memcpy( &bits, base + c->offset, sizeof(bits) );
+		return bits;
+	case LOGCOL_TIME:
+	case LOGCOL_OSTIME:
+		return *(const unsigned int *)(base + c->offset) * 1000000ULL +
+			   *(const unsigned int *)(base + c->offset2);
+	default:
+		return *(const unsigned char *)(base + c->offset);
+	}
+}
+
+static void setField( int column, LogRecord *r, uint64_t v )
+{
+	const LogColumn *c = &fullPlan.columns[column];
+	char *base = (char *) r;
+	uint32_t bits = (uint32_t) v;
+
+	if( column == LOGPLAN_COLUMNS )
+	{
+		if( v > ISD_MAX_AUX_INPUTS )
+			r->pose.flags |= POSE_INPUTS;
+		r->ext.aux_inputs = (unsigned char) (v % (ISD_MAX_AUX_INPUTS + 1));
+		return;
+	}
+
+	switch( c->kind )
+	{
+	case LOGCOL_ANALOG:
+		*(short *)(base + c->offset) = (short) v;
+		break;
+	case LOGCOL_FLOAT:
+		memcpy( base + c->offset, &bits, sizeof(bits) );
+		break;
+	case LOGCOL_TIME:
+	case LOGCOL_OSTIME:
+		*(unsigned int *)(base + c->offset) = (unsigned int) (v / 1000000);
+		*(unsigned int *)(base + c->offset2) = (unsigned int) (v % 1000000);
+		break;
+	default:
+		*(unsigned char *)(base + c->offset) = (unsigned char) v;
+		break;
+	}
+}
+
+//==========================================================================================
+//
+//  Bits, most significant first
+//
+//==========================================================================================
+typedef struct
+{
+	unsigned char			*p;
+	uint64_t				acc;
+	int						bits;
+} BitWriter;
+
+typedef struct
+{
+	const unsigned char		*p, *end;
+	uint64_t				acc;
+	int						bits;
+	int						overrun;
+} BitReader;
+
+// n up to 32
+static void putBits( BitWriter *w, uint64_t v, int n )
+{
+	w->acc = (w->acc << n) | (v & ((1ULL << n) - 1));
+	w->bits += n;
+	while( w->bits >= 8 )
+	{
+		w->bits -= 8;
+		*w->p++ = (unsigned char) (w->acc >> w->bits);
+	}
+}
+
+static void put64( BitWriter *w, uint64_t v )
+{
+	putBits( w, v >> 32, 32 );
+	putBits( w, v, 32 );
+}
+
+static void putFlush( BitWriter *w )
+{
+	if( w->bits )
+		*w->p++ = (unsigned char) (w->acc << (8 - w->bits));
+	w->bits = 0;
+}
+
+static uint64_t getBits( BitReader *r, int n )
+{
+	while( r->bits < n )
+	{
+		if( r->p < r->end )
+			r->acc = (r->acc << 8) | *r->p++;
+		else
+		{
+			r->acc <<= 8;
+			r->overrun = 1;
+		}
+		r->bits += 8;
+	}
+	r->bits -= n;
+	return (r->acc >> r->bits) & ((1ULL << n) - 1);
+}
+
+static uint64_t get64( BitReader *r )
+{
+	uint64_t hi = getBits( r, 32 );
+
+	return (hi << 32) | getBits( r, 32 );
+}
+
+static int64_t getSigned( BitReader *r, int n )
+{
+	uint64_t v = getBits( r, n );
+
+	return (int64_t) (v ^ (1ULL << (n - 1))) - (int64_t) (1ULL << (n - 1));
+}
+
+//==========================================================================================
+//
+//  Integers and times: the first in full, then how much each step differs from the last
+//  one, in the smallest of five widths that holds it
+//
+//==========================================================================================
+static void encodeInts( BitWriter *w, const uint64_t *v, uint32_t n )
+{
+	uint64_t delta, prevDelta = 0;
+	int64_t dod;
+	uint32_t i;
+
+	put64( w, v[0] );
+	for( i = 1; i < n; i++ )
+	{
+		delta = v[i] - v[i-1];
+		dod = (int64_t) (delta - prevDelta);
+		prevDelta = delta;
+
+		if( dod == 0 )
+			putBits( w, 0, 1 );
+		else if( dod >= -64 && dod < 64 )
+			putBits( w, 2, 2 ), putBits( w, dod, 7 );
+		else if( dod >= -256 && dod < 256 )
+			putBits( w, 6, 3 ), putBits( w, dod, 9 );
+		else if( dod >= -2048 && dod < 2048 )
+			putBits( w, 14, 4 ), putBits( w, dod, 12 );
+		else if( dod >= INT32_MIN && dod <= INT32_MAX )
+			putBits( w, 30, 5 ), putBits( w, dod, 32 );
+		else
+			putBits( w, 31, 5 ), put64( w, dod );
+	}
+}
+
+static void decodeInts( BitReader *r, int64_t *v, uint32_t n )
+{
+	static const int widths[5] = { 7, 9, 12, 32, 64 };
+	uint64_t prev, delta = 0;
+	uint32_t i;
+	int ones;
+
+	prev = get64( r );
+	v[0] = (int64_t) prev;
+	for( i = 1; i < n; i++ )
+	{
+		for( ones = 0; ones < 5 && getBits( r, 1 ); ones++ )
+			;
+		if( ones == 5 )
+			delta += get64( r );
+		else if( ones > 0 )
+			delta += (uint64_t) getSigned( r, widths[ones - 1] );
+		prev += delta;
+		v[i] = (int64_t) prev;
+	}
+}
+
+//==========================================================================================
+//
+//  Floats: XOR with the one before; a repeat is one bit, else the bits that differ, in
+//  the window of the last ones that needed a new window if they fit it
+//
+//==========================================================================================
+static void encodeFloats( BitWriter *w, const uint64_t *v, uint32_t n )
+{
+	int lead = -1, trail = 0, l, t;
+	uint32_t i, x;
+
+	putBits( w, v[0], 32 );
+	for( i = 1; i < n; i++ )
+	{
+		x = (uint32_t) (v[i] ^ v[i-1]);
+		if( x == 0 )
+		{
+			putBits( w, 0, 1 );
+			continue;
+		}
+
+		l = __builtin_clz( x );
+		t = __builtin_ctz( x );
+		if( lead >= 0 && l >= lead && t >= trail )
+		{
+			putBits( w, 2, 2 );
+			putBits( w, x >> trail, 32 - lead - trail );
+		}
+		else
+		{
+			putBits( w, 3, 2 );
+			putBits( w, l, 5 );
+			putBits( w, 32 - l - t - 1, 5 );
+			putBits( w, x >> t, 32 - l - t );
+			lead = l;
+			trail = t;
+		}
+	}
+}
+
+static Bool decodeFloats( BitReader *r, float *out, uint32_t n )
+{
+	int lead = -1, trail = 0, len;
+	uint32_t i, v;
+
+	v = (uint32_t) getBits( r, 32 );
+	memcpy( &out[0], &v, sizeof(v) );
+	for( i = 1; i < n; i++ )
+	{
+		if( getBits( r, 1 ) )
+		{
+			if( getBits( r, 1 ) )
+			{
+				lead = (int) getBits( r, 5 );
+				len = (int) getBits( r, 5 ) + 1;
+				trail = 32 - lead - len;
+				if( trail < 0 )
+					return FALSE;
+			}
+			else if( lead < 0 )
+			{
+				return FALSE;
+			}
+			v ^= (uint32_t) getBits( r, 32 - lead - trail ) << trail;
+		}
+		memcpy( &out[i], &v, sizeof(v) );
+	}
+	return TRUE;
+}
+
+//==========================================================================================
+//
+//  Writing
+//
+//==========================================================================================
+static void writeBytes( Archive *a, const void *p, size_t len )
+{
+	if( iob_write( a->io, p, len ) != 0 )
+		a->failed = 1;
+	a->offset += len;
+}
+
+Archive *archiveOpen( const char *path, enum iob_backend backend, const char *text, size_t textBytes )
+{
+	ArchiveHeader h;
+	Archive *a;
+
+	initColumns();
+	if( (a = (Archive *) calloc( 1, sizeof(*a) )) == NULL )
+		return NULL;
+	if( (a->out = (unsigned char *) malloc( ARCHIVE_COLUMNS * STREAM_MAX )) == NULL ||
+		(a->fp = iob_fopen( path, backend )) == NULL )
+	{
+		free( a->out );
+		free( a );
+		return NULL;
+	}
+	a->io = iob_of( a->fp );
+	a->outCap = ARCHIVE_COLUMNS * STREAM_MAX;
+
+	memset( &h, 0, sizeof(h) );
+	memcpy( h.magic, ARCHIVE_MAGIC, sizeof(h.magic) );
+	h.version = ARCHIVE_VERSION;
+	h.columns = ARCHIVE_COLUMNS;
+	h.chunkRows = ARCHIVE_CHUNK;
+	h.textBytes = (uint32_t) textBytes;
+	writeBytes( a, &h, sizeof(h) );
+	writeBytes( a, columnInfo, sizeof(columnInfo) );
+	writeBytes( a, text, textBytes );
+	return a;
+}
+
+static void addIndex( Archive *a, const ArchiveChunk *c )
+{
+	ArchiveChunk *index;
+
+	if( a->chunks == a->indexCap )
+	{
+		uint32_t cap = a->indexCap ? a->indexCap * 2 : 64;
+
+		if( (index = (ArchiveChunk *) realloc( a->index, cap * sizeof(*index) )) == NULL )
+		{
+			a->failed = 1;
+			return;
+		}
+		a->index = index;
+		a->indexCap = cap;
+	}
+	a->index[a->chunks++] = *c;
+}
+
+//==========================================================================================
+//
+//  A station's chunk out: its record, then each column's stream
+//
+//==========================================================================================
+static void writeChunk( Archive *a, ArchiveSeries *s, uint8_t tracker, uint8_t station )
+{
+	ArchiveChunk c;
+	BitWriter w;
+	unsigned char *start;
+	uint32_t i;
+	int col;
+
+	memset( &c, 0, sizeof(c) );
+	memcpy( c.magic, "CHNK", sizeof(c.magic) );
+	c.rows = s->rows;
+	c.tracker = tracker;
+	c.station = station;
+	c.offset = a->offset + sizeof(c);
+	c.firstTime = (int64_t) s->values[timeColumn][0];
+	c.lastTime = (int64_t) s->values[timeColumn][s->rows - 1];
+
+	w.p = a->out;
+	w.acc = 0;
+	w.bits = 0;
+	for( col = 0; col < ARCHIVE_COLUMNS; col++ )
+	{
+		const uint64_t *v = s->values[col];
+		double x, lo = 0, hi = 0;
+		int seen = 0;
+		float f;
+
+		start = w.p;
+		if( columnInfo[col].type == ARCCOL_FLOAT )
+			encodeFloats( &w, v, s->rows );
+		else
+			encodeInts( &w, v, s->rows );
+		putFlush( &w );
+		c.columnBytes[col] = (uint32_t) (w.p - start);
+
+		for( i = 0; i < s->rows; i++ )
+		{
+			if( columnInfo[col].type == ARCCOL_FLOAT )
+			{
+				uint32_t bits = (uint32_t) v[i];
+
+				memcpy( &f, &bits, sizeof(f) );
+				x = f;
+				if( x != x )
+					continue;
+			}
+			else
+			{
+				x = (double) (int64_t) v[i];
+			}
+			if( !seen || x < lo )
+				lo = x;
+			if( !seen || x > hi )
+				hi = x;
+			seen = 1;
+		}
+		c.min[col] = lo;
+		c.max[col] = hi;
+	}
+	c.bytes = (uint32_t) (w.p - a->out);
+
+	writeBytes( a, &c, sizeof(c) );
+	writeBytes( a, a->out, c.bytes );
+	addIndex( a, &c );
+	a->rows += s->rows;
+	s->rows = 0;
+}
+
+void archiveAppend( Archive *a, const LogRecord *r )
+{
+	ArchiveSeries *s;
+	unsigned int k;
+	int col;
+
+	if( r->pose.tracker < 1 || r->pose.tracker > ISD_MAX_TRACKERS ||
+		r->pose.station < 1 || r->pose.station > ISD_MAX_STATIONS )
+		return;
+
+	k = (r->pose.tracker - 1) * ISD_MAX_STATIONS + r->pose.station - 1;
+	if( (s = a->series[k]) == NULL )
+	{
+		if( (s = a->series[k] = (ArchiveSeries *) calloc( 1, sizeof(*s) )) == NULL )
+		{
+			a->failed = 1;
+			return;
+		}
+	}
+
+	for( col = 0; col < ARCHIVE_COLUMNS; col++ )
+		s->values[col][s->rows] = getField( col, r );
+	if( ++s->rows == ARCHIVE_CHUNK )
+		writeChunk( a, s, r->pose.tracker, r->pose.station );
+}
+
+void archiveStore( AsyncLog *log, const LogRecord *r )
+{
+	Archive *a = (Archive *) log->context;
+
+	if( log->osTimeOffset == 0.0 )
+		log->osTimeOffset = a->osTimeOffset = r->ext.os_time_s + r->ext.os_time_us * 1.0e-6 - r->pose.time;
+	archiveAppend( a, r );
+}
+
+int archiveClose( Archive *a, uint64_t *bytes )
+{
+	ArchiveTrailer t;
+	unsigned int k;
+	int failed;
+
+	for( k = 0; k < ISD_MAX_TRACKERS * ISD_MAX_STATIONS; k++ )
+	{
+		if( a->series[k] && a->series[k]->rows )
+			writeChunk( a, a->series[k], k / ISD_MAX_STATIONS + 1, k % ISD_MAX_STATIONS + 1 );
+		free( a->series[k] );
+	}
+
+	memset( &t, 0, sizeof(t) );
+	t.index = a->offset;
+	t.chunks = a->chunks;
+	t.osTimeOffset = a->osTimeOffset;
+	memcpy( t.magic, ARCHIVE_END, sizeof(t.magic) );
+	writeBytes( a, a->index, a->chunks * sizeof(ArchiveChunk) );
+	writeBytes( a, &t, sizeof(t) );
+
+	if( iob_flush( a->io ) != 0 )
+		a->failed = 1;
+	if( fclose( a->fp ) != 0 )
+		a->failed = 1;
+
+	failed = a->failed;
+	if( bytes )
+		*bytes = a->offset;
+	free( a->index );
+	free( a->out );
+	free( a );
+	return failed ? -1 : 0;
+}
+
+//==========================================================================================
+//
+//  Reading
+//
+//==========================================================================================
+static Bool readAt( ArchiveReader *rd, void *p, size_t len, uint64_t offset )
+{
+	ssize_t n;
+
+	while( len > 0 )
+	{
+		if( (n = pread( rd->fd, p, len, (off_t) offset )) <= 0 )
+		{
+			if( n < 0 && errno == EINTR )
+				continue;
+			return FALSE;
+		}
+		p = (char *) p + n;
+		len -= n;
+		offset += n;
+	}
+	return TRUE;
+}
+
+static Bool chunkValid( const ArchiveReader *rd, const ArchiveChunk *c )
+{
+	uint64_t sum = 0;
+	int col;
+
+	if( memcmp( c->magic, "CHNK", sizeof(c->magic) ) != 0 || c->rows == 0 ||
+		c->rows > ARCHIVE_CHUNK || c->offset + c->bytes > rd->size )
+		return FALSE;
+	for( col = 0; col < ARCHIVE_COLUMNS; col++ )
+	{
+		if( c->columnBytes[col] > STREAM_MAX )
+			return FALSE;
+		sum += c->columnBytes[col];
+	}
+	return sum == c->bytes;
+}
+
+// With no trailer, the chunk records are found one after another from the first
+static Bool walkChunks( ArchiveReader *rd, uint64_t offset )
+{
+	ArchiveChunk c, *index;
+	uint32_t cap = 0;
+
+	while( offset + sizeof(c) <= rd->size && readAt( rd, &c, sizeof(c), offset ) &&
+		   c.offset == offset + sizeof(c) && chunkValid( rd, &c ) )
+	{
+		if( rd->chunks == cap )
+		{
+			cap = cap ? cap * 2 : 64;
+			if( (index = (ArchiveChunk *) realloc( rd->index, cap * sizeof(*index) )) == NULL )
+				return FALSE;
+			rd->index = index;
+		}
+		rd->index[rd->chunks++] = c;
+		offset = c.offset + c.bytes;
+	}
+	return TRUE;
+}
+
+Bool archiveRead( ArchiveReader *rd, const char *path )
+{
+	ArchiveTrailer t;
+	struct stat st;
+	uint64_t data;
+	uint32_t i;
+
+	initColumns();
+	memset( rd, 0, sizeof(*rd) );
+	if( (rd->fd = open( path, O_RDONLY )) < 0 )
+		return FALSE;
+	if( fstat( rd->fd, &st ) != 0 )
+		goto fail;
+	rd->size = (uint64_t) st.st_size;
+
+	if( !readAt( rd, &rd->header, sizeof(rd->header), 0 ) ||
+		memcmp( rd->header.magic, ARCHIVE_MAGIC, sizeof(rd->header.magic) ) != 0 ||
+		rd->header.version != ARCHIVE_VERSION || rd->header.columns != ARCHIVE_COLUMNS ||
+		rd->header.chunkRows != ARCHIVE_CHUNK ||
+		!readAt( rd, rd->columns, sizeof(rd->columns), sizeof(rd->header) ) ||
+		(rd->text = (char *) malloc( rd->header.textBytes + 1 )) == NULL ||
+		!readAt( rd, rd->text, rd->header.textBytes, sizeof(rd->header) + sizeof(rd->columns) ) ||
+		(rd->in = (unsigned char *) malloc( STREAM_MAX )) == NULL )
+	{
+		errno = EINVAL;
+		goto fail;
+	}
+	rd->text[rd->header.textBytes] = '\0';
+	rd->inCap = STREAM_MAX;
+	data = sizeof(rd->header) + sizeof(rd->columns) + rd->header.textBytes;
+
+	// The index at the end if it was closed, else whatever chunks made it
+	if( rd->size >= data + sizeof(t) && readAt( rd, &t, sizeof(t), rd->size - sizeof(t) ) &&
+		memcmp( t.magic, ARCHIVE_END, sizeof(t.magic) ) == 0 &&
+		t.index + (uint64_t) t.chunks * sizeof(ArchiveChunk) + sizeof(t) == rd->size &&
+		(rd->index = (ArchiveChunk *) malloc( t.chunks * sizeof(ArchiveChunk) + 1 )) != NULL &&
+		readAt( rd, rd->index, t.chunks * sizeof(ArchiveChunk), t.index ) )
+	{
+		rd->chunks = t.chunks;
+		rd->osTimeOffset = t.osTimeOffset;
+		rd->closed = 1;
+		for( i = 0; i < rd->chunks; i++ )
+		{
+			if( !chunkValid( rd, &rd->index[i] ) )
+			{
+				errno = EINVAL;
+				goto fail;
+			}
+		}
+	}
+	else if( !walkChunks( rd, data ) )
+	{
+		goto fail;
+	}
+	return TRUE;
+
+fail:
+	archiveDone( rd );
+	return FALSE;
+}
+
+int archiveColumn( const ArchiveReader *rd, const char *name )
+{
+	int col;
+
+	for( col = 0; col < ARCHIVE_COLUMNS; col++ )
+	{
+		if( strncmp( rd->columns[col].name, name, ARCHIVE_NAME ) == 0 )
+			return col;
+	}
+	return -1;
+}
+
+Bool archiveDecode( ArchiveReader *rd, uint32_t chunk, int column, void *out )
+{
+	const ArchiveChunk *c;
+	uint64_t offset;
+	BitReader r;
+	int col;
+
+	if( chunk >= rd->chunks || column < 0 || column >= ARCHIVE_COLUMNS )
+		return FALSE;
+
+	c = &rd->index[chunk];
+	offset = c->offset;
+	for( col = 0; col < column; col++ )
+		offset += c->columnBytes[col];
+	if( !readAt( rd, rd->in, c->columnBytes[column], offset ) )
+		return FALSE;
+	rd->bytesRead += c->columnBytes[column];
+
+	r.p = rd->in;
+	r.end = rd->in + c->columnBytes[column];
+	r.acc = 0;
+	r.bits = 0;
+	r.overrun = 0;
+	if( rd->columns[column].type == ARCCOL_FLOAT )
+	{
+		if( !decodeFloats( &r, (float *) out, c->rows ) )
+			return FALSE;
+	}
+	else
+	{
+		decodeInts( &r, (int64_t *) out, c->rows );
+	}
+	return !r.overrun;
+}
+
+Bool archiveDecodeRecords( ArchiveReader *rd, uint32_t chunk, LogRecord *out )
+{
+	int64_t values[ARCHIVE_CHUNK];
+	uint32_t i, rows;
+	int col;
+
+	if( chunk >= rd->chunks )
+		return FALSE;
+
+	rows = rd->index[chunk].rows;
+	memset( out, 0, rows * sizeof(*out) );
+	for( col = 0; col < ARCHIVE_COLUMNS; col++ )
+	{
+		if( !archiveDecode( rd, chunk, col, values ) )
+			return FALSE;
+
+		// floats came out as floats, put back as their bits
+		for( i = 0; i < rows; i++ )
+		{
+			if( rd->columns[col].type == ARCCOL_FLOAT )
+			{
+				uint32_t bits;
+
+				memcpy( &bits, (float *) values + i, sizeof(bits) );
+				setField( col, &out[i], bits );
+			}
+			else
+			{
+				setField( col, &out[i], (uint64_t) values[i] );
+			}
+		}
+	}
+	return TRUE;
+}
+
+void archiveDone( ArchiveReader *rd )
+{
+	int err = errno;
+
+	if( rd->fd >= 0 )
+		close( rd->fd );
+	free( rd->text );
+	free( rd->index );
+	free( rd->in );
+	memset( rd, 0, sizeof(*rd) );
+	rd->fd = -1;
+	errno = err;
+}
@@ -0,0 +1,179 @@
+//==========================================================================================
+//
+//    File Name:      archive.h
+//    Description:    A columnar, compressed archive of the station logs' samples
+//
+//    Comments:       An hour of a station log is hundreds of MB of text, although
+//                    most of its columns barely change (Position is all zeros on an
+//                    IC4) and an analysis usually wants three to six of them. An
+//                    archive keeps each of the log's columns (see logplan.h) in a
+//                    stream of its own, compressed the way time series are:
+//
+//                        times and integers    delta-of-delta, a bit for each
+//                                              sample keeping its step
+//                        floats                XOR with the sample before, in
+//                                              Gorilla's leading/trailing-zero
+//                                              windows; a bit for a repeat
+//
+//                    The samples of each station go in chunks of ARCHIVE_CHUNK, and
+//                    each chunk's column streams lie one after another behind a
+//                    chunk record, which says whose samples they are, their first
+//                    and last DoubleTime, and each column's bytes, minimum and
+//                    maximum. A copy of all the chunk records closes the file, so
+//                    a reader finds the chunks it wants without reading the rest,
+//                    and then reads only the columns it wants of those. If the
+//                    archive was never closed, the records are found by walking
+//                    the chunks instead.
+//
+//                    The log's header sections are kept as the text logHeader
+//                    wrote (see main.c), so the whole log can be written out again.
+//
+//                        Archive *a = archiveOpen( "stationdata.arc", IOB_PLAIN, text, len );
+//                        asyncLogStartStore( &log, archiveStore, a, &rt );
+//                        ...
+//                        asyncLogStop( &log );
+//                        archiveClose( a, NULL );
+//
+//                        ArchiveReader rd;
+//                        archiveRead( &rd, "stationdata.arc" );
+//                        yaw = archiveColumn( &rd, "Yaw" );
+//                        for( i = 0; i < rd.chunks; i++ )
+//                            archiveDecode( &rd, i, yaw, values );    // float[ARCHIVE_CHUNK]
+//                        archiveDone( &rd );
+//
+//                    Columns hold the records' own values: TQ is TrackingStatus,
+//                    0 to 255, times are microseconds, and DoubleOSTime leaves out
+//                    the log's OS time offset, which the archive keeps once. The
+//                    input columns are 0 where the log writes -1; the LogPlan
+//                    column says which of them a station had (see logPlanIndex).
+//
+//==========================================================================================
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdint.h>
+
+#include "asynclog.h"
+#include "logplan.h"
+
+#define ARCHIVE_MAGIC		"ISARCHIV"
+#define ARCHIVE_END			"ISARCEND"
+#define ARCHIVE_VERSION		1
+#define ARCHIVE_CHUNK		2048					// samples, ~11 s at 180 Hz
+#define ARCHIVE_COLUMNS		(LOGPLAN_COLUMNS + 1)	// and the LogPlan column
+#define ARCHIVE_NAME		16						// bytes of a column's name
+
+typedef enum
+{
+	ARCCOL_INT,				// an integer field, int64_t when decoded
+	ARCCOL_TIME,			// seconds and microseconds, as int64_t microseconds
+	ARCCOL_FLOAT			// a float field, float when decoded
+} ArchiveColumnType;
+
+// At the start of the file, followed by the column descriptors and the header text
+typedef struct
+{
+	char					magic[8];		// ARCHIVE_MAGIC
+	uint32_t				version;		// ARCHIVE_VERSION
+	uint32_t				columns;		// ARCHIVE_COLUMNS
+	uint32_t				chunkRows;		// ARCHIVE_CHUNK
+	uint32_t				textBytes;		// of the header text
+} ArchiveHeader;
+
+typedef struct
+{
+	char					name[ARCHIVE_NAME];	// as in the column header, NUL padded
+	uint8_t					type;				// ArchiveColumnType
+	uint8_t					decimals;			// the log writes
+	uint8_t					pad[6];
+} ArchiveColumnInfo;
+
+// Before each chunk's column streams, and copied into the index at the end
+typedef struct
+{
+	char					magic[4];		// "CHNK"
+	uint32_t				rows;
+	uint8_t					tracker, station, pad[2];
+	uint32_t				bytes;			// of the column streams
+	uint64_t				offset;			// of the first column stream in the file
+	int64_t					firstTime;		// DoubleTime, microseconds
+	int64_t					lastTime;
+	uint32_t				columnBytes[ARCHIVE_COLUMNS];
+	double					min[ARCHIVE_COLUMNS];
+	double					max[ARCHIVE_COLUMNS];
+} ArchiveChunk;
+
+// The file's last bytes once it's closed
+typedef struct
+{
+	uint64_t				index;			// offset of the chunk records
+	uint32_t				chunks;
+	uint32_t				pad;
+	double					osTimeOffset;	// to take from DoubleOSTime, see logRow in main.c
+	char					magic[8];		// ARCHIVE_END
+} ArchiveTrailer;
+
+typedef struct ArchiveSeries ArchiveSeries;
+
+typedef struct
+{
+	FILE					*fp;
+	struct iob				*io;
+	uint64_t				offset;			// bytes written so far
+	double					osTimeOffset;	// set by whoever knows it before archiveClose
+	ArchiveSeries			*series[ISD_MAX_TRACKERS * ISD_MAX_STATIONS];
+	ArchiveChunk			*index;			// chunk records written so far
+	uint32_t				chunks, indexCap;
+	unsigned char			*out;			// a chunk's column streams, being encoded
+	size_t					outCap;
+	uint64_t				rows;			// in chunks written so far
+	int						failed;			// out of memory or a write failed
+} Archive;
+
+typedef struct
+{
+	int						fd;
+	uint64_t				size;
+	ArchiveHeader			header;
+	ArchiveColumnInfo		columns[ARCHIVE_COLUMNS];
+	char					*text;			// the header text, NUL terminated
+	ArchiveChunk			*index;
+	uint32_t				chunks;
+	int						closed;			// the trailer was there; else the chunks were walked
+	double					osTimeOffset;
+	unsigned char			*in;			// a column stream, being decoded
+	size_t					inCap;
+	uint64_t				bytesRead;		// of column streams, so far
+} ArchiveReader;
+
+// Creates path through an iob (see iob.h) and writes the header, with the header text;
+// NULL if it couldn't
+Archive *archiveOpen( const char *path, enum iob_backend backend, const char *text, size_t textBytes );
+
+// Adds a record to its station's chunk, writing the chunk out once it's full
+void archiveAppend( Archive *a, const LogRecord *r );
+
+// An AsyncLogStore for archiveAppend, with the Archive as the log's context; takes the
+// OS time offset from the first record as logRow does
+void archiveStore( AsyncLog *log, const LogRecord *r );
+
+// Writes the chunks still filling, the index and the trailer, closes the file and frees
+// a, with the file's size in bytes unless it's NULL; 0, or -1 if anything failed
+int archiveClose( Archive *a, uint64_t *bytes );
+
+// Opens path and reads its header and chunk records; FALSE if it isn't an archive
+Bool archiveRead( ArchiveReader *rd, const char *path );
+
+// The column called name, or -1
+int archiveColumn( const ArchiveReader *rd, const char *name );
+
+// Decodes one column of one chunk into out, int64_t or float per its type, rows of them
+Bool archiveDecode( ArchiveReader *rd, uint32_t chunk, int column, void *out );
+
+// The chunk's samples as records, from every column (ARCHIVE_CHUNK of them)
+Bool archiveDecodeRecords( ArchiveReader *rd, uint32_t chunk, LogRecord *out );
+
+void archiveDone( ArchiveReader *rd );
+
+#endif
@@ -0,0 +1,143 @@
+//==========================================================================================
+//
+//    File Name:      asynclog.c
+//    Description:    A log file written by a thread of its own, see asynclog.h
+//
+//==========================================================================================
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "asynclog.h"
+
+#define ASYNCLOG_MASK	(ASYNCLOG_QUEUE - 1)
+#define ASYNCLOG_IDLE	5000000		// ns the writer sleeps when it finds the queue empty
+
+static void *writerThread( void *arg )
+{
+	AsyncLog *log = (AsyncLog *) arg;
+	struct timespec idle = { 0, ASYNCLOG_IDLE };
+	char line[ASYNCLOG_LINE_MAX];
+	unsigned int tail = atomic_load_explicit( &log->tail, memory_order_relaxed );
+	unsigned int head;
+
+	for( ;; )
+	{
+		// running is read first, so nothing pushed before the stop is missed
+		int running = atomic_load_explicit( &log->running, memory_order_acquire );
+
+		head = atomic_load_explicit( &log->head, memory_order_acquire );
+		if( tail == head )
+		{
+			if( !running )
+				break;
+			nanosleep( &idle, NULL );
+			continue;
+		}
+
+		if( head - tail > atomic_load_explicit( &log->maxDepth, memory_order_relaxed ) )
+			atomic_store_explicit( &log->maxDepth, head - tail, memory_order_relaxed );
+		atomic_fetch_add_explicit( &log->lines, head - tail, memory_order_relaxed );
+
+		while( tail != head )
+		{
+			if( log->store )
+			{
+				log->store( log, &log->records[tail & ASYNCLOG_MASK] );
+			}
+			else
+			{
+				size_t n = log->format( log, &log->records[tail & ASYNCLOG_MASK], line );
+
+				if( iob_write( log->io, line, n ) != 0 )
+					atomic_store_explicit( &log->failed, 1, memory_order_relaxed );
+			}
+			tail++;
+			atomic_store_explicit( &log->tail, tail, memory_order_release );
+		}
+	}
+	return NULL;
+}
+
+// The queue and the thread, for a log set up but otherwise zeroed
+static Bool startWriter( AsyncLog *log, const struct rt_request *rt )
+{
+	void *records;
+
+	if( posix_memalign( &records, POSE_LINE, ASYNCLOG_QUEUE * sizeof(LogRecord) ) != 0 )
+		return FALSE;
+
+	log->records = (LogRecord *) records;
+	atomic_store( &log->running, 1 );
+	if( pthread_create( &log->thread, NULL, writerThread, log ) != 0 )
+	{
+		free( log->records );
+		log->records = NULL;
+		return FALSE;
+	}
+	if( rt )
+		rt_apply( log->thread, "log writer", rt );
+	return TRUE;
+}
+
+Bool asyncLogStart( AsyncLog *log, FILE *fp, AsyncLogFormat format, const struct rt_request *rt )
+{
+	memset( log, 0, sizeof(*log) );
+	if( !(log->io = iob_of( fp )) )
+		return FALSE;
+
+	fflush( fp );
+	log->fp = fp;
+	log->format = format;
+	return startWriter( log, rt );
+}
+
+Bool asyncLogStartStore( AsyncLog *log, AsyncLogStore store, void *context,
+						 const struct rt_request *rt )
+{
+	memset( log, 0, sizeof(*log) );
+	log->store = store;
+	log->context = context;
+	return startWriter( log, rt );
+}
+
+void asyncLogStop( AsyncLog *log )
+{
+	if( !log->records )
+		return;
+
+	atomic_store_explicit( &log->running, 0, memory_order_release );
+	pthread_join( log->thread, NULL );
+	free( log->records );
+	log->records = NULL;
+}
+
+LogRecord *asyncLogReserve( AsyncLog *log )
+{
+	unsigned int head = atomic_load_explicit( &log->head, memory_order_relaxed );
+
+	if( head - log->tailCache == ASYNCLOG_QUEUE )
+	{
+		log->tailCache = atomic_load_explicit( &log->tail, memory_order_acquire );
+		if( head - log->tailCache == ASYNCLOG_QUEUE )
+		{
+			atomic_fetch_add_explicit( &log->dropped, 1, memory_order_relaxed );
+			return NULL;
+		}
+	}
+	return &log->records[head & ASYNCLOG_MASK];
+}
+
+void asyncLogCommit( AsyncLog *log )
+{
+	unsigned int head = atomic_load_explicit( &log->head, memory_order_relaxed );
+
+	atomic_store_explicit( &log->head, head + 1, memory_order_release );
+}
+
+unsigned int asyncLogDepth( AsyncLog *log )
+{
+	return atomic_load_explicit( &log->head, memory_order_acquire ) -
+		   atomic_load_explicit( &log->tail, memory_order_acquire );
+}
@@ -0,0 +1,96 @@
+//==========================================================================================
+//
+//    File Name:      asynclog.h
+//    Description:    A log file written by a thread of its own
+//
+//    Comments:       Formatting and writing a log line per sample in the polling loop
+//                    means a slow disk makes the loop late, and the ring buffers it
+//                    drains overrun. An AsyncLog takes the samples as pose records
+//                    through a lock-free queue instead; its thread formats them into
+//                    the file's iob blocks (see iob.h), which go out with one write()
+//                    per 64 KB block, or through io_uring while the next block fills.
+//                    When the writer falls a whole queue behind, samples are dropped
+//                    and counted rather than waited for.
+//
+//                        fp = iob_fopen( "stationdata.log", IOB_PLAIN );
+//                        ...write the header to fp
+//                        asyncLogStart( &log, fp, formatRow, &rt );
+//                        ...
+//                        LogRecord *r = asyncLogReserve( &log );
+//                        if( r ) { fill in r->pose, r->ext; asyncLogCommit( &log ); }
+//                        ...
+//                        asyncLogStop( &log );   // writes what's queued, fp stays open
+//
+//==========================================================================================
+
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "isense.h"
+#include "../pose.h"
+#include "../iob.h"
+#include "../rt.h"
+
+#define ASYNCLOG_QUEUE		4096	// records, a power of two; ~3 s of 8 stations at 180 Hz
+#define ASYNCLOG_LINE_MAX	1024	// longest formatted line
+
+typedef struct
+{
+	struct pose_sample		pose;
+	struct pose_extended	ext;
+} LogRecord;
+
+typedef struct AsyncLog AsyncLog;
+
+// Formats one record as a line at out (ASYNCLOG_LINE_MAX bytes), returns its length
+typedef size_t (*AsyncLogFormat)( AsyncLog *log, const LogRecord *r, char *out );
+
+// Or takes each record itself, e.g. into a flight recorder (see flightrec.h)
+typedef void (*AsyncLogStore)( AsyncLog *log, const LogRecord *r );
+
+struct AsyncLog
+{
+	FILE					*fp;
+	struct iob				*io;
+	AsyncLogFormat			format;
+	AsyncLogStore			store;			// instead of format, fp and io
+	void					*context;		// the store's
+	double					osTimeOffset;	// the formatter's, see logRow in main.c
+	pthread_t				thread;
+	atomic_int				running;
+	LogRecord				*records;		// ASYNCLOG_QUEUE of them
+
+	// producer's line
+	_Alignas(POSE_LINE) atomic_uint head;
+	unsigned int			tailCache;
+	atomic_ulong			dropped;
+
+	// writer's line
+	_Alignas(POSE_LINE) atomic_uint tail;
+	atomic_ulong			lines;
+	atomic_uint				maxDepth;		// deepest the writer found the queue
+	atomic_int				failed;			// a block didn't write
+};
+
+// Starts the writer thread on fp, an iob_fopen stream; FALSE if it couldn't
+Bool asyncLogStart( AsyncLog *log, FILE *fp, AsyncLogFormat format, const struct rt_request *rt );
+
+// Starts the writer thread handing records to store, with log->context set to context
+Bool asyncLogStartStore( AsyncLog *log, AsyncLogStore store, void *context,
+						 const struct rt_request *rt );
+
+// Waits for everything queued to be written, then stops the thread
+void asyncLogStop( AsyncLog *log );
+
+// A record to fill in and commit, or NULL (counted as a drop) when the queue is full
+LogRecord *asyncLogReserve( AsyncLog *log );
+void asyncLogCommit( AsyncLog *log );
+
+// Records waiting for the writer
+unsigned int asyncLogDepth( AsyncLog *log );
+
+#endif
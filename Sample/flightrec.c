@@ -0,0 +1,424 @@
+//==========================================================================================
+//
+//    File Name:      flightrec.c
+//    Description:    A flight recorder of samples in a file of fixed size, see flightrec.h
+//
+//==========================================================================================
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE		// fallocate, sync_file_range
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "flightrec.h"
+
+// CRC-32 (IEEE, reflected), a nibble at a time
+static uint32_t crc32Update( uint32_t crc, const void *data, size_t len )
+{
+	static const uint32_t table[16] =
+	{
+		0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+		0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+	};
+	const unsigned char *p = (const unsigned char *) data;
+
+	crc = ~crc;
+	while( len-- )
+	{
+		crc = (crc >> 4) ^ table[(crc ^ *p) & 0x0f];
+		crc = (crc >> 4) ^ table[(crc ^ (*p++ >> 4)) & 0x0f];
+	}
+	return ~crc;
+}
+
+static uint32_t headerCrc( const FlightRecHeader *h )
+{
+	return crc32Update( 0, h, offsetof(FlightRecHeader, crc) );
+}
+
+// The slot's CRC, as if its crc field were zero
+static uint32_t slotCrc( const FlightRecSlot *s )
+{
+	static const uint32_t zero = 0;
+	uint32_t crc;
+
+	crc = crc32Update( 0, s, offsetof(FlightRecSlot, crc) );
+	crc = crc32Update( crc, &zero, sizeof(zero) );
+	return crc32Update( crc, &s->tracker, sizeof(*s) - offsetof(FlightRecSlot, tracker) );
+}
+
+static void pack( FlightRecSlot *s, const LogRecord *r )
+{
+	const struct pose_sample *p = &r->pose;
+	const struct pose_extended *x = &r->ext;
+
+	s->tracker = p->tracker;
+	s->station = p->station;
+	s->status = p->status;
+	s->flags = p->flags;
+	s->comm = p->comm;
+	s->meas = p->meas;
+	s->auxInputs = x->aux_inputs;
+	s->buttons = x->buttons;
+	memcpy( s->aux, x->aux, sizeof(s->aux) );
+	s->analog[0] = x->analog[0];
+	s->analog[1] = x->analog[1];
+	s->timeS = p->time_s;
+	s->timeUs = p->time_us;
+	s->osTimeS = x->os_time_s;
+	s->osTimeUs = x->os_time_us;
+	s->time = p->time;
+	memcpy( s->position, p->position, sizeof(s->position) );
+	memcpy( s->euler, p->euler, sizeof(s->euler) );
+	memcpy( s->angvelBody, x->angvel_body, sizeof(s->angvelBody) );
+	memcpy( s->angvel, x->angvel, sizeof(s->angvel) );
+	memcpy( s->angvelRaw, x->angvel_raw, sizeof(s->angvelRaw) );
+	memcpy( s->accelBody, x->accel_body, sizeof(s->accelBody) );
+	memcpy( s->accel, x->accel, sizeof(s->accel) );
+	memcpy( s->mag, x->mag, sizeof(s->mag) );
+	s->compassYaw = x->compass_yaw;
+	s->stillTime = x->still_time;
+	s->battery = x->battery;
+	s->temperature = x->temperature;
+}
+
+static void unpack( LogRecord *r, const FlightRecSlot *s )
+{
+	struct pose_sample *p = &r->pose;
+	struct pose_extended *x = &r->ext;
+
+	memset( r, 0, sizeof(*r) );
+	p->seq = (unsigned int) s->seq;
+	p->tracker = s->tracker;
+	p->station = s->station;
+	p->status = s->status;
+	p->flags = s->flags;
+	p->comm = s->comm;
+	p->meas = s->meas;
+	x->aux_inputs = s->auxInputs;
+	x->buttons = s->buttons;
+	memcpy( x->aux, s->aux, sizeof(x->aux) );
+	x->analog[0] = s->analog[0];
+	x->analog[1] = s->analog[1];
+	p->time_s = s->timeS;
+	p->time_us = s->timeUs;
+	x->os_time_s = s->osTimeS;
+	x->os_time_us = s->osTimeUs;
+	p->time = s->time;
+	memcpy( p->position, s->position, sizeof(p->position) );
+	memcpy( p->euler, s->euler, sizeof(p->euler) );
+	memcpy( x->angvel_body, s->angvelBody, sizeof(x->angvel_body) );
+	memcpy( x->angvel, s->angvel, sizeof(x->angvel) );
+	memcpy( x->angvel_raw, s->angvelRaw, sizeof(x->angvel_raw) );
+	memcpy( x->accel_body, s->accelBody, sizeof(x->accel_body) );
+	memcpy( x->accel, s->accel, sizeof(x->accel) );
+	memcpy( x->mag, s->mag, sizeof(x->mag) );
+	x->compass_yaw = s->compassYaw;
+	x->still_time = s->stillTime;
+	x->battery = s->battery;
+	x->temperature = s->temperature;
+}
+
+//==========================================================================================
+//
+//  Start the kernel writing back slots first to last-1, without waiting for it
+//
+//==========================================================================================
+static void writeBack( FlightRec *rec, uint32_t first, uint32_t last )
+{
+	size_t from = FLIGHTREC_HEADER + (size_t) first * sizeof(FlightRecSlot);
+	size_t to = FLIGHTREC_HEADER + (size_t) last * sizeof(FlightRecSlot);
+
+	if( first >= last )
+		return;
+
+#if defined(__linux__)
+	// msync( MS_ASYNC ) does nothing on Linux
+	if( sync_file_range( rec->fd, from, to - from, SYNC_FILE_RANGE_WRITE ) != 0 )
+		rec->failed = 1;
+#else
+	from &= ~((size_t) FLIGHTREC_HEADER - 1);
+	if( msync( rec->map + from, to - from, MS_ASYNC ) != 0 )
+		rec->failed = 1;
+#endif
+}
+
+static void writeBackUnsynced( FlightRec *rec )
+{
+	if( rec->unsynced == 0 )
+		return;
+
+	if( rec->next > rec->syncFrom )
+	{
+		writeBack( rec, rec->syncFrom, rec->next );
+	}
+	else
+	{
+		writeBack( rec, rec->syncFrom, rec->capacity );
+		writeBack( rec, 0, rec->next );
+	}
+	rec->unsynced = 0;
+	rec->syncFrom = rec->next;
+}
+
+//==========================================================================================
+//
+//  If path is a flight recorder that was never closed, all that's left of a crash, move it
+//  to the first free path.1 to path.99 and return which, so opening a new one doesn't
+//  truncate it; 0 if there was nothing to keep, -1 if there was but it couldn't be moved
+//
+//==========================================================================================
+static int keepCrashed( const char *path )
+{
+	FlightRecHeader h;
+	char kept[4096];
+	struct stat st;
+	int fd, n;
+	ssize_t got;
+
+	fd = open( path, O_RDONLY );
+	if( fd < 0 )
+		return 0;
+	got = read( fd, &h, sizeof(h) );
+	close( fd );
+	if( got != (ssize_t) sizeof(h) || memcmp( h.magic, FLIGHTREC_MAGIC, sizeof(h.magic) ) != 0 ||
+		h.crc != headerCrc( &h ) || h.closedSeq != 0 )
+		return 0;
+
+	for( n = 1; n <= 99; n++ )
+	{
+		snprintf( kept, sizeof(kept), "%s.%d", path, n );
+		if( stat( kept, &st ) != 0 && errno == ENOENT )
+			return rename( path, kept ) == 0 ? n : -1;
+	}
+	errno = EEXIST;
+	return -1;
+}
+
+Bool flightRecOpen( FlightRec *rec, const char *path, uint32_t capacity )
+{
+	FlightRecHeader *h;
+	int err, kept;
+
+	memset( rec, 0, sizeof(*rec) );
+	if( capacity == 0 )
+	{
+		errno = EINVAL;
+		return FALSE;
+	}
+
+	kept = keepCrashed( path );
+	if( kept < 0 )
+		return FALSE;
+
+	rec->size = FLIGHTREC_HEADER + (size_t) capacity * sizeof(FlightRecSlot);
+	rec->fd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+	if( rec->fd < 0 )
+		return FALSE;
+
+	// Every block allocated now, so writing a slot never has to find disk space; where
+	// the filesystem can't, the file is at least the right size
+#if defined(__linux__)
+	if( fallocate( rec->fd, 0, 0, rec->size ) != 0 && errno != EOPNOTSUPP )
+		goto fail;
+#endif
+	if( ftruncate( rec->fd, rec->size ) != 0 )
+		goto fail;
+
+	rec->map = (unsigned char *) mmap( NULL, rec->size, PROT_READ | PROT_WRITE, MAP_SHARED, rec->fd, 0 );
+	if( rec->map == MAP_FAILED )
+	{
+		rec->map = NULL;
+		goto fail;
+	}
+
+	h = rec->header = (FlightRecHeader *) rec->map;
+	rec->slots = (FlightRecSlot *) (rec->map + FLIGHTREC_HEADER);
+	rec->capacity = capacity;
+
+	memcpy( h->magic, FLIGHTREC_MAGIC, sizeof(h->magic) );
+	h->version = FLIGHTREC_VERSION;
+	h->headerSize = FLIGHTREC_HEADER;
+	h->slotSize = sizeof(FlightRecSlot);
+	h->capacity = capacity;
+	h->started = (uint64_t) time( NULL );
+	h->closedSeq = 0;
+	h->crc = headerCrc( h );
+	if( msync( rec->map, FLIGHTREC_HEADER, MS_SYNC ) != 0 )
+		goto fail;
+	rec->kept = kept;
+	return TRUE;
+
+fail:
+	err = errno;
+	if( rec->map )
+		munmap( rec->map, rec->size );
+	close( rec->fd );
+	memset( rec, 0, sizeof(*rec) );
+	errno = err;
+	return FALSE;
+}
+
+//==========================================================================================
+//
+//  The writer thread's: the record into the next slot, its sequence number and CRC last
+//
+//==========================================================================================
+void flightRecStore( AsyncLog *log, const LogRecord *r )
+{
+	FlightRec *rec = (FlightRec *) log->context;
+	FlightRecSlot *s = &rec->slots[rec->next];
+
+	pack( s, r );
+	s->seq = ++rec->seq;
+	s->crc = 0;
+	s->crc = slotCrc( s );
+
+	if( ++rec->next == rec->capacity )
+		rec->next = 0;
+	if( ++rec->unsynced >= FLIGHTREC_SYNC )
+		writeBackUnsynced( rec );
+}
+
+void flightRecClose( FlightRec *rec )
+{
+	if( !rec->map )
+		return;
+
+	writeBackUnsynced( rec );
+	if( msync( rec->map, rec->size, MS_SYNC ) != 0 )
+		rec->failed = 1;
+
+	// Only now is the header told, so a reader can tell a clean close from a crash
+	rec->header->closedSeq = rec->seq;
+	rec->header->crc = headerCrc( rec->header );
+	if( msync( rec->map, FLIGHTREC_HEADER, MS_SYNC ) != 0 )
+		rec->failed = 1;
+
+	munmap( rec->map, rec->size );
+	close( rec->fd );
+	rec->map = NULL;
+	rec->header = NULL;
+	rec->slots = NULL;
+}
+
+static Bool slotValid( const FlightRecSlot *s )
+{
+	return s->seq != 0 && s->crc == slotCrc( s );
+}
+
+//==========================================================================================
+//
+//  Check the header, then find the newest slot whose CRC checks; the oldest is the one
+//  after it, whether or not the file ever wrapped
+//
+//==========================================================================================
+Bool flightRecRead( FlightRecReader *rd, const char *path )
+{
+	const FlightRecHeader *h;
+	struct stat st;
+	uint32_t i, newestSlot = 0;
+	void *map;
+
+	memset( rd, 0, sizeof(*rd) );
+	rd->fd = open( path, O_RDONLY );
+	if( rd->fd < 0 )
+		return FALSE;
+
+	if( fstat( rd->fd, &st ) != 0 || (size_t) st.st_size < FLIGHTREC_HEADER )
+		goto fail;
+
+	rd->size = (size_t) st.st_size;
+	map = mmap( NULL, rd->size, PROT_READ, MAP_SHARED, rd->fd, 0 );
+	if( map == MAP_FAILED )
+		goto fail;
+	rd->map = (const unsigned char *) map;
+	madvise( map, rd->size, MADV_SEQUENTIAL );
+
+	h = rd->header = (const FlightRecHeader *) rd->map;
+	if( memcmp( h->magic, FLIGHTREC_MAGIC, sizeof(h->magic) ) != 0 || h->crc != headerCrc( h ) ||
+		h->version != FLIGHTREC_VERSION || h->headerSize != FLIGHTREC_HEADER ||
+		h->slotSize != sizeof(FlightRecSlot) ||
+		rd->size < FLIGHTREC_HEADER + (size_t) h->capacity * sizeof(FlightRecSlot) )
+	{
+		errno = EINVAL;
+		goto fail;
+	}
+
+	rd->slots = (const FlightRecSlot *) (rd->map + FLIGHTREC_HEADER);
+	rd->capacity = h->capacity;
+	for( i = 0; i < rd->capacity; i++ )
+	{
+		const FlightRecSlot *s = &rd->slots[i];
+
+		if( s->seq == 0 )
+			continue;
+		if( !slotValid( s ) )
+			rd->bad++;
+		else if( s->seq > rd->newest )
+		{
+			rd->newest = s->seq;
+			newestSlot = i;
+		}
+	}
+	rd->start = rd->newest ? (newestSlot + 1) % rd->capacity : 0;
+	return TRUE;
+
+fail:
+	flightRecDone( rd );
+	return FALSE;
+}
+
+//==========================================================================================
+//
+//  The slot position places after start holds sequence number newest - capacity + 1 +
+//  position, if it was written back; a slot with a good CRC and any other sequence
+//  number is left from the lap before, its new contents lost with the pages a power cut
+//  kept from the disk
+//
+//==========================================================================================
+Bool flightRecNext( FlightRecReader *rd, LogRecord *r )
+{
+	while( rd->newest && rd->visited < rd->capacity )
+	{
+		const FlightRecSlot *s = &rd->slots[(rd->start + rd->visited) % rd->capacity];
+		uint64_t expected = rd->newest + 1 + rd->visited - rd->capacity;
+
+		rd->visited++;
+		if( !slotValid( s ) )
+			continue;
+		if( s->seq != expected )
+		{
+			rd->stale++;
+			continue;
+		}
+		unpack( r, s );
+		rd->records++;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+void flightRecDone( FlightRecReader *rd )
+{
+	int err = errno;
+
+	if( rd->map )
+		munmap( (void *) rd->map, rd->size );
+	if( rd->fd >= 0 )
+		close( rd->fd );
+	rd->map = NULL;
+	rd->header = NULL;
+	rd->slots = NULL;
+	rd->fd = -1;
+	errno = err;
+}
@@ -0,0 +1,143 @@
+//==========================================================================================
+//
+//    File Name:      flightrec.h
+//    Description:    A flight recorder: the last hours of samples, in a file of fixed size
+//
+//    Comments:       A text log of all trackers grows for as long as it runs, and
+//                    what a crash leaves of its last lines is anyone's guess. A flight
+//                    recorder file is allocated in full when it's opened (fallocate)
+//                    and mapped; the log's writer thread (see asynclog.h) copies each
+//                    record into the next fixed-size slot, wrapping round to the first
+//                    once the file is full, so the file always holds the latest
+//                    capacity samples. Writing a slot is a memcpy into the map, with
+//                    no syscall; every FLIGHTREC_SYNC records the pages written since
+//                    are handed to the kernel to write back, so a power cut loses
+//                    about that many.
+//
+//                    Each slot carries a 64-bit sequence number and a CRC-32 of the
+//                    whole slot, written last. A reader finds the newest slot whose
+//                    CRC checks and reads the ring oldest-first from the one after
+//                    it, skipping slots a crash left half-written or never reached,
+//                    and slots whose sequence number isn't the one their place in
+//                    the ring calls for: pages can reach the disk in any order, so
+//                    a power cut can leave a slot as it was a lap before, CRC and
+//                    all. Nothing else has to have made it to disk.
+//
+//                        FlightRec rec;
+//                        flightRecOpen( &rec, "alldata.rec", capacity );
+//                        asyncLogStartStore( &log, flightRecStore, &rec, &rt );
+//                        ...
+//                        asyncLogStop( &log );
+//                        flightRecClose( &rec );
+//
+//                        FlightRecReader rd;
+//                        flightRecRead( &rd, "alldata.rec" );
+//                        while( flightRecNext( &rd, &record ) ) ...
+//                        flightRecDone( &rd );
+//
+//                    Slots keep what the station logs' columns hold (see logplan.h);
+//                    the quaternion and battery state are left out. With -M the map
+//                    is locked in memory like everything else, so the file has to fit.
+//
+//==========================================================================================
+
+#ifndef FLIGHTREC_H
+#define FLIGHTREC_H
+
+#include <stdint.h>
+
+#include "asynclog.h"
+
+#define FLIGHTREC_MAGIC		"ISFLTREC"
+#define FLIGHTREC_VERSION	1
+#define FLIGHTREC_HEADER	4096	// bytes before the first slot, a page
+#define FLIGHTREC_SYNC		2048	// records between writebacks, ~1.4 s of 8 stations at 180 Hz
+
+// At the start of the file, written when it's opened and again when it's closed
+typedef struct
+{
+	char					magic[8];		// FLIGHTREC_MAGIC, no terminator
+	uint32_t				version;		// FLIGHTREC_VERSION
+	uint32_t				headerSize;		// FLIGHTREC_HEADER
+	uint32_t				slotSize;		// sizeof(FlightRecSlot)
+	uint32_t				capacity;		// slots
+	uint64_t				started;		// time(), when opened
+	uint64_t				closedSeq;		// the last slot's sequence number once closed, else 0
+	uint32_t				crc;			// of the header up to here
+	uint32_t				pad;
+} FlightRecHeader;
+
+// One sample, 160 bytes
+typedef struct
+{
+	uint64_t				seq;			// from 1; 0 in a slot never written
+	uint32_t				crc;			// of the slot with this field zero
+	uint8_t					tracker, station, status, flags;
+	uint8_t					comm, meas, auxInputs, buttons;
+	uint8_t					aux[4];
+	int16_t					analog[2];
+	uint32_t				timeS, timeUs, osTimeS, osTimeUs;
+	float					time;
+	float					position[3], euler[3];
+	float					angvelBody[3], angvel[3], angvelRaw[3];
+	float					accelBody[3], accel[3], mag[3];
+	float					compassYaw, stillTime, battery, temperature;
+} FlightRecSlot;
+
+typedef char flightRecSlotFits[sizeof(FlightRecSlot) == 160 ? 1 : -1];
+typedef char flightRecHeaderFits[sizeof(FlightRecHeader) <= FLIGHTREC_HEADER ? 1 : -1];
+
+typedef struct
+{
+	int						fd;
+	unsigned char			*map;
+	size_t					size;
+	FlightRecHeader			*header;
+	FlightRecSlot			*slots;
+	uint32_t				capacity;
+	uint32_t				next;			// slot to write
+	uint64_t				seq;			// of the last slot written
+	uint32_t				unsynced;		// slots written since the last writeback
+	uint32_t				syncFrom;		// the first of them
+	int						failed;			// a writeback failed
+	int						kept;			// n if a crashed recording at path was kept as path.n
+} FlightRec;
+
+typedef struct
+{
+	int						fd;
+	const unsigned char		*map;
+	size_t					size;
+	const FlightRecHeader	*header;
+	const FlightRecSlot		*slots;
+	uint32_t				capacity;
+	uint32_t				start;			// oldest slot
+	uint32_t				visited;		// slots looked at so far
+	uint64_t				newest;			// sequence number of the newest valid slot, 0 if none
+	uint64_t				records;		// valid slots returned so far
+	uint64_t				bad;			// slots with a sequence number but a bad CRC
+	uint64_t				stale;			// slots with a good CRC but left from a lap before
+} FlightRecReader;
+
+// Creates path (truncating it) with room for capacity records and maps it; FALSE if
+// it couldn't, with errno set. A recording at path that was never closed is what a
+// crash left, so it's renamed to path.1 (or .2, ...) first and rec->kept says which;
+// FALSE if it can't be
+Bool flightRecOpen( FlightRec *rec, const char *path, uint32_t capacity );
+
+// An AsyncLogStore, with the FlightRec as the log's context
+void flightRecStore( AsyncLog *log, const LogRecord *r );
+
+// Writes everything back, marks the header closed and unmaps the file
+void flightRecClose( FlightRec *rec );
+
+// Maps path read-only and finds its oldest record; FALSE if it isn't a flight recorder
+Bool flightRecRead( FlightRecReader *rd, const char *path );
+
+// The next record oldest-first, unpacked into r (with the flags logplan.h needs); FALSE
+// at the end
+Bool flightRecNext( FlightRecReader *rd, LogRecord *r );
+
+void flightRecDone( FlightRecReader *rd );
+
+#endif
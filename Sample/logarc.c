@@ -0,0 +1,261 @@
+//==========================================================================================
+//
+//    File Name:      logarc.c
+//    Description:    Packs station logs into archives (see archive.h) and reads them back
+//
+//    Comments:       pack reads a log's header sections and data lines, writes them as
+//                    an archive and says what each column came to. cat writes the
+//                    whole log out again, a station's chunk at a time. cols writes just
+//                    the columns asked for, as CSV after the tracker, station and
+//                    DoubleTime, reading only those columns of the chunks that overlap
+//                    the time range.
+//
+//                        make logarc
+//                        ./logarc pack stationdata.log stationdata.arc
+//                        ./logarc cat stationdata.arc > stationdata.log
+//                        ./logarc cols stationdata.arc Yaw,Pitch,Roll [from to]
+//
+//==========================================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "archive.h"
+#include "../fmt.h"
+
+static LogRecord records[ARCHIVE_CHUNK];
+
+static int usage( const char *argv0 )
+{
+	fprintf( stderr, "usage: %s pack LOG ARCHIVE\n", argv0 );
+	fprintf( stderr, "       %s cat ARCHIVE\n", argv0 );
+	fprintf( stderr, "       %s cols ARCHIVE COLUMN[,COLUMN...] [FROM TO]\n", argv0 );
+	return 1;
+}
+
+static Bool openArchive( ArchiveReader *rd, const char *path )
+{
+	if( archiveRead( rd, path ) )
+		return TRUE;
+	fprintf( stderr, "Couldn't read %s as an archive (%s)\n", path, strerror(errno) );
+	return FALSE;
+}
+
+//==========================================================================================
+//
+//  Log in, archive out, and what each column of it takes
+//
+//==========================================================================================
+static int pack( const char *logPath, const char *arcPath )
+{
+	static char line[4 * ASYNCLOG_LINE_MAX];
+	unsigned long long logBytes = 0, rows = 0, bad = 0, bytes[ARCHIVE_COLUMNS] = { 0 };
+	char *text = NULL, *grown;
+	size_t textBytes = 0, textCap = 0, len;
+	ArchiveReader rd;
+	Archive *a = NULL;
+	LogRecord r;
+	uint32_t i;
+	FILE *fp;
+	int col;
+
+	if( (fp = fopen( logPath, "r" )) == NULL )
+	{
+		fprintf( stderr, "Couldn't open %s (%s)\n", logPath, strerror(errno) );
+		return 1;
+	}
+
+	while( fgets( line, sizeof(line), fp ) )
+	{
+		len = strlen( line );
+		logBytes += len;
+		if( a )
+		{
+			if( logPlanParse( line, &r ) )
+				archiveAppend( a, &r ), rows++;
+			else
+				bad++;
+			continue;
+		}
+
+		// Everything up to and including the column header is kept as it is
+		if( textBytes + len > textCap )
+		{
+			textCap = 2 * (textBytes + len);
+			if( (grown = (char *) realloc( text, textCap )) == NULL )
+				break;
+			text = grown;
+		}
+		memcpy( text + textBytes, line, len );
+		textBytes += len;
+		if( strcmp( line, LOGPLAN_HEADER ) == 0 &&
+			(a = archiveOpen( arcPath, IOB_PLAIN, text, textBytes )) == NULL )
+		{
+			fprintf( stderr, "Couldn't create %s (%s)\n", arcPath, strerror(errno) );
+			break;
+		}
+	}
+	fclose( fp );
+	free( text );
+	if( !a )
+	{
+		fprintf( stderr, "No archive written; is %s a station log?\n", logPath );
+		return 1;
+	}
+	if( archiveClose( a, NULL ) != 0 )
+	{
+		fprintf( stderr, "Couldn't write %s\n", arcPath );
+		return 1;
+	}
+
+	if( !openArchive( &rd, arcPath ) )
+		return 1;
+	for( i = 0; i < rd.chunks; i++ )
+		for( col = 0; col < ARCHIVE_COLUMNS; col++ )
+			bytes[col] += rd.index[i].columnBytes[col];
+
+	printf( "%-14s %10s %9s\n", "column", "bytes", "bits/row" );
+	for( col = 0; col < ARCHIVE_COLUMNS; col++ )
+		printf( "%-14.*s %10llu %9.2f\n", ARCHIVE_NAME, rd.columns[col].name, bytes[col],
+				rows ? bytes[col] * 8.0 / rows : 0.0 );
+	printf( "%llu rows in %u chunks\n", rows, rd.chunks );
+	printf( "%s %llu bytes, %s %llu bytes, %.1fx\n", logPath, logBytes, arcPath,
+			(unsigned long long) rd.size, (double) logBytes / rd.size );
+	if( bad )
+		printf( "%llu lines after the column header weren't data lines and were left out\n", bad );
+	archiveDone( &rd );
+	return 0;
+}
+
+//==========================================================================================
+//
+//  The log again, from every column
+//
+//==========================================================================================
+static int cat( const char *arcPath )
+{
+	static LogPlan plans[LOGPLAN_COUNT];
+	char line[ASYNCLOG_LINE_MAX];
+	ArchiveReader rd;
+	uint32_t i, k;
+
+	if( !openArchive( &rd, arcPath ) )
+		return 1;
+
+	logPlanInit( plans );
+	fputs( rd.text, stdout );
+	for( i = 0; i < rd.chunks; i++ )
+	{
+		if( !archiveDecodeRecords( &rd, i, records ) )
+		{
+			fprintf( stderr, "%s: chunk %u is damaged\n", arcPath, i );
+			archiveDone( &rd );
+			return 1;
+		}
+		for( k = 0; k < rd.index[i].rows; k++ )
+			fwrite( line, 1, logPlanFormat( &plans[logPlanIndex(&records[k])], &records[k],
+											rd.osTimeOffset, line ), stdout );
+	}
+	if( !rd.closed )
+		fprintf( stderr, "%s wasn't closed; wrote the %u chunks that made it\n", arcPath, rd.chunks );
+	archiveDone( &rd );
+	return fflush( stdout ) == 0 ? 0 : 1;
+}
+
+//==========================================================================================
+//
+//  Some of the columns, between two DoubleTimes in seconds
+//
+//==========================================================================================
+static int cols( const char *arcPath, char *names, double from, double to )
+{
+	static int64_t times[ARCHIVE_CHUNK], values[ARCHIVE_COLUMNS][ARCHIVE_CHUNK];
+	int want[ARCHIVE_COLUMNS], n = 0, time, c;
+	char line[ASYNCLOG_LINE_MAX], *name, *p;
+	unsigned long long rows = 0;
+	ArchiveReader rd;
+	uint32_t i, k;
+
+	if( !openArchive( &rd, arcPath ) )
+		return 1;
+
+	time = archiveColumn( &rd, "DoubleTime" );
+	for( name = strtok( names, "," ); name && n < ARCHIVE_COLUMNS; name = strtok( NULL, "," ) )
+	{
+		if( (want[n++] = archiveColumn( &rd, name )) < 0 )
+		{
+			fprintf( stderr, "%s has no column %s\n", arcPath, name );
+			archiveDone( &rd );
+			return 1;
+		}
+	}
+
+	for( i = 0; i < rd.chunks; i++ )
+	{
+		const ArchiveChunk *chunk = &rd.index[i];
+
+		// The index says which chunks to leave unread
+		if( chunk->lastTime * 1e-6 < from || chunk->firstTime * 1e-6 > to )
+			continue;
+
+		if( !archiveDecode( &rd, i, time, times ) )
+			goto damaged;
+		for( c = 0; c < n; c++ )
+			if( !archiveDecode( &rd, i, want[c], values[c] ) )
+				goto damaged;
+
+		for( k = 0; k < chunk->rows; k++ )
+		{
+			if( times[k] * 1e-6 < from || times[k] * 1e-6 > to )
+				continue;
+
+			p = fmt_uint( line, chunk->tracker ), *p++ = ',';
+			p = fmt_uint( p, chunk->station ), *p++ = ',';
+			p = fmt_fixed_d( p, times[k] * 1e-6, 4 );
+			for( c = 0; c < n; c++ )
+			{
+				const ArchiveColumnInfo *info = &rd.columns[want[c]];
+
+				*p++ = ',';
+				if( info->type == ARCCOL_FLOAT )
+					p = fmt_fixed( p, ((float *) values[c])[k], info->decimals );
+				else if( info->type == ARCCOL_TIME )
+					p = fmt_fixed_d( p, values[c][k] * 1e-6 -
+									 (strcmp( info->name, "DoubleOSTime" ) == 0 ? rd.osTimeOffset : 0),
+									 info->decimals );
+				else if( values[c][k] < 0 )
+					*p++ = '-', p = fmt_uint( p, -values[c][k] );
+				else
+					p = fmt_uint( p, values[c][k] );
+			}
+			*p++ = '\n';
+			fwrite( line, 1, p - line, stdout );
+			rows++;
+		}
+	}
+
+	fprintf( stderr, "%llu rows; read %llu of %s's %llu bytes\n", rows,
+			 (unsigned long long) rd.bytesRead, arcPath, (unsigned long long) rd.size );
+	archiveDone( &rd );
+	return fflush( stdout ) == 0 ? 0 : 1;
+
+damaged:
+	fprintf( stderr, "%s: chunk %u is damaged\n", arcPath, i );
+	archiveDone( &rd );
+	return 1;
+}
+
+int main( int argc, char **argv )
+{
+	if( argc == 4 && strcmp( argv[1], "pack" ) == 0 )
+		return pack( argv[2], argv[3] );
+	if( argc == 3 && strcmp( argv[1], "cat" ) == 0 )
+		return cat( argv[2] );
+	if( argc == 4 && strcmp( argv[1], "cols" ) == 0 )
+		return cols( argv[2], argv[3], -1e300, 1e300 );
+	if( argc == 6 && strcmp( argv[1], "cols" ) == 0 )
+		return cols( argv[2], argv[3], atof( argv[4] ), atof( argv[5] ) );
+	return usage( argv[0] );
+}
@@ -0,0 +1,170 @@
+//==========================================================================================
+//
+//    File Name:      logbench.c
+//    Description:    Benchmark of the station log's data lines, logplan.c against the
+//                    sprintf chain it replaced
+//
+//    Comments:       Reads the data lines of a log (the shipped stationdata.log by
+//                    default) back into LogRecords and formats them again both ways,
+//                    over and over, timing each. It fails if any line doesn't come
+//                    out as it was read, or as the sprintf chain writes it; only a
+//                    value exactly halfway between two last digits should (see
+//                    logplan.h), and the shipped log has none.
+//
+//                        make logbench && ./logbench [log [passes]]
+//
+//==========================================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "logplan.h"
+
+#define MAX_RECORDS		100000
+
+static double now( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//==========================================================================================
+//
+//  The data line as it was written before the column plan, one sprintf per group of fields
+//
+//==========================================================================================
+static size_t logRowPrintf( const LogRecord *r, double osTimeOffset, char *out )
+{
+	const struct pose_sample			*data = &r->pose;
+	const struct pose_extended			*ext = &r->ext;
+	char								*p = out;
+	WORD								i;
+
+	p += sprintf( p, "%d,%d,", data->tracker, data->station );
+	p += sprintf( p, "%.5f,%.5f,%.5f,",
+				data->position[0], data->position[1], data->position[2]);
+	p += sprintf( p, "%.3f,%.3f,%.3f,",
+				data->euler[0], data->euler[1], data->euler[2]);
+	p += sprintf( p, "%.4f,", data->time);
+	p += sprintf( p, "%.4f,", (double)data->time_s + 
+						  (double)data->time_us * 1.0e-6);
+	p += sprintf( p, "%.4f,", (double)ext->os_time_s + 
+						  (double)ext->os_time_us * 1.0e-6 - osTimeOffset);
+	p += sprintf( p, "%d,%d,%d,",
+		(int)(data->status/2.55), data->comm, data->meas);
+	p += sprintf( p, "%.5f,%.5f,%.5f,",
+		ext->angvel_body[0], ext->angvel_body[1], ext->angvel_body[2]);
+	p += sprintf( p, "%.5f,%.5f,%.5f,",
+		ext->angvel[0], ext->angvel[1], ext->angvel[2]);
+	p += sprintf( p, "%.5f,%.5f,%.5f,",
+		ext->angvel_raw[0], ext->angvel_raw[1], ext->angvel_raw[2]);
+	p += sprintf( p, "%.5f,%.5f,%.5f,",
+		ext->accel_body[0], ext->accel_body[1], ext->accel_body[2]);
+	p += sprintf( p, "%.5f,%.5f,%.5f,",
+		ext->accel[0], ext->accel[1], ext->accel[2]);
+	p += sprintf( p, "%.5f,%.5f,%.5f,",
+		ext->mag[0], ext->mag[1], ext->mag[2]);
+	p += sprintf( p, "%.3f,",
+		ext->compass_yaw ); 
+	if(data->flags & POSE_INPUTS)
+		p += sprintf( p, "%u,%u,", ext->analog[0],ext->analog[1] ); 
+	else
+		p += sprintf( p, "-1,-1," );
+	if(data->flags & POSE_INPUTS)
+		p += sprintf( p, "%u,", ext->buttons );
+	else
+		p += sprintf( p, "-1," );
+	for(i=0; i < ISD_MAX_AUX_INPUTS; i++)
+	{
+		if(i < ext->aux_inputs)
+			p += sprintf( p, "%d,", ext->aux[i] );
+		else
+			p += sprintf( p, "-1," );
+	}
+	p += sprintf( p, "%.4f,", ext->still_time );
+	p += sprintf( p, "%.3f,%.3f", ext->battery, ext->temperature);
+	*p++ = '\n';
+	return p - out;
+}
+
+int main( int argc, char **argv )
+{
+	static LogRecord records[MAX_RECORDS];
+	static char lines[MAX_RECORDS][ASYNCLOG_LINE_MAX];
+	static LogPlan plans[LOGPLAN_COUNT];
+	const char *path = argc > 1 ? argv[1] : "stationdata.log";
+	long passes = argc > 2 ? atol( argv[2] ) : 200;
+	char line[ASYNCLOG_LINE_MAX], a[ASYNCLOG_LINE_MAX], b[ASYNCLOG_LINE_MAX];
+	int n = 0, data = 0, differ = 0, differPrintf = 0, i;
+	unsigned long sum = 0;
+	double t0, tPlan, tPrintf;
+	size_t len;
+	long k;
+	FILE *fp;
+
+	if( (fp = fopen( path, "r" )) == NULL )
+	{
+		printf( "Couldn't open %s\n", path );
+		return 1;
+	}
+	while( n < MAX_RECORDS && fgets( line, sizeof(line), fp ) )
+	{
+		// Data lines follow the column header
+		if( !data )
+		{
+			data = strncmp( line, "TrackerNum,StationNum,X,", 24 ) == 0;
+			continue;
+		}
+		if( logPlanParse( line, &records[n] ) )
+		{
+			line[strcspn( line, "\r\n" )] = '\0';
+			strcpy( lines[n++], line );
+		}
+	}
+	fclose( fp );
+	if( n == 0 )
+	{
+		printf( "No data lines in %s\n", path );
+		return 1;
+	}
+
+	logPlanInit( plans );
+	for( i = 0; i < n; i++ )
+	{
+		len = logPlanFormat( &plans[logPlanIndex(&records[i])], &records[i], 0.0, a );
+		a[len - 1] = '\0';
+		if( strcmp( a, lines[i] ) != 0 )
+		{
+			if( differ++ < 3 )
+				printf( "read    %s\nwritten %s\n", lines[i], a );
+		}
+		len = logRowPrintf( &records[i], 0.0, b );
+		b[len - 1] = '\0';
+		if( strcmp( a, b ) != 0 )
+			differPrintf++;
+	}
+
+	t0 = now();
+	for( k = 0; k < passes; k++ )
+		for( i = 0; i < n; i++ )
+			sum += logPlanFormat( &plans[logPlanIndex(&records[i])], &records[i], 0.0, a );
+	tPlan = now() - t0;
+
+	t0 = now();
+	for( k = 0; k < passes; k++ )
+		for( i = 0; i < n; i++ )
+			sum += logRowPrintf( &records[i], 0.0, b );
+	tPrintf = now() - t0;
+
+	printf( "%d lines from %s x %ld passes (%lu bytes)\n", n, path, passes, sum );
+	printf( "column plan  %7.1f ns/line\n", tPlan / (n * (double) passes) * 1e9 );
+	printf( "sprintf      %7.1f ns/line\n", tPrintf / (n * (double) passes) * 1e9 );
+	printf( "speedup      %7.1fx; %d lines differ from the log, %d from sprintf\n",
+		tPrintf / tPlan, differ, differPrintf );
+	return differ || differPrintf ? 1 : 0;
+}
@@ -0,0 +1,228 @@
+//==========================================================================================
+//
+//    File Name:      logplan.c
+//    Description:    Data lines of the station logs, formatted from a column plan,
+//                    see logplan.h
+//
+//==========================================================================================
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logplan.h"
+#include "../fmt.h"
+
+#define RECORD(field)	((WORD) offsetof(LogRecord, field))
+
+static LogColumn *addColumn( LogPlan *plan, BYTE kind, WORD offset, BYTE decimals )
+{
+	LogColumn *c = &plan->columns[plan->count++];
+
+	c->kind = kind;
+	c->decimals = decimals;
+	c->offset = offset;
+	c->offset2 = 0;
+	return c;
+}
+
+// Three floats in a row, as the logs have for every vector
+static void addVector( LogPlan *plan, WORD offset, BYTE decimals )
+{
+	int i;
+
+	for( i = 0; i < 3; i++ )
+		addColumn( plan, LOGCOL_FLOAT, offset + i * sizeof(float), decimals );
+}
+
+//==========================================================================================
+//
+//  The columns of logHeader's data header, in order
+//
+//==========================================================================================
+void logPlanBuild( LogPlan *plan, Bool inputs, int auxInputs )
+{
+	int i;
+
+	plan->count = 0;
+
+	// TrackerNum, StationNum
+	addColumn( plan, LOGCOL_BYTE, RECORD(pose.tracker), 0 );
+	addColumn( plan, LOGCOL_BYTE, RECORD(pose.station), 0 );
+
+	// X, Y, Z (m), then Yaw, Pitch, Roll (degrees)
+	addVector( plan, RECORD(pose.position), 5 );
+	addVector( plan, RECORD(pose.euler), 3 );
+
+	// Time, DoubleTime, DoubleOSTime (seconds)
+	addColumn( plan, LOGCOL_FLOAT, RECORD(pose.time), 4 );
+	addColumn( plan, LOGCOL_TIME, RECORD(pose.time_s), 4 )->offset2 = RECORD(pose.time_us);
+	addColumn( plan, LOGCOL_OSTIME, RECORD(ext.os_time_s), 4 )->offset2 = RECORD(ext.os_time_us);
+
+	// TQ, CI, MQ
+	addColumn( plan, LOGCOL_QUALITY, RECORD(pose.status), 0 );
+	addColumn( plan, LOGCOL_BYTE, RECORD(pose.comm), 0 );
+	addColumn( plan, LOGCOL_BYTE, RECORD(pose.meas), 0 );
+
+	// Angular velocities, body, navigation frame and raw (rad/sec), accelerations, body
+	// and navigation frame (m/s^2), magnetometer (Gauss), compass yaw (degrees)
+	addVector( plan, RECORD(ext.angvel_body), 5 );
+	addVector( plan, RECORD(ext.angvel), 5 );
+	addVector( plan, RECORD(ext.angvel_raw), 5 );
+	addVector( plan, RECORD(ext.accel_body), 5 );
+	addVector( plan, RECORD(ext.accel), 5 );
+	addVector( plan, RECORD(ext.mag), 5 );
+	addColumn( plan, LOGCOL_FLOAT, RECORD(ext.compass_yaw), 3 );
+
+	// Joystick axes 1, 2 and buttons, if they were asked for
+	addColumn( plan, inputs ? LOGCOL_ANALOG : LOGCOL_NONE, RECORD(ext.analog[0]), 0 );
+	addColumn( plan, inputs ? LOGCOL_ANALOG : LOGCOL_NONE, RECORD(ext.analog[1]), 0 );
+	addColumn( plan, inputs ? LOGCOL_BYTE : LOGCOL_NONE, RECORD(ext.buttons), 0 );
+
+	// AUX input bytes, as many as the station has if they were asked for
+	for( i = 0; i < ISD_MAX_AUX_INPUTS; i++ )
+		addColumn( plan, i < auxInputs ? LOGCOL_BYTE : LOGCOL_NONE, RECORD(ext.aux) + i, 0 );
+
+	// Still time, battery and temperature (3DOF sensors)
+	addColumn( plan, LOGCOL_FLOAT, RECORD(ext.still_time), 4 );
+	addColumn( plan, LOGCOL_FLOAT, RECORD(ext.battery), 3 );
+	addColumn( plan, LOGCOL_FLOAT, RECORD(ext.temperature), 3 );
+}
+
+void logPlanInit( LogPlan *plans )
+{
+	int aux;
+
+	for( aux = 0; aux <= ISD_MAX_AUX_INPUTS; aux++ )
+	{
+		logPlanBuild( &plans[aux], FALSE, aux );
+		logPlanBuild( &plans[ISD_MAX_AUX_INPUTS + 1 + aux], TRUE, aux );
+	}
+}
+
+void logPlanMark( LogRecord *r, const ISD_STATION_INFO_TYPE *staInfo,
+				  const ISD_STATION_HARDWARE_INFO_TYPE *stationHwInfo )
+{
+	DWORD aux = staInfo->GetAuxInputs ? stationHwInfo->Capability.AuxInputs : 0;
+
+	if( staInfo->GetInputs )
+		r->pose.flags |= POSE_INPUTS;
+	else
+		r->pose.flags &= ~POSE_INPUTS;
+	r->ext.aux_inputs = aux < ISD_MAX_AUX_INPUTS ? aux : ISD_MAX_AUX_INPUTS;
+}
+
+size_t logPlanFormat( const LogPlan *plan, const LogRecord *r, double osTimeOffset, char *out )
+{
+	const char *base = (const char *) r;
+	const LogColumn *c, *end = plan->columns + plan->count;
+	char *p = out;
+	double t;
+
+	for( c = plan->columns; c < end; c++ )
+	{
+		switch( c->kind )
+		{
+		case LOGCOL_BYTE:
+			p = fmt_uint( p, *(const unsigned char *)(base + c->offset) );
+			break;
+
+		case LOGCOL_ANALOG:
+			p = fmt_uint( p, (unsigned int) *(const short *)(base + c->offset) );
+			break;
+
+		case LOGCOL_FLOAT:
+			p = fmt_fixed( p, *(const float *)(base + c->offset), c->decimals );
+			break;
+
+		case LOGCOL_QUALITY:
+			p = fmt_uint( p, (unsigned int)(*(const unsigned char *)(base + c->offset) / 2.55) );
+			break;
+
+		case LOGCOL_TIME:
+		case LOGCOL_OSTIME:
+			t = (double) *(const unsigned int *)(base + c->offset) +
+				(double) *(const unsigned int *)(base + c->offset2) * 1.0e-6;
+			if( c->kind == LOGCOL_OSTIME )
+				t -= osTimeOffset;
+			p = fmt_fixed_d( p, t, c->decimals );
+			break;
+
+		default:
+			*p++ = '-';
+			*p++ = '1';
+			break;
+		}
+		*p++ = ',';
+	}
+
+	// The last column ends the line instead
+	p[-1] = '\n';
+	return p - out;
+}
+
+// A timestamp written as seconds to 4 decimals, back as seconds and microseconds
+static void splitTime( double t, unsigned int *s, unsigned int *us )
+{
+	*s = (unsigned int) t;
+	*us = (unsigned int) ((t - *s) * 1e6 + 0.5);
+}
+
+static void parseVector( char **p, float *v )
+{
+	int i;
+
+	for( i = 0; i < 3; i++ )
+		v[i] = strtof( *p, p ), (*p)++;
+}
+
+size_t logPlanParse( char *p, LogRecord *r )
+{
+	char *line = p, *q;
+	double quality;
+	long v[7];
+	int i;
+
+	memset( r, 0, sizeof(*r) );
+	r->pose.tracker = strtol( p, &p, 10 ), p++;
+	r->pose.station = strtol( p, &p, 10 ), p++;
+	parseVector( &p, r->pose.position );
+	parseVector( &p, r->pose.euler );
+	r->pose.time = strtof( p, &p ), p++;
+	splitTime( strtod( p, &p ), &r->pose.time_s, &r->pose.time_us ), p++;
+	splitTime( strtod( p, &p ), &r->ext.os_time_s, &r->ext.os_time_us ), p++;
+
+	// TQ is TrackingStatus as a percent, rounded down; the smallest status that gives it
+	quality = strtol( p, &p, 10 ) * 2.55, p++;
+	r->pose.status = (BYTE) quality;
+	if( r->pose.status < quality )
+		r->pose.status++;
+	r->pose.comm = strtol( p, &p, 10 ), p++;
+	r->pose.meas = strtol( p, &p, 10 ), p++;
+	parseVector( &p, r->ext.angvel_body );
+	parseVector( &p, r->ext.angvel );
+	parseVector( &p, r->ext.angvel_raw );
+	parseVector( &p, r->ext.accel_body );
+	parseVector( &p, r->ext.accel );
+	parseVector( &p, r->ext.mag );
+	r->ext.compass_yaw = strtof( p, &p ), p++;
+
+	// Joystick axes, buttons and aux inputs, -1 where the station didn't have them
+	for( i = 0; i < 7; i++ )
+		v[i] = strtol( p, &p, 10 ), p++;
+	if( v[0] != -1 )
+		r->pose.flags |= POSE_INPUTS;
+	r->ext.analog[0] = (short) v[0];
+	r->ext.analog[1] = (short) v[1];
+	r->ext.buttons = (BYTE) v[2];
+	for( i = 0; i < ISD_MAX_AUX_INPUTS && v[3 + i] != -1; i++ )
+		r->ext.aux[i] = (BYTE) v[3 + i];
+	r->ext.aux_inputs = i;
+
+	r->ext.still_time = strtof( p, &p ), p++;
+	r->ext.battery = strtof( p, &p ), p++;
+	r->ext.temperature = strtof( p, &q );
+	if( q == p || (*q != '\n' && *q != '\r' && *q != '\0') )
+		return 0;
+	return q - line;
+}
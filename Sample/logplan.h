@@ -0,0 +1,92 @@
+//==========================================================================================
+//
+//    File Name:      logplan.h
+//    Description:    Data lines of the station logs, formatted from a column plan
+//
+//    Comments:       The data lines keep the schema of the column header logHeader
+//                    writes (see main.c), one line per sample. Rather than a chain
+//                    of sprintf calls parsing their format strings for every field
+//                    of every line, the columns are worked out once as a plan: what
+//                    each column is, where its value sits in a LogRecord, and how
+//                    many decimals it gets. Which of the input columns hold values
+//                    and which say -1 depends on the station's GetInputs and
+//                    GetAuxInputs flags and on how many aux inputs its hardware
+//                    has, so there is a plan for each combination of those, and a
+//                    station's records name theirs (see logPlanMark). Values are
+//                    written with fmt.c's integer fixed-point formatter.
+//
+//                        LogPlan plans[LOGPLAN_COUNT];
+//                        logPlanInit( plans );
+//                        ...
+//                        logPlanMark( r, &staInfo, &hwInfo );     // as the record is queued
+//                        ...
+//                        n = logPlanFormat( &plans[logPlanIndex( r )], r, osTimeOffset, line );
+//
+//                    Output matches the old "%.5f"-style fprintf path, -0.00000
+//                    included, except where a value lies exactly halfway between two
+//                    last digits (fmt.c rounds those away from zero, printf to even).
+//
+//==========================================================================================
+
+#ifndef LOGPLAN_H
+#define LOGPLAN_H
+
+#include "asynclog.h"
+
+#define LOGPLAN_COLUMNS		43		// in the header's TrackerNum,...,Temperature line
+
+// The column header, the last line logHeader writes before the data (see main.c)
+#define LOGPLAN_HEADER		"TrackerNum,StationNum,X,Y,Z,Yaw,Pitch,Roll,Time,DoubleTime,DoubleOSTime,TQ,CI,MQ,GXBF," \
+							"GYBF,GZBF,GXNF,GYNF,GZNF,GXRAW,GYRAW,GZRAW,AXBF,AYBF,AZBF,AXNF,AYNF,AZNF," \
+							"MagX,MagY,MagZ,CompassYaw,JoystickAxis1," \
+							"JoystickAxis2,Buttons,AuxIn0,AuxIn1,AuxIn2,AuxIn3,StillTime,Vbatt,Temperature\n"
+#define LOGPLAN_COUNT		(2 * (ISD_MAX_AUX_INPUTS + 1))	// input configurations
+
+typedef enum
+{
+	LOGCOL_BYTE,			// unsigned char, as an integer
+	LOGCOL_ANALOG,			// short, as an unsigned integer
+	LOGCOL_FLOAT,			// float, fixed point
+	LOGCOL_QUALITY,			// TrackingStatus scaled to percent
+	LOGCOL_TIME,			// seconds and microseconds, fixed point
+	LOGCOL_OSTIME,			// the same less the log's OS time offset
+	LOGCOL_NONE				// an input the station wasn't asked for, as -1
+} LogColumnKind;
+
+typedef struct
+{
+	BYTE					kind;		// LogColumnKind
+	BYTE					decimals;
+	WORD					offset;		// of the value in a LogRecord
+	WORD					offset2;	// of the microseconds, for LOGCOL_TIME and LOGCOL_OSTIME
+} LogColumn;
+
+typedef struct
+{
+	int						count;
+	LogColumn				columns[LOGPLAN_COLUMNS];
+} LogPlan;
+
+// Builds the plan for a station with inputs (GetInputs) and auxInputs aux inputs logged
+void logPlanBuild( LogPlan *plan, Bool inputs, int auxInputs );
+
+// Builds plans[LOGPLAN_COUNT], one per input configuration
+void logPlanInit( LogPlan *plans );
+
+// Marks a record with its station's input configuration
+void logPlanMark( LogRecord *r, const ISD_STATION_INFO_TYPE *staInfo,
+				  const ISD_STATION_HARDWARE_INFO_TYPE *stationHwInfo );
+
+// Which of logPlanInit's plans a marked record goes with
+#define logPlanIndex(r)		(((r)->pose.flags & POSE_INPUTS ? ISD_MAX_AUX_INPUTS + 1 : 0) + \
+							 (r)->ext.aux_inputs)
+
+// Writes r as a line, '\n' included, at out (ASYNCLOG_LINE_MAX bytes), returns its length
+size_t logPlanFormat( const LogPlan *plan, const LogRecord *r, double osTimeOffset, char *out );
+
+// A data line back into a record, marked with its input configuration, and the OS time
+// as written (less the offset); returns the line's length without its end, or 0 if it
+// doesn't have every column. The fields no column holds are zero.
+size_t logPlanParse( char *line, LogRecord *r );
+
+#endif
@@ -0,0 +1,509 @@
+//==========================================================================================
+//
+//    File Name:      logread.c
+//    Description:    Reads a station log into columns, see logread.h
+//
+//==========================================================================================
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "logread.h"
+
+#define FIELD_MAX		64				// longest field strtod is handed
+#define PIECE_MIN		(1 << 20)		// bytes of data lines worth a thread of their own
+
+typedef struct
+{
+	LogFile					*lf;
+	const char				*begin, *end;	// whole lines
+	size_t					lines;			// line ends, counting a last one cut short
+	size_t					first;			// row its lines start at
+	size_t					rows;			// read
+	size_t					bad, slow;
+} Piece;
+
+static const float pow10f[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+static const double pow10d[] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static size_t typeSize( int type )
+{
+	return type == LOGREAD_DOUBLE ? sizeof(double) : type == LOGREAD_FLOAT ? sizeof(float) : sizeof(int);
+}
+
+//==========================================================================================
+//
+//  Fields
+//
+//==========================================================================================
+
+// Digits with an optional sign and point, as an integer and the power of ten to divide
+// it by; FALSE if there's anything else or too many digits to be exact
+static Bool parseFixed( const char *s, const char *e, Bool *neg, uint64_t *mant, int *scale )
+{
+	int digits = 0;
+
+	*neg = s < e && *s == '-';
+	s += *neg;
+	*mant = 0;
+	*scale = 0;
+	for( ; s < e && (unsigned)(*s - '0') < 10; s++, digits++ )
+		*mant = *mant * 10 + (*s - '0');
+	if( s < e && *s == '.' )
+	{
+		for( s++; s < e && (unsigned)(*s - '0') < 10; s++, digits++ )
+		{
+			*mant = *mant * 10 + (*s - '0');
+			(*scale)++;
+		}
+	}
+	return s == e && digits > 0 && digits <= 19;
+}
+
+// The field as a C string for strtod and friends; FALSE if it's too long to be a number
+static Bool copyField( const char *s, const char *e, char *buf )
+{
+	if( e - s >= FIELD_MAX || e == s )
+		return FALSE;
+	memcpy( buf, s, e - s );
+	buf[e - s] = '\0';
+	return TRUE;
+}
+
+static Bool parseField( Piece *pc, LogFileColumn *c, size_t row, const char *s, const char *e )
+{
+	char buf[FIELD_MAX], *q;
+	uint64_t mant;
+	Bool neg;
+	int scale;
+
+	if( e > s && e[-1] == '\r' )
+		e--;
+
+	if( parseFixed( s, e, &neg, &mant, &scale ) )
+	{
+		switch( c->type )
+		{
+		case LOGREAD_INT:
+			if( scale == 0 && mant <= INT32_MAX )
+			{
+				((int *) c->values)[row] = neg ? -(int) mant : (int) mant;
+				return TRUE;
+			}
+			break;
+
+		case LOGREAD_FLOAT:
+			// Both exact as floats, so the one rounding is the division's, as strtof's
+			if( mant < (1u << 24) && scale <= 10 )
+			{
+				float v = (float) mant / pow10f[scale];
+
+				((float *) c->values)[row] = neg ? -v : v;
+				return TRUE;
+			}
+			break;
+
+		default:
+			if( mant < (1ULL << 53) && scale <= 22 )
+			{
+				double v = (double) mant / pow10d[scale];
+
+				((double *) c->values)[row] = neg ? -v : v;
+				return TRUE;
+			}
+			break;
+		}
+	}
+
+	// Long, or an exponent, inf, nan... as the C library reads it
+	pc->slow++;
+	if( !copyField( s, e, buf ) )
+		return FALSE;
+	switch( c->type )
+	{
+	case LOGREAD_INT:
+		((int *) c->values)[row] = (int) strtol( buf, &q, 10 );
+		break;
+	case LOGREAD_FLOAT:
+		((float *) c->values)[row] = strtof( buf, &q );
+		break;
+	default:
+		((double *) c->values)[row] = strtod( buf, &q );
+		break;
+	}
+	return *q == '\0';
+}
+
+//==========================================================================================
+//
+//  Pieces: counting their lines, then reading them
+//
+//==========================================================================================
+static size_t countByte( const char *p, const char *end, char c )
+{
+	size_t n = 0;
+
+#if defined(__SSE2__)
+	const __m128i want = _mm_set1_epi8( c );
+
+	for( ; end - p >= 16; p += 16 )
+		n += __builtin_popcount( _mm_movemask_epi8( _mm_cmpeq_epi8(
+				_mm_loadu_si128( (const __m128i *) p ), want ) ) );
+#endif
+	for( ; p < end; p++ )
+		n += *p == c;
+	return n;
+}
+
+static void *countPiece( void *arg )
+{
+	Piece *pc = (Piece *) arg;
+
+	pc->lines = countByte( pc->begin, pc->end, '\n' );
+	if( pc->end > pc->begin && pc->end[-1] != '\n' )
+		pc->lines++;
+	return NULL;
+}
+
+typedef struct
+{
+	Piece					*pc;
+	size_t					row;
+	int						field;
+	Bool					ok;
+	const char				*fieldStart;
+} Reading;
+
+// The field ending at d, a comma or line end
+static void delimiter( Reading *rd, const char *d )
+{
+	LogFile *lf = rd->pc->lf;
+
+	if( rd->field < LOGPLAN_COLUMNS )
+	{
+		LogFileColumn *c = &lf->columns[rd->field];
+
+		if( c->wanted && rd->ok )
+			rd->ok = parseField( rd->pc, c, rd->row, rd->fieldStart, d );
+	}
+	rd->field++;
+
+	if( d == rd->pc->end || *d == '\n' )
+	{
+		const char *s = rd->fieldStart;
+		Bool blank = rd->field == 1 && (d == s || (d == s + 1 && *s == '\r'));
+
+		if( rd->field == LOGPLAN_COLUMNS && rd->ok )
+			rd->row++;
+		else if( !blank )
+			rd->pc->bad++;
+		rd->field = 0;
+		rd->ok = TRUE;
+	}
+	rd->fieldStart = d + 1;
+}
+
+static void *readPiece( void *arg )
+{
+	Piece *pc = (Piece *) arg;
+	const char *p = pc->begin, *end = pc->end;
+	Reading rd;
+
+	rd.pc = pc;
+	rd.row = pc->first;
+	rd.field = 0;
+	rd.ok = TRUE;
+	rd.fieldStart = p;
+
+#if defined(__SSE2__)
+	{
+		const __m128i comma = _mm_set1_epi8( ',' ), newline = _mm_set1_epi8( '\n' );
+
+		for( ; end - p >= 16; p += 16 )
+		{
+			__m128i v = _mm_loadu_si128( (const __m128i *) p );
+			unsigned int mask = _mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( v, comma ),
+																 _mm_cmpeq_epi8( v, newline ) ) );
+
+			while( mask )
+			{
+				delimiter( &rd, p + __builtin_ctz( mask ) );
+				mask &= mask - 1;
+			}
+		}
+	}
+#endif
+	for( ; p < end; p++ )
+	{
+		if( *p == ',' || *p == '\n' )
+			delimiter( &rd, p );
+	}
+
+	// A last line with no line end
+	if( rd.fieldStart < end || rd.field > 0 )
+		delimiter( &rd, end );
+
+	pc->rows = rd.row - pc->first;
+	return NULL;
+}
+
+// Runs fn on every piece, each on a thread of its own but the first
+static void runPieces( Piece *pieces, int n, void *(*fn)( void * ) )
+{
+	pthread_t threads[LOGREAD_THREADS];
+	Bool started[LOGREAD_THREADS];
+	int i;
+
+	for( i = 1; i < n; i++ )
+		started[i] = pthread_create( &threads[i], NULL, fn, &pieces[i] ) == 0;
+	fn( &pieces[0] );
+	for( i = 1; i < n; i++ )
+	{
+		if( started[i] )
+			pthread_join( threads[i], NULL );
+		else
+			fn( &pieces[i] );
+	}
+}
+
+//==========================================================================================
+//
+//  The file
+//
+//==========================================================================================
+static void initColumns( LogFile *lf )
+{
+	const char *name = LOGPLAN_HEADER, *end;
+	LogPlan plan;
+	int i;
+
+	logPlanBuild( &plan, TRUE, ISD_MAX_AUX_INPUTS );
+	for( i = 0; i < LOGPLAN_COLUMNS; i++ )
+	{
+		LogFileColumn *c = &lf->columns[i];
+
+		end = name + strcspn( name, ",\n" );
+		memcpy( c->name, name, end - name < LOGREAD_NAME ? end - name : LOGREAD_NAME - 1 );
+		name = end + 1;
+
+		switch( plan.columns[i].kind )
+		{
+		case LOGCOL_FLOAT:
+			c->type = LOGREAD_FLOAT;
+			break;
+		case LOGCOL_TIME:
+		case LOGCOL_OSTIME:
+			c->type = LOGREAD_DOUBLE;
+			break;
+		default:
+			c->type = LOGREAD_INT;
+			break;
+		}
+	}
+}
+
+static Bool wantColumns( LogFile *lf, const char *wanted )
+{
+	char *list, *name;
+	int col;
+
+	if( !wanted )
+	{
+		for( col = 0; col < LOGPLAN_COLUMNS; col++ )
+			lf->columns[col].wanted = TRUE;
+		return TRUE;
+	}
+
+	if( (list = strdup( wanted )) == NULL )
+		return FALSE;
+	for( name = strtok( list, "," ); name; name = strtok( NULL, "," ) )
+	{
+		if( (col = logFileColumn( lf, name )) < 0 )
+		{
+			free( list );
+			errno = EINVAL;
+			return FALSE;
+		}
+		lf->columns[col].wanted = TRUE;
+	}
+	free( list );
+	return TRUE;
+}
+
+// The header sections up to the column header; where the data lines start, or NULL
+static const char *readSections( LogFile *lf )
+{
+	const char *p = lf->map, *end = lf->map + lf->size, *eol;
+	size_t headerLength = strlen( LOGPLAN_HEADER ) - 1;
+	LogFileSection *section = NULL;
+
+	for( ; p < end; p = eol + 1 )
+	{
+		size_t length;
+
+		if( (eol = (const char *) memchr( p, '\n', end - p )) == NULL )
+			return NULL;
+		length = eol - p - (eol > p && eol[-1] == '\r');
+
+		if( length == headerLength && memcmp( p, LOGPLAN_HEADER, headerLength ) == 0 )
+			return eol + 1;
+
+		if( strncmp( p, "[BEGIN ", 7 ) == 0 )
+		{
+			section = strncmp( p + 7, "LOG INFO]", 9 ) == 0 ? &lf->logInfo :
+					  strncmp( p + 7, "TRACKER INFO]", 13 ) == 0 ? &lf->trackerInfo :
+					  strncmp( p + 7, "STATION INFO]", 13 ) == 0 ? &lf->stationInfo : NULL;
+			if( section )
+				section->text = eol + 1;
+		}
+		else if( strncmp( p, "[END ", 5 ) == 0 && section )
+		{
+			section->length = p - section->text;
+			section = NULL;
+		}
+	}
+	return NULL;
+}
+
+Bool logFileOpen( LogFile *lf, const char *path, const char *wanted, int threads )
+{
+	Piece pieces[LOGREAD_THREADS];
+	const char *data, *end;
+	struct stat st;
+	size_t lines = 0, row = 0;
+	void *map;
+	int i, col;
+
+	memset( lf, 0, sizeof(*lf) );
+	initColumns( lf );
+	if( (lf->fd = open( path, O_RDONLY )) < 0 )
+		return FALSE;
+	if( !wantColumns( lf, wanted ) || fstat( lf->fd, &st ) != 0 )
+		goto fail;
+
+	lf->size = (size_t) st.st_size;
+	if( lf->size == 0 || (map = mmap( NULL, lf->size, PROT_READ, MAP_PRIVATE, lf->fd, 0 )) == MAP_FAILED )
+	{
+		errno = lf->size == 0 ? EINVAL : errno;
+		goto fail;
+	}
+	lf->map = (const char *) map;
+	madvise( map, lf->size, MADV_SEQUENTIAL );
+	madvise( map, lf->size, MADV_WILLNEED );
+
+	if( (data = readSections( lf )) == NULL )
+	{
+		errno = EINVAL;
+		goto fail;
+	}
+	end = lf->map + lf->size;
+
+	// A piece per thread, ending at line ends
+	if( threads <= 0 )
+		threads = (int) sysconf( _SC_NPROCESSORS_ONLN );
+	if( threads > LOGREAD_THREADS )
+		threads = LOGREAD_THREADS;
+	if( threads > (end - data) / PIECE_MIN )
+		threads = (int) ((end - data) / PIECE_MIN);
+	if( threads < 1 )
+		threads = 1;
+	for( i = 0; i < threads; i++ )
+	{
+		const char *cut = data + (end - data) / threads * (i + 1);
+
+		if( i == threads - 1 || (cut = (const char *) memchr( cut, '\n', end - cut )) == NULL )
+			cut = end;
+		else
+			cut++;
+
+		memset( &pieces[i], 0, sizeof(pieces[i]) );
+		pieces[i].lf = lf;
+		pieces[i].begin = i ? pieces[i-1].end : data;
+		pieces[i].end = cut > pieces[i].begin ? cut : pieces[i].begin;
+	}
+	lf->threads = threads;
+
+	// Room for every line, then each piece reads into its own stretch
+	runPieces( pieces, threads, countPiece );
+	for( i = 0; i < threads; i++ )
+	{
+		pieces[i].first = lines;
+		lines += pieces[i].lines;
+	}
+	for( col = 0; col < LOGPLAN_COLUMNS; col++ )
+	{
+		LogFileColumn *c = &lf->columns[col];
+
+		if( c->wanted && (c->values = malloc( (lines ? lines : 1) * typeSize( c->type ) )) == NULL )
+			goto fail;
+	}
+	runPieces( pieces, threads, readPiece );
+
+	// Closing up the rows the bad lines left
+	for( i = 0; i < threads; i++ )
+	{
+		for( col = 0; col < LOGPLAN_COLUMNS; col++ )
+		{
+			LogFileColumn *c = &lf->columns[col];
+			size_t size = typeSize( c->type );
+
+			if( c->wanted && row != pieces[i].first )
+				memmove( (char *) c->values + row * size, (char *) c->values + pieces[i].first * size,
+						 pieces[i].rows * size );
+		}
+		row += pieces[i].rows;
+		lf->badLines += pieces[i].bad;
+		lf->slowFields += pieces[i].slow;
+	}
+	lf->rows = row;
+	return TRUE;
+
+fail:
+	logFileClose( lf );
+	return FALSE;
+}
+
+int logFileColumn( const LogFile *lf, const char *name )
+{
+	int col;
+
+	for( col = 0; col < LOGPLAN_COLUMNS; col++ )
+	{
+		if( strncmp( lf->columns[col].name, name, LOGREAD_NAME ) == 0 )
+			return col;
+	}
+	return -1;
+}
+
+void logFileClose( LogFile *lf )
+{
+	int err = errno, col;
+
+	for( col = 0; col < LOGPLAN_COLUMNS; col++ )
+	{
+		free( lf->columns[col].values );
+		lf->columns[col].values = NULL;
+	}
+	if( lf->map )
+		munmap( (void *) lf->map, lf->size );
+	if( lf->fd >= 0 )
+		close( lf->fd );
+	lf->map = NULL;
+	lf->fd = -1;
+	errno = err;
+}
@@ -0,0 +1,94 @@
+//==========================================================================================
+//
+//    File Name:      logread.h
+//    Description:    Reads a station log (stationdata.log, alldata.log...) into columns
+//
+//    Comments:       Loading a multi-GB log a line at a time through a CSV reader and
+//                    strtod takes minutes. A LogFile maps the file, keeps the sections
+//                    logHeader wrote (see main.c) as text, and reads the data lines
+//                    into an array per column, of the columns asked for:
+//
+//                      - commas and line ends are found 16 bytes at a time with SSE2
+//                        compares (a byte at a time elsewhere), and the fields
+//                        between them taken in order;
+//                      - a field is read as the fixed-point number the log wrote:
+//                        digits into an integer, divided by a power of ten. Where
+//                        both are exact in the result's type that gives what strtof
+//                        or strtod would, and anything longer or unexpected is
+//                        handed to them;
+//                      - the data lines are cut into a piece per thread, counted,
+//                        then read, each piece into its own stretch of the arrays.
+//
+//                        LogFile lf;
+//                        logFileOpen( &lf, "alldata.log", "Yaw,Pitch,Roll", 0 );
+//                        col = logFileColumn( &lf, "Yaw" );
+//                        yaw = (const float *) lf.columns[col].values;    // lf.rows of them
+//                        ...
+//                        logFileClose( &lf );
+//
+//                    Columns hold what the log shows: TQ in percent, -1 for inputs a
+//                    station wasn't asked for, DoubleTime and DoubleOSTime as double
+//                    seconds, the other decimal columns as float, like the records
+//                    they came from (see pose.h). Lines without every column, like a
+//                    last line cut short, are counted and left out.
+//
+//==========================================================================================
+
+#ifndef LOGREAD_H
+#define LOGREAD_H
+
+#include <stddef.h>
+
+#include "logplan.h"
+
+#define LOGREAD_NAME		16		// bytes of a column's name
+#define LOGREAD_THREADS		8		// most threads logFileOpen starts by default
+
+typedef enum
+{
+	LOGREAD_INT,			// int
+	LOGREAD_FLOAT,			// float
+	LOGREAD_DOUBLE			// double
+} LogReadType;
+
+typedef struct
+{
+	char					name[LOGREAD_NAME];	// as in the column header
+	BYTE					type;				// LogReadType
+	BYTE					wanted;				// values is filled in
+	void					*values;			// rows of them, or NULL
+} LogFileColumn;
+
+// A [BEGIN ...] / [END ...] section, the lines between its markers
+typedef struct
+{
+	const char				*text;
+	size_t					length;
+} LogFileSection;
+
+typedef struct
+{
+	int						fd;
+	const char				*map;
+	size_t					size;
+	LogFileSection			logInfo, trackerInfo, stationInfo;
+	size_t					rows;
+	size_t					badLines;			// with some column missing or unreadable
+	size_t					slowFields;			// handed to strtod or strtof
+	int						threads;			// used
+	LogFileColumn			columns[LOGPLAN_COLUMNS];
+} LogFile;
+
+// Maps path and reads the columns named in the comma separated list wanted, or all of
+// them if it's NULL, with up to threads threads (0 for one per CPU, at most
+// LOGREAD_THREADS); FALSE with errno set if it couldn't, EINVAL if it isn't a station
+// log or a column isn't one of its
+Bool logFileOpen( LogFile *lf, const char *path, const char *wanted, int threads );
+
+// The column called name, or -1
+int logFileColumn( const LogFile *lf, const char *name );
+
+// Frees the columns and unmaps the file; the sections go with it
+void logFileClose( LogFile *lf );
+
+#endif
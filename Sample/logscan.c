@@ -0,0 +1,216 @@
+//==========================================================================================
+//
+//    File Name:      logscan.c
+//    Description:    Loads a station log into columns (see logread.h) and summarises them
+//
+//    Comments:       Prints the log's sections, how long loading took and each column's
+//                    minimum, maximum and mean. -o writes the columns as raw arrays,
+//                    dir/Yaw.f32, dir/DoubleTime.f64, dir/TQ.i32 and so on, for
+//                    numpy.fromfile and the like. -v reads the log again a line at a
+//                    time with strtod and checks every value against it, timing that
+//                    too.
+//
+//                        make logscan
+//                        ./logscan [-j threads] [-c Yaw,Pitch,Roll] [-o dir] [-v] alldata.log
+//
+//==========================================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "logread.h"
+
+static double now( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double value( const LogFileColumn *c, size_t row )
+{
+	switch( c->type )
+	{
+	case LOGREAD_INT:
+		return ((const int *) c->values)[row];
+	case LOGREAD_FLOAT:
+		return ((const float *) c->values)[row];
+	default:
+		return ((const double *) c->values)[row];
+	}
+}
+
+static void printSection( const char *title, const LogFileSection *s )
+{
+	printf( "[%s]\n%.*s", title, (int) s->length, s->text ? s->text : "" );
+}
+
+//==========================================================================================
+//
+//  Each column to dir/name.f32, .f64 or .i32
+//
+//==========================================================================================
+static int writeColumns( const LogFile *lf, const char *dir )
+{
+	static const char *suffix[] = { "i32", "f32", "f64" };
+	static const size_t size[] = { sizeof(int), sizeof(float), sizeof(double) };
+	char path[1024];
+	int col;
+	FILE *fp;
+
+	for( col = 0; col < LOGPLAN_COLUMNS; col++ )
+	{
+		const LogFileColumn *c = &lf->columns[col];
+
+		if( !c->wanted )
+			continue;
+		snprintf( path, sizeof(path), "%s/%s.%s", dir, c->name, suffix[c->type] );
+		if( (fp = fopen( path, "wb" )) == NULL ||
+			fwrite( c->values, size[c->type], lf->rows, fp ) != lf->rows || fclose( fp ) != 0 )
+		{
+			fprintf( stderr, "Couldn't write %s (%s)\n", path, strerror(errno) );
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//==========================================================================================
+//
+//  The log again, a line and a strtod at a time, against what was loaded
+//
+//==========================================================================================
+static int verify( const LogFile *lf, const char *path )
+{
+	static char line[1 << 16];
+	size_t row = 0, differ = 0;
+	Bool data = FALSE;
+	double t0 = now();
+	char *p, *q;
+	int col;
+	FILE *fp;
+
+	if( (fp = fopen( path, "r" )) == NULL )
+		return 1;
+	while( fgets( line, sizeof(line), fp ) )
+	{
+		if( !data )
+		{
+			data = strcmp( line, LOGPLAN_HEADER ) == 0;
+			continue;
+		}
+		if( strcspn( line, "\r\n" ) == 0 )
+			continue;
+
+		for( p = line, col = 0; col < LOGPLAN_COLUMNS; col++, p = q + 1 )
+		{
+			const LogFileColumn *c = &lf->columns[col];
+			Bool same = TRUE;
+
+			if( c->type == LOGREAD_INT )
+			{
+				long v = strtol( p, &q, 10 );
+
+				same = !c->wanted || row >= lf->rows || ((const int *) c->values)[row] == v;
+			}
+			else if( c->type == LOGREAD_FLOAT )
+			{
+				float v = strtof( p, &q );
+
+				same = !c->wanted || row >= lf->rows || memcmp( (const float *) c->values + row, &v, sizeof(v) ) == 0;
+			}
+			else
+			{
+				double v = strtod( p, &q );
+
+				same = !c->wanted || row >= lf->rows || memcmp( (const double *) c->values + row, &v, sizeof(v) ) == 0;
+			}
+			if( !same && differ++ < 5 )
+				printf( "row %zu %s differs: loaded %.9g, strtod %.*s\n", row, c->name, value( c, row ),
+						(int) (q - p), p );
+			if( *q != ',' )
+				break;
+		}
+		row++;
+	}
+	fclose( fp );
+
+	printf( "strtod, a line at a time: %.3f s; %zu rows, %zu values differ\n", now() - t0, row, differ );
+	return differ || row != lf->rows;
+}
+
+int main( int argc, char **argv )
+{
+	const char *wanted = NULL, *dir = NULL, *path = NULL;
+	int threads = 0, check = 0, i, col;
+	double t0, seconds;
+	LogFile lf;
+
+	for( i = 1; i < argc; i++ )
+	{
+		if( strcmp( argv[i], "-j" ) == 0 && i+1 < argc )
+			threads = atoi( argv[++i] );
+		else if( strcmp( argv[i], "-c" ) == 0 && i+1 < argc )
+			wanted = argv[++i];
+		else if( strcmp( argv[i], "-o" ) == 0 && i+1 < argc )
+			dir = argv[++i];
+		else if( strcmp( argv[i], "-v" ) == 0 )
+			check = 1;
+		else if( argv[i][0] != '-' && !path )
+			path = argv[i];
+		else
+			path = NULL, i = argc;
+	}
+	if( !path )
+	{
+		fprintf( stderr, "usage: %s [-j threads] [-c col,col...] [-o dir] [-v] log\n", argv[0] );
+		return 1;
+	}
+
+	t0 = now();
+	if( !logFileOpen( &lf, path, wanted, threads ) )
+	{
+		fprintf( stderr, "Couldn't load %s (%s)\n", path, errno == EINVAL ?
+				 "not a station log, or no such column" : strerror(errno) );
+		return 1;
+	}
+	seconds = now() - t0;
+
+	printSection( "LOG INFO", &lf.logInfo );
+	printSection( "TRACKER INFO", &lf.trackerInfo );
+	printSection( "STATION INFO", &lf.stationInfo );
+	printf( "\n%zu rows from %zu bytes in %.3f s, %.0f MB/s on %d threads; %zu bad lines, "
+			"%zu fields left to strtod\n\n", lf.rows, lf.size, seconds, lf.size / seconds / 1e6,
+			lf.threads, lf.badLines, lf.slowFields );
+
+	printf( "%-14s %14s %14s %14s\n", "column", "min", "max", "mean" );
+	for( col = 0; col < LOGPLAN_COLUMNS; col++ )
+	{
+		const LogFileColumn *c = &lf.columns[col];
+		double lo = 0, hi = 0, sum = 0, v;
+		size_t row;
+
+		if( !c->wanted )
+			continue;
+		for( row = 0; row < lf.rows; row++ )
+		{
+			v = value( c, row );
+			if( row == 0 || v < lo )
+				lo = v;
+			if( row == 0 || v > hi )
+				hi = v;
+			sum += v;
+		}
+		printf( "%-14s %14.5f %14.5f %14.5f\n", c->name, lo, hi, lf.rows ? sum / lf.rows : 0.0 );
+	}
+
+	i = dir ? writeColumns( &lf, dir ) : 0;
+	if( check )
+		i |= verify( &lf, path );
+	logFileClose( &lf );
+	return i;
+}
@@ -23,6 +23,7 @@
 #include <string.h>
 #include <time.h>
 #include <limits.h>
+#include <errno.h>
 
 #if defined(_WIN32) || defined(WIN32) || defined(__WIN32__)
 #include <conio.h>
@@ -35,6 +36,16 @@
 #endif
 
 #include "isense.h"
+#include "../iob.h"
+#include "../rt.h"
+#include "../pace.h"
+#include "stationring.h"
+#include "../pose.h"
+#include "trackerworker.h"
+#include "asynclog.h"
+#include "logplan.h"
+#include "flightrec.h"
+#include "archive.h"
 
 #define ESC 0x1B
 #define VER "1.1.0"
@@ -42,6 +53,29 @@
 // DLL version, set once the first tracker is detected
 float libVersion = -1;
 
+// How log files reach the disk: plain write() per block, or io_uring (-i uring)
+enum iob_backend logBackend = IOB_PLAIN;
+
+// With -F hours, 'a' logs all trackers to a flight recorder holding that many hours
+// instead of to alldata.log; see flightrec.h
+float flightRecHours = 0;
+FlightRec flightRec;
+
+// With -A, the logs are columnar archives (stationdata.arc...) instead; see archive.h
+Bool archiveLogs = FALSE;
+
+// Ring buffer of every valid station, by tracker handle and station (both 1-based)
+StationRing stationRings[ISD_MAX_TRACKERS][ISD_MAX_STATIONS];
+
+// How a log line is laid out for each combination of inputs a station can have
+LogPlan logPlans[LOGPLAN_COUNT];
+
+#if defined UNIX
+// A polling thread per tracker while logging all trackers, see trackerworker.h
+TrackerWorker trackerWorkers[ISD_MAX_TRACKERS];
+int numTrackerWorkers = 0;
+#endif
+
 //==========================================================================================
 const char *systemType( int Type ) 
 {
@@ -104,15 +138,113 @@ void configureStations( ISD_TRACKER_HANDLE currentTrackerH, ISD_STATION_INFO_TYP
 			{
 				validStation[currentTrackerH-1][i-1] = 1;
 
-				// Configure ring buffer for logging purposes
+				// Configure ring buffer for logging purposes, in a buffer of our own so the
+				// loop can read it in place; see stationring.h
 				// 180 samples is ~1 second at typical data rate for wired devices
-				ISD_RingBufferSetup(currentTrackerH, i , NULL, 180);
-				ISD_RingBufferStart(currentTrackerH, i);
+				stationRingOpen(&stationRings[currentTrackerH-1][i-1], currentTrackerH, i, 180);
 			}
 		}
 	}
 }
 
+//==========================================================================================
+//
+//  Queue every sample that reached a station's ring buffer since the last call for the
+//  log's writer thread, skipping numRecordsToSkip between logged ones; with no log the
+//  samples are just dropped
+//
+//==========================================================================================
+void logStationRing( StationRing *ring, WORD trackerNum, WORD stationNum, AsyncLog *log,
+					 ISD_STATION_INFO_TYPE *staInfo,
+					 ISD_STATION_HARDWARE_INFO_TYPE stationHwInfo[ISD_MAX_TRACKERS][ISD_MAX_STATIONS],
+					 WORD *numRecordsSkipped, WORD numRecordsToSkip )
+{
+	StationSpan spans[2];
+	LogRecord *r;
+	DWORD k;
+	int s, n;
+
+	n = stationRingDrain( ring, spans );
+	for( s = 0; s < n && log; s++ )
+	{
+		for( k = 0; k < spans[s].count; k++ )
+		{
+			if( *numRecordsSkipped < numRecordsToSkip )
+			{
+				(*numRecordsSkipped)++;
+			}
+			else
+			{
+				*numRecordsSkipped = 0;
+				if( (r = asyncLogReserve( log )) != NULL )
+				{
+					pose_from_station( &r->pose, &r->ext, trackerNum + 1, stationNum, &spans[s].data[k] );
+					logPlanMark( r, staInfo, &stationHwInfo[trackerNum][stationNum-1] );
+					asyncLogCommit( log );
+				}
+			}
+		}
+	}
+}
+
+#if defined UNIX
+//==========================================================================================
+//
+//  Start a polling thread per tracker for logging all trackers, unless they are running
+//  already; FALSE if they couldn't all be started, and the trackers are to be polled
+//  from this thread as before
+//
+//==========================================================================================
+Bool startTrackerWorkers( ISD_TRACKER_HANDLE Trackers[ISD_MAX_TRACKERS], WORD numOpenTrackers,
+						  WORD validStation[ISD_MAX_TRACKERS][ISD_MAX_STATIONS] )
+{
+	static Bool failed = FALSE;
+	WORD i;
+
+	if( numTrackerWorkers > 0 )
+		return TRUE;
+	if( failed )
+		return FALSE;
+
+	for( i = 0; i < numOpenTrackers; i++ )
+	{
+		if( !startTrackerWorker( &trackerWorkers[i], Trackers[i], i, stationRings[Trackers[i]-1],
+								 validStation[i] ) )
+		{
+			printf( "\nCouldn't start a thread for tracker %d, polling them all from one\n", i+1 );
+			while( i > 0 )
+				stopTrackerWorker( &trackerWorkers[--i] );
+			failed = TRUE;
+			return FALSE;
+		}
+	}
+	numTrackerWorkers = numOpenTrackers;
+	return TRUE;
+}
+
+//==========================================================================================
+//
+//  Stop them, and say how each tracker did; called with the library lock held, as the
+//  main loop holds it, and lets go of it while they finish what they're doing
+//
+//==========================================================================================
+void stopTrackerWorkers( void )
+{
+	int i;
+
+	if( numTrackerWorkers == 0 )
+		return;
+
+	unlockTrackerLibrary();
+	for( i = 0; i < numTrackerWorkers; i++ )
+		stopTrackerWorker( &trackerWorkers[i] );
+	lockTrackerLibrary();
+	printf( "\n" );
+	printTrackerWorkers( trackerWorkers, numTrackerWorkers );
+	numTrackerWorkers = 0;
+}
+#endif
+
 //==========================================================================================
 //
 //  Get and display tracker information
@@ -130,20 +262,24 @@ void showTrackerStats( ISD_TRACKER_HANDLE Trackers[ISD_MAX_TRACKERS], ISD_TRACKE
 	DWORD maxStations;
 
 	printf( "\n\n========================== Tracker Information ==========================\n" );
-	printf( "Ver: %s, Lib: %0.4f. LogRatio: 1:%d. Press 'h' for help\nLOGGING: ", VER, libVersion, recordsToSkip+1 );
+	printf( "Ver: %s, Lib: %0.4f. LogRatio: 1:%d. Log I/O: %s. Press 'h' for help\nLOGGING: ", 
+		VER, libVersion, recordsToSkip+1, iob_backend_name(logBackend) );
 	
 	switch(logType)
 	{
 		case 1:
-			printf( "Current Tracker / Current Station (stationdata.log)" );
+			printf( "Current Tracker / Current Station (stationdata.%s)", archiveLogs ? "arc" : "log" );
 			break;
 
 		case 2:
-			printf( "Current Tracker / All Stations (stationsdata.log)" );
+			printf( "Current Tracker / All Stations (stationsdata.%s)", archiveLogs ? "arc" : "log" );
 			break;
 
 		case 3:
-			printf( "All Trackers / All Stations (alldata.log)" );
+			if( flightRecHours > 0 )
+				printf( "All Trackers / All Stations (alldata.rec, last %g hours)", flightRecHours );
+			else
+				printf( "All Trackers / All Stations (alldata.%s)", archiveLogs ? "arc" : "log" );
 			break;
 
 		case 0:
@@ -287,256 +423,329 @@ void showTrackerStats( ISD_TRACKER_HANDLE Trackers[ISD_MAX_TRACKERS], ISD_TRACKE
 //      battery voltage (float)
 //      temperature (float)
 //==========================================================================================
-void logData(ISD_TRACKER_HANDLE Trackers[ISD_MAX_TRACKERS], ISD_STATION_DATA_TYPE *data, 
-			 WORD trackerNum, WORD stationNum, FILE *fp,
-			 ISD_STATION_INFO_TYPE *staInfo,
-			 ISD_STATION_HARDWARE_INFO_TYPE	stationHwInfo[ISD_MAX_TRACKERS][ISD_MAX_STATIONS])
+void logHeader(ISD_TRACKER_HANDLE Trackers[ISD_MAX_TRACKERS], FILE *fp,
+			   ISD_STATION_HARDWARE_INFO_TYPE	stationHwInfo[ISD_MAX_TRACKERS][ISD_MAX_STATIONS])
 {
 	ISD_TRACKER_INFO_TYPE				Tracker;
 	ISD_STATION_INFO_TYPE				Station;
 	ISD_HARDWARE_INFO_TYPE				hwInfo;
 	ISD_STATION_INFO_TYPE				Stations[ISD_MAX_STATIONS];
 
-	static double						osLibTimeDiff = 0.0;
-	static WORD							recordsSkipped = 0;
 	WORD								i, j, thisStation, numOpenTrackers = 0, numStations = 1;
 	DWORD								maxStations;
-	BYTE								buttons = 0;
 	time_t								now;
 
 	// Initial write to the file:
 	// First metadata, then actual logged data.  The metadata provides information about what device(s)
 	// was/were logged, which makes it much easier to remember all of the specific settings that applied
 	// when the data was taken
-	if(ftell(fp) == 0)
+	// Only get the time the first time through the log
+	time(&now);
+
+	// Determine the number of currently open trackers
+	ISD_NumOpenTrackers(&numOpenTrackers);
+
+	// Print program information
+	fprintf(fp,"[BEGIN LOG INFO]\n");
+	fprintf(fp,"Version,LogDate\n");
+	fprintf(fp,"%s,%s", VER, asctime(localtime(&now)) );
+	fprintf(fp,"[END LOG INFO]\n\n");
+
+	// Print tracker information
+	fprintf(fp,"[BEGIN TRACKER INFO]\n");
+	fprintf(fp,"TrackerNum,LibVersion,TrackerType,TrackerModel,Port,SyncState,SyncRate,SyncPhase,");
+	fprintf(fp,"Interface,UltTimeout,UltVolume,FirmwareRev,LedEnable\n");
+	for(i = 0; i < numOpenTrackers; i++)
 	{
-		// Only get the time the first time through the log
-		time(&now);
-
-		// Determine the number of currently open trackers
-		ISD_NumOpenTrackers(&numOpenTrackers);
-
-		// Print program information
-		fprintf(fp,"[BEGIN LOG INFO]\n");
-		fprintf(fp,"Version,LogDate\n");
-		fprintf(fp,"%s,%s", VER, asctime(localtime(&now)) );
-		fprintf(fp,"[END LOG INFO]\n\n");
-
-		// Print tracker information
-		fprintf(fp,"[BEGIN TRACKER INFO]\n");
-		fprintf(fp,"TrackerNum,LibVersion,TrackerType,TrackerModel,Port,SyncState,SyncRate,SyncPhase,");
-		fprintf(fp,"Interface,UltTimeout,UltVolume,FirmwareRev,LedEnable\n");
-		for(i = 0; i < numOpenTrackers; i++)
+		if( ISD_GetTrackerConfig( Trackers[i], &Tracker, FALSE ) )
 		{
-			if( ISD_GetTrackerConfig( Trackers[i], &Tracker, FALSE ) )
-			{
-				fprintf(fp,"%u,%3.4f,%u,%u,%u,%u,%f,%u,%u,%u,%u,%3.4f,%u\n",
-					i+1,Tracker.LibVersion,Tracker.TrackerType,Tracker.TrackerModel,
-					Tracker.Port,Tracker.SyncState,Tracker.SyncRate,Tracker.SyncPhase,
-					Tracker.Interface,Tracker.UltTimeout,Tracker.UltVolume,Tracker.FirmwareRev,
-					Tracker.LedEnable);
-			}
-			else
-			{
-				fprintf(fp,"ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR\n");
-			}
+			fprintf(fp,"%u,%3.4f,%u,%u,%u,%u,%f,%u,%u,%u,%u,%3.4f,%u\n",
+				i+1,Tracker.LibVersion,Tracker.TrackerType,Tracker.TrackerModel,
+				Tracker.Port,Tracker.SyncState,Tracker.SyncRate,Tracker.SyncPhase,
+				Tracker.Interface,Tracker.UltTimeout,Tracker.UltVolume,Tracker.FirmwareRev,
+				Tracker.LedEnable);
 		}
-		fprintf(fp,"[END TRACKER INFO]\n\n");
+		else
+		{
+			fprintf(fp,"ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR\n");
+		}
+	}
+	fprintf(fp,"[END TRACKER INFO]\n\n");
 
-		// Print station information
-		fprintf(fp,"[BEGIN STATION INFO]\n");
-		fprintf(fp,"TrackerNum,StationNum,Serial,FW,StationType,Descriptor,CalDate,Port,");
-		fprintf(fp,"Timestamp,State,Enhancement,Sensitivity,Compass,Prediction\n" );
+	// Print station information
+	fprintf(fp,"[BEGIN STATION INFO]\n");
+	fprintf(fp,"TrackerNum,StationNum,Serial,FW,StationType,Descriptor,CalDate,Port,");
+	fprintf(fp,"Timestamp,State,Enhancement,Sensitivity,Compass,Prediction\n" );
 
-		for(i = 0; i < numOpenTrackers; i++)
+	for(i = 0; i < numOpenTrackers; i++)
+	{
+		if( ISD_GetTrackerConfig( Trackers[i], &Tracker, FALSE ) )
 		{
-			if( ISD_GetTrackerConfig( Trackers[i], &Tracker, FALSE ) )
+			if( ISD_GetSystemHardwareInfo( Trackers[i], &hwInfo ) )
 			{
-				if( ISD_GetSystemHardwareInfo( Trackers[i], &hwInfo ) )
+				if( hwInfo.Valid )
 				{
-					if( hwInfo.Valid )
-					{
-						maxStations = hwInfo.Capability.MaxStations;
-					}
+					maxStations = hwInfo.Capability.MaxStations;
 				}
+			}
 
-				if( Tracker.TrackerType == ISD_PRECISION_SERIES )
-				{
-					for( thisStation = 1; thisStation <= maxStations; thisStation++ )
-					{         
-						// Fill ISD_STATION_INFO_TYPE structure with current station configuration 
-						if( !ISD_GetStationConfig( Trackers[i], 
-							&Stations[thisStation-1], thisStation, FALSE ) ) break;
-					}
+			if( Tracker.TrackerType == ISD_PRECISION_SERIES )
+			{
+				for( thisStation = 1; thisStation <= maxStations; thisStation++ )
+				{         
+					// Fill ISD_STATION_INFO_TYPE structure with current station configuration 
+					if( !ISD_GetStationConfig( Trackers[i], 
+						&Stations[thisStation-1], thisStation, FALSE ) ) break;
 				}
+			}
 
-				switch( Tracker.TrackerModel ) 
-				{
-				case ISD_IS300:
-				case ISD_IS1200:
-					numStations = 4;
-					break;
-				case ISD_IS600:
-				case ISD_IS900:
-					numStations = ISD_MAX_STATIONS;
-					break;
-				default:
-					numStations = 1;
-					break;
-				}
+			switch( Tracker.TrackerModel ) 
+			{
+			case ISD_IS300:
+			case ISD_IS1200:
+				numStations = 4;
+				break;
+			case ISD_IS600:
+			case ISD_IS900:
+				numStations = ISD_MAX_STATIONS;
+				break;
+			default:
+				numStations = 1;
+				break;
+			}
 
-				printf("");
+			printf("");
 
-				for(j = 0; j < numStations; j++)
+			for(j = 0; j < numStations; j++)
+			{
+				if( stationHwInfo[i][j].Valid == 1)
 				{
-					if( stationHwInfo[i][j].Valid == 1)
+					if( ISD_GetStationConfig( Trackers[i], &Station, j+1, FALSE ))
 					{
-						if( ISD_GetStationConfig( Trackers[i], &Station, j+1, FALSE ))
+						if(Station.State == 1) // Don't log stations that are not connected
 						{
-							if(Station.State == 1) // Don't log stations that are not connected
-							{
-								fprintf(fp,"%u,%u,%u,%g,%u,%s,%s,%u,%s,%s,%u,%u,%u,%u\n",
-									i+1, j+1,
-									stationHwInfo[i][j].Valid ? (&stationHwInfo[i][j])->SerialNum : -1,
-									stationHwInfo[i][j].Valid ? (&stationHwInfo[i][j])->FirmwareRev : -1, 
-									stationHwInfo[i][j].Type,
-									stationHwInfo[i][j].DescVersion,
-									stationHwInfo[i][j].CalDate,
-									stationHwInfo[i][j].Port,
-									Station.TimeStamped ? "ON" : "OFF",
-									Station.State ? "ON" : "OFF",
-									Station.Enhancement,
-									Station.Sensitivity, 
-									Station.Compass, 
-									Station.Prediction );
-							}
-						}
-						else
-						{
-							fprintf(fp,"%u,%u,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR\n",
-								i+1,j+1);
+							fprintf(fp,"%u,%u,%u,%g,%u,%s,%s,%u,%s,%s,%u,%u,%u,%u\n",
+								i+1, j+1,
+								stationHwInfo[i][j].Valid ? (&stationHwInfo[i][j])->SerialNum : -1,
+								stationHwInfo[i][j].Valid ? (&stationHwInfo[i][j])->FirmwareRev : -1, 
+								stationHwInfo[i][j].Type,
+								stationHwInfo[i][j].DescVersion,
+								stationHwInfo[i][j].CalDate,
+								stationHwInfo[i][j].Port,
+								Station.TimeStamped ? "ON" : "OFF",
+								Station.State ? "ON" : "OFF",
+								Station.Enhancement,
+								Station.Sensitivity, 
+								Station.Compass, 
+								Station.Prediction );
 						}
 					}
+					else
+					{
+						fprintf(fp,"%u,%u,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR\n",
+							i+1,j+1);
+					}
 				}
 			}
-			else
-			{
-				fprintf(fp,"%u,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR\n",i+1);
-			}
 		}
-		fprintf(fp,"[END STATION INFO]\n");
-		fprintf(fp,"\n");
-
-		fprintf(fp,"TrackerNum,StationNum,X,Y,Z,Yaw,Pitch,Roll,Time,DoubleTime,DoubleOSTime,TQ,CI,MQ,GXBF,");
-		fprintf(fp,"GYBF,GZBF,GXNF,GYNF,GZNF,GXRAW,GYRAW,GZRAW,AXBF,AYBF,AZBF,AXNF,AYNF,AZNF," );
-		fprintf(fp,"MagX,MagY,MagZ,CompassYaw,JoystickAxis1,");
-		fprintf(fp,"JoystickAxis2,Buttons,AuxIn0,AuxIn1,AuxIn2,AuxIn3,StillTime,Vbatt,Temperature\n" );
+		else
+		{
+			fprintf(fp,"%u,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR,ERR\n",i+1);
+		}
 	}
+	fprintf(fp,"[END STATION INFO]\n");
+	fprintf(fp,"\n");
 
-	// Set the initial logged timestamp
-	if(osLibTimeDiff == 0.0)
-		osLibTimeDiff = data->OSTimeStampSeconds + data->OSTimeStampMicroSec * 1.0e-6 - data->TimeStamp;
+	fputs(LOGPLAN_HEADER, fp);
+}
 
-	// Tracker and station identification numbers
-	fprintf( fp, "%d,%d,", trackerNum + 1, stationNum );
+//==========================================================================================
+//
+//  One line of data in the format above, for a log's writer thread (see asynclog.h and
+//  logplan.h)
+//
+//==========================================================================================
+size_t logRow( AsyncLog *log, const LogRecord *r, char *out )
+{
+	// Set the initial logged timestamp
+	if(log->osTimeOffset == 0.0)
+		log->osTimeOffset = r->ext.os_time_s + r->ext.os_time_us * 1.0e-6 - r->pose.time;
 
-	// X, Y, Z (m)
-	fprintf( fp, "%.5f,%.5f,%.5f,",
-				data->Position[0], data->Position[1], data->Position[2]);
+	return logPlanFormat( &logPlans[logPlanIndex(r)], r, log->osTimeOffset, out );
+}
 
-	// Yaw, pitch, roll (degrees)
-	fprintf( fp, "%.3f,%.3f,%.3f,",
-				data->Euler[0], data->Euler[1], data->Euler[2]);
 
-	// Timestamp (seconds)
-	fprintf( fp, "%.4f,", data->TimeStamp);
 
-	// Double precision sensor timestamp (seconds)
-	fprintf( fp, "%.4f,", (double)data->TimeStampSeconds + 
-						  (double)data->TimeStampMicroSec * 1.0e-6);
+//==========================================================================================
+//
+//  Open a log as an archive, path with .arc for .log, keeping the header as text, and
+//  hand it to a writer thread of its own
+//
+//==========================================================================================
+AsyncLog *openArchive( AsyncLog *log, const char *path, ISD_TRACKER_HANDLE Trackers[ISD_MAX_TRACKERS],
+					   ISD_STATION_HARDWARE_INFO_TYPE stationHwInfo[ISD_MAX_TRACKERS][ISD_MAX_STATIONS],
+					   const struct rt_request *writerRt )
+{
+	char arcPath[256], *text = NULL;
+	size_t textBytes = 0;
+	Archive *archive;
+	FILE *mem;
 
-	// Double precision OS timestamp, offset to coincide with DLL timestamp (seconds)
-	fprintf( fp, "%.4f,", (double)data->OSTimeStampSeconds + 
-						  (double)data->OSTimeStampMicroSec * 1.0e-6 - osLibTimeDiff);
+	snprintf(arcPath, sizeof(arcPath), "%.*s.arc", (int) strcspn(path, "."), path);
+	if((mem = open_memstream(&text, &textBytes)) == NULL)
+	{
+		printf( "\nCouldn't open %s\n", arcPath );
+		return NULL;
+	}
+	logHeader(Trackers, mem, stationHwInfo);
+	fclose(mem);
 
-	// TQ, CI, MQ
-	fprintf( fp, "%d,%d,%d,",
-		(int)(data->TrackingStatus/2.55), data->CommIntegrity, data->MeasQuality);
+	archive = archiveOpen(arcPath, logBackend, text, textBytes);
+	free(text);
+	if(archive == NULL)
+	{
+		printf( "\nCouldn't open %s\n", arcPath );
+		return NULL;
+	}
+	if(!asyncLogStartStore(log, archiveStore, archive, writerRt))
+	{
+		printf( "\nCouldn't start a writer thread for %s\n", arcPath );
+		archiveClose(archive, NULL);
+		return NULL;
+	}
+	return log;
+}
 
-	// AngularVelBodyFrame (rad/sec)
-	fprintf( fp, "%.5f,%.5f,%.5f,",
-		data->AngularVelBodyFrame[0], data->AngularVelBodyFrame[1], data->AngularVelBodyFrame[2]);
+//==========================================================================================
+//
+//  Open a log file and write its header, then hand it to a writer thread of its own
+//
+//==========================================================================================
+AsyncLog *openLog( AsyncLog *log, const char *path, ISD_TRACKER_HANDLE Trackers[ISD_MAX_TRACKERS],
+				   ISD_STATION_HARDWARE_INFO_TYPE stationHwInfo[ISD_MAX_TRACKERS][ISD_MAX_STATIONS],
+				   const struct rt_request *writerRt )
+{
+	FILE *fp;
 
-	// AngularVelNavFrame (rad/sec)
-	fprintf( fp, "%.5f,%.5f,%.5f,",
-		data->AngularVelNavFrame[0], data->AngularVelNavFrame[1], data->AngularVelNavFrame[2]);
+	if(archiveLogs)
+		return openArchive(log, path, Trackers, stationHwInfo, writerRt);
 
-	// AngularVelRaw (rad/sec)
-	fprintf( fp, "%.5f,%.5f,%.5f,",
-		data->AngularVelRaw[0], data->AngularVelRaw[1], data->AngularVelRaw[2]);
+	if((fp = iob_fopen(path, logBackend)) == NULL)
+	{
+		printf( "\nCouldn't open %s\n", path );
+		return NULL;
+	}
 
-	// AccelBodyFrame (m/s^2)
-	fprintf( fp, "%.5f,%.5f,%.5f,",
-		data->AccelBodyFrame[0], data->AccelBodyFrame[1], data->AccelBodyFrame[2]);
+	logHeader(Trackers, fp, stationHwInfo);
+	if(!asyncLogStart(log, fp, logRow, writerRt))
+	{
+		printf( "\nCouldn't start a writer thread for %s\n", path );
+		fclose(fp);
+		return NULL;
+	}
+	return log;
+}
 
-	// AccelNavFrame (m/s^2)
-	fprintf( fp, "%.5f,%.5f,%.5f,",
-		data->AccelNavFrame[0], data->AccelNavFrame[1], data->AccelNavFrame[2]);
+//==========================================================================================
+//
+//  Open the flight recorder with room for the last flightRecHours of every valid station
+//  at its tracker's current record rate, as thinned out by the log ratio, and give it a
+//  writer thread
+//
+//==========================================================================================
+AsyncLog *openFlightRecorder( AsyncLog *log, const char *path, ISD_TRACKER_HANDLE Trackers[ISD_MAX_TRACKERS],
+							  WORD validStation[ISD_MAX_TRACKERS][ISD_MAX_STATIONS],
+							  WORD numRecordsToSkip, const struct rt_request *writerRt )
+{
+	ISD_TRACKER_INFO_TYPE tracker;
+	double perSec = 0, records;
+	WORD i, j;
 
-	// Magnetometer data (Gauss)
-	fprintf( fp, "%.5f,%.5f,%.5f,",
-		data->MagBodyFrame[0], data->MagBodyFrame[1], data->MagBodyFrame[2]);
+	for( i = 0; i < ISD_MAX_TRACKERS && Trackers[i] > 0; i++ )
+	{
+		// Not known until the tracker has been running a while; 180 Hz is typical
+		DWORD rate = 180;
 
-	// Compass yaw, from magnetometers (degrees)
-	fprintf( fp, "%.3f,",
-		data->CompassYaw ); 
+		if( ISD_GetTrackerConfig( Trackers[i], &tracker, FALSE ) && tracker.RecordsPerSec > 0 )
+			rate = tracker.RecordsPerSec;
+		for( j = 0; j < ISD_MAX_STATIONS; j++ )
+		{
+			if( validStation[i][j] )
+				perSec += (double) rate / (numRecordsToSkip + 1);
+		}
+	}
 
-	// Joystick axis 1,2 (0-255)
-	if(staInfo->GetInputs)
+	records = flightRecHours * 3600.0 * (perSec > 0 ? perSec : 180);
+	if( records > UINT_MAX )
+		records = UINT_MAX;
+	if( !flightRecOpen( &flightRec, path, records < 1 ? 1 : (uint32_t) records ) )
 	{
-		fprintf( fp, "%u,%u,", data->AnalogData[0],data->AnalogData[1] ); 
+		printf( "\nCouldn't create a %g hour flight recorder %s (%s)\n", flightRecHours, path, strerror(errno) );
+		return NULL;
 	}
-	else
+	if( !asyncLogStartStore( log, flightRecStore, &flightRec, writerRt ) )
 	{
-		fprintf( fp, "-1,-1," );
+		printf( "\nCouldn't start a writer thread for %s\n", path );
+		flightRecClose( &flightRec );
+		return NULL;
 	}
+	if( flightRec.kept )
+		printf( "\n%s was never closed, kept it as %s.%d", path, path, flightRec.kept );
+	printf( "\n%s holds %u records, %.1f MB, %g hours at %.0f records/s\n", path, flightRec.capacity,
+			flightRec.size / 1048576.0, flightRecHours, perSec );
+	return log;
+}
 
-	// Button data (written as a byte, as 8 inputs are allowed currently)
-	if(staInfo->GetInputs)
-	{
-		for(i=0; i < ISD_MAX_BUTTONS; i++)
-		{
-			buttons |= data->ButtonState[i] << i;
-		}
-		fprintf( fp, "%u,", buttons );
-	}
-	else
-		fprintf( fp, "-1," );
+//==========================================================================================
+//
+//  Close a log file once everything queued is written, reporting how many syscalls that
+//  took and how far behind the writer got
+//
+//==========================================================================================
+void closeLog( AsyncLog **log )
+{
+	struct iob *io;
+
+	if(*log == NULL)
+		return;
 
-	// AUX input (input from station) data bytes
-	if(staInfo->GetAuxInputs)
+	asyncLogStop(*log);
+	if((*log)->store == archiveStore)
 	{
-		for(i=0; i < ISD_MAX_AUX_INPUTS; i++)
-		{
-			if(i < stationHwInfo[trackerNum][stationNum-1].Capability.AuxInputs)
-				fprintf( fp, "%d,", data->AuxInputs[i] );
-			else
-				fprintf( fp, "-1," );
-		}
+		uint64_t bytes = 0;
+		int failed = archiveClose((Archive *)(*log)->context, &bytes);
+
+		printf( "\nArchive closed: %lu lines, %lu dropped, queue depth at most %u of %d, "
+				"%llu bytes%s\n",
+			(unsigned long)(*log)->lines, (unsigned long)(*log)->dropped, (unsigned)(*log)->maxDepth,
+			ASYNCLOG_QUEUE, (unsigned long long)bytes, failed ? ", WRITE FAILED" : "" );
+		*log = NULL;
+		return;
 	}
-	else
+	if((*log)->store == flightRecStore)
 	{
-		fprintf( fp, "-1,-1,-1,-1," );
+		FlightRec *rec = (FlightRec *)(*log)->context;
+
+		flightRecClose(rec);
+		printf( "\nFlight recorder closed: %lu records, %lu dropped, queue depth at most %u of %d, "
+				"the last %llu of them kept%s\n",
+			(unsigned long)(*log)->lines, (unsigned long)(*log)->dropped, (unsigned)(*log)->maxDepth,
+			ASYNCLOG_QUEUE, (unsigned long long)(rec->seq < rec->capacity ? rec->seq : rec->capacity),
+			rec->failed ? ", WRITEBACK FAILED" : "" );
+		*log = NULL;
+		return;
 	}
 
-	// Still time
-	fprintf( fp, "%.4f,", data->StillTime );
+	io = (*log)->io;
+	iob_flush(io);
+	printf( "\nLog closed: %lu lines, %lu dropped, queue depth at most %u of %d, "
+			"%llu bytes in %llu syscalls (%s)%s\n",
+		(unsigned long)(*log)->lines, (unsigned long)(*log)->dropped, (unsigned)(*log)->maxDepth,
+		ASYNCLOG_QUEUE, io->bytes, io->syscalls, iob_backend_name(io->backend),
+		(*log)->failed ? ", WRITE FAILED" : "" );
 
-	// Battery and temperature (3DOF sensors)
-	fprintf( fp, "%.3f,%.3f", data->BatteryLevel, data->Temperature);
-	
-	// End of line
-	fprintf( fp, "\n" );
+	fclose((*log)->fp);
+	*log = NULL;
 }
 
 
@@ -550,7 +759,9 @@ void showStationData( ISD_TRACKER_HANDLE				currentTrackerH,
 					  ISD_STATION_INFO_TYPE				*Station,
 					  ISD_STATION_DATA_TYPE				*data,
 					  ISD_STATION_HARDWARE_INFO_TYPE	*stationHwInfo,
-					  BYTE showTemp)
+					  BYTE showTemp,
+					  const struct pace					*pace,
+					  AsyncLog							*log)
 {
 	DWORD i;
 
@@ -619,6 +830,18 @@ void showStationData( ISD_TRACKER_HANDLE				currentTrackerH,
 
 		printf( "%1.1fs ", data->TimeStamp );
 
+		// What polling costs, and how long after a record was due it was picked up
+		if( pace )
+		{
+			printf( "%.1f%%CPU late %.1fms ", pace->cpu * 100, pace->late_mean * 1e3 );
+		}
+
+		// How far behind the log's writer thread is, and what it had no room for
+		if( log )
+		{
+			printf( "log %u drop %lu ", asyncLogDepth( log ), (unsigned long) log->dropped );
+		}
+
 		printf( "\r" );
 		fflush(0);
 	}
@@ -665,18 +888,20 @@ int unix_kbhit(void)
 // The main function shows how to initialize and obtain data from InterSense trackers. 
 //
 //==========================================================================================
-int main()
+int main( int argc, char *argv[] )
 {
 	ISD_TRACKER_HANDLE              Trackers[ISD_MAX_TRACKERS];
 	ISD_TRACKER_HANDLE				currentTrackerH;
-	ISD_TRACKING_DATA_TYPE          data, alternateTrackerData;
+	ISD_TRACKING_DATA_TYPE          data;
+	ISD_STATION_DATA_TYPE			*shown;
 	ISD_STATION_INFO_TYPE           Stations[ISD_MAX_STATIONS];
 	ISD_STATION_HARDWARE_INFO_TYPE	StationsHwInfo[ISD_MAX_TRACKERS][ISD_MAX_STATIONS];
 	ISD_TRACKER_INFO_TYPE           TrackerInfo;
 	ISD_HARDWARE_INFO_TYPE			hwInfo;
-	FILE 							*fpStation = NULL;
-	FILE 							*fpStations = NULL;
-	FILE 							*fpAll = NULL;
+	static AsyncLog					logs[3];
+	AsyncLog						*logStation = NULL;
+	AsyncLog						*logStations = NULL;
+	AsyncLog						*logAll = NULL;
 	FILE							*fpCurrent = NULL;
 
 	// These are 1-based indexes specifying the currently selected tracker and station
@@ -695,8 +920,77 @@ int main()
 	float lastTime; 
 #if defined UNIX
 	char ch_key;
+	struct pace pace;
+	struct pose_sample pose;
+	struct pose_extended ext;
+	LogRecord *record;
+	DWORD head, tail;
 #endif
 
+	// Command line options
+	struct rt_request loggerRt, writerRt;
+	BYTE lockMemory = FALSE;
+	rt_default( &loggerRt );
+	rt_default( &writerRt );
+	logPlanInit( logPlans );
+	for( i = 1; i < argc; i++ )
+	{
+		if( strcmp(argv[i], "-i") == 0 && i+1 < argc )
+		{
+			if( iob_parse_backend(argv[++i], &logBackend) != 0 )
+			{
+				printf( "Unknown log I/O backend '%s', expected plain or uring\n", argv[i] );
+				exit(1);
+			}
+		}
+		else if( strcmp(argv[i], "-L") == 0 && i+1 < argc )
+		{
+			// this thread polls the trackers and queues samples for the logs
+			if( rt_parse(argv[++i], &loggerRt) != 0 )
+			{
+				printf( "Expected cpu, cpu:priority or :priority, got '%s'\n", argv[i] );
+				exit(1);
+			}
+		}
+		else if( strcmp(argv[i], "-W") == 0 && i+1 < argc )
+		{
+			// each log's writer thread, applied as it's started
+			if( rt_parse(argv[++i], &writerRt) != 0 )
+			{
+				printf( "Expected cpu, cpu:priority or :priority, got '%s'\n", argv[i] );
+				exit(1);
+			}
+		}
+		else if( strcmp(argv[i], "-F") == 0 && i+1 < argc )
+		{
+			if( (flightRecHours = (float) atof(argv[++i])) <= 0 )
+			{
+				printf( "Expected a number of hours, got '%s'\n", argv[i] );
+				exit(1);
+			}
+		}
+		else if( strcmp(argv[i], "-A") == 0 )
+		{
+			archiveLogs = TRUE;
+		}
+		else if( strcmp(argv[i], "-M") == 0 )
+		{
+			lockMemory = TRUE;
+		}
+		else
+		{
+			printf( "usage: %s [-i plain|uring] [-L cpu[:prio]] [-W cpu[:prio]] [-F hours] [-A] [-M]\n", argv[0] );
+			printf( "  -L  pin the polling loop to a core and/or run it SCHED_FIFO at prio\n" );
+			printf( "  -W  same for the threads writing the log files\n" );
+			printf( "  -F  'a' keeps the last hours of samples in alldata.rec, a binary file of\n"
+					"      fixed size, instead of logging to alldata.log (see flightrec.h)\n" );
+			printf( "  -A  write the logs as columnar archives, stationdata.arc and so on, to be\n"
+					"      read with logarc (see archive.h)\n" );
+			printf( "  -M  mlockall, so no page faults once running\n" );
+			exit(1);
+		}
+	}
+
 	// Detect all trackers, using ISD_OpenAllTrackers().  Note that all InertiaCube
 	// products are considered "trackers" (even when on the same receiver for wireless
 	// sensors), while stations connected to an IS-900 or similar product are "stations"
@@ -760,6 +1054,9 @@ int main()
 
 		station = 1;
 		lastTime = ISD_GetTime();
+#if defined UNIX
+		pace_init( &pace, 0 );
+#endif
 
 		// Move the selected station to the first valid station
 		for( i=0; i < ISD_MAX_STATIONS; i++ )
@@ -771,9 +1068,17 @@ int main()
 			}
 		}
 
+		rt_apply( pthread_self(), "logger", &loggerRt );
+		if( lockMemory ) rt_lock_memory();
+
 		// Show information for all trackers, initially with first tracker/station selected:
 		showTrackerStats( Trackers, currentTrackerH, station, logType, numRecordsToSkip );
 
+#if defined UNIX
+		// The loop calls into the library throughout, so it lets the threads polling the
+		// trackers have it only while it sleeps
+		lockTrackerLibrary();
+#endif
 		while( !done )
 		{
 			// Keyboard handling functions
@@ -800,6 +1105,11 @@ int main()
 						char buf[1024];
 						int numOutputs = StationsHwInfo[currentTrackerH-1][station-1].Capability.AuxOutputs;
 
+						// Not to hold up the threads polling the trackers while waiting on
+						// the keyboard; they start again with the next poll
+#if defined UNIX
+						stopTrackerWorkers();
+#endif
 						if(numOutputs == 0)
 						{
 							printf( "\nThis station does not support AUX output, please check descriptor\n" );
@@ -834,6 +1144,9 @@ int main()
 						printf( "configurable using normal keyboard commands.\n\n" );
 						printf( "Please enter a protocol command to send (4096 byte limit):\n" );
 						
+#if defined UNIX
+						stopTrackerWorkers();
+#endif
 						fgets( buf, sizeof(buf), stdin );
 
 						ISD_SendScript( currentTrackerH, buf );
@@ -984,23 +1297,9 @@ int main()
 						logType = 0;
 
 						// Close any open files
-						if(fpStation)
-						{
-							fclose(fpStation);
-							fpStation = NULL;
-						}
-
-						if(fpStations)
-						{
-							fclose(fpStations);
-							fpStations = NULL;
-						}
-
-						if(fpAll)
-						{
-							fclose(fpAll);
-							fpAll = NULL;
-						}
+						closeLog(&logStation);
+						closeLog(&logStations);
+						closeLog(&logAll);
 
 						fpCurrent = NULL;
 					}
@@ -1016,7 +1315,11 @@ int main()
 					currentTrackerH = Trackers[trackerIdx];
 					station = 1;  // Revert to the first station on tracker switches
 
-					// Reconfigure stations
+					// Reconfigure stations, which starts their ring buffers over; the threads
+					// polling them are started again with the next poll
+#if defined UNIX
+					stopTrackerWorkers();
+#endif
 					configureStations(currentTrackerH, Stations, validStation);
 
 					showTrackerStats( Trackers, currentTrackerH, station, logType, numRecordsToSkip );
@@ -1037,24 +1340,14 @@ int main()
 				case 'x':
 					logType = 0;
 
-					// Close any open files
-					if(fpStation)
-					{
-						fclose(fpStation);
-						fpStation = NULL;
-					}
-
-					if(fpStations)
-					{
-						fclose(fpStations);
-						fpStations = NULL;
-					}
+#if defined UNIX
+					stopTrackerWorkers();
+#endif
 
-					if(fpAll)
-					{
-						fclose(fpAll);
-						fpAll = NULL;
-					}
+					// Close any open files
+					closeLog(&logStation);
+					closeLog(&logStations);
+					closeLog(&logAll);
 
 					fpCurrent = NULL;
 					showTrackerStats( Trackers, currentTrackerH, station, logType, numRecordsToSkip );
@@ -1066,24 +1359,27 @@ int main()
 				case 'l':
 					logType = 1;
 
-					if(!fpStation)
-						fpStation = fopen("stationdata.log","w");
+					if(!logStation)
+						logStation = openLog(&logs[0], "stationdata.log", Trackers, StationsHwInfo, &writerRt);
 					showTrackerStats( Trackers, currentTrackerH, station, logType, numRecordsToSkip );
 					break;
 
 				case 'L':
 					logType = 2;
 
-					if(!fpStations)
-						fpStations = fopen("stationsdata.log","w");
+					if(!logStations)
+						logStations = openLog(&logs[1], "stationsdata.log", Trackers, StationsHwInfo, &writerRt);
 					showTrackerStats( Trackers, currentTrackerH, station, logType, numRecordsToSkip );
 					break;
 
 				case 'a':
 					logType = 3;
 
-					if(!fpAll)
-						fpAll = fopen("alldata.log","w");
+					if(!logAll && flightRecHours > 0)
+						logAll = openFlightRecorder(&logs[2], "alldata.rec", Trackers, validStation,
+													numRecordsToSkip, &writerRt);
+					else if(!logAll)
+						logAll = openLog(&logs[2], "alldata.log", Trackers, StationsHwInfo, &writerRt);
 					showTrackerStats( Trackers, currentTrackerH, station, logType, numRecordsToSkip );
 					break;
 
@@ -1261,6 +1557,8 @@ int main()
 					printf( "l -- Log current tracker / current station to 'stationdata.log' (overwrites)\n" );
 					printf( "L -- Log current tracker / all stations to 'stationsdata.log' (overwrites)\n" );
 					printf( "a -- Log all trackers / all stations to 'alldata.log' (overwrites)\n" );
+					printf( "     or with -F, keep their last hours in 'alldata.rec' (overwrites)\n" );
+					printf( "     with -A, each log is an archive, '.arc' for '.log'\n" );
 					printf( "x -- Stop logging (log file NOT deleted)\n" );
 					printf( "=========================================\n" );
 					printf( "< -- Show/hide AUX data (hex)\n" );
@@ -1281,93 +1579,108 @@ int main()
 				}
 			}
 
+#if defined UNIX
+			// The per-tracker threads only run while logging all trackers
+			if( !(logType == 3 && logAll) )
+				stopTrackerWorkers();
+#endif
+
 			if( currentTrackerH > 0 )
 			{
+				// Each valid station's new samples are read straight out of its ring buffer,
+				// all of them in one go, rather than a whole ISD_TRACKING_DATA_TYPE per sample
+
 				// Logging: Single station
-				if(logType == 1 && fpStation)
+				if(logType == 1 && logStation)
 				{
-					ISD_GetTrackingData( currentTrackerH, &data );
-
-					while(data.Station[station-1].NewData == TRUE)
+					logStationRing(&stationRings[currentTrackerH-1][station-1],trackerIdx,
+								   station,logStation,&Stations[station-1],StationsHwInfo,
+								   &numRecordsSkipped[currentTrackerH-1][station-1],numRecordsToSkip);
+				}
+				// Logging: All stations on selected tracker
+				else if(logType == 2 && logStations)
+				{
+					for(j=0; j < ISD_MAX_STATIONS; j++)
 					{
-						if(numRecordsSkipped[currentTrackerH-1][station-1] < numRecordsToSkip)
-						{
-							numRecordsSkipped[currentTrackerH-1][station-1]++;
-						}
-						else
-						{
-							numRecordsSkipped[currentTrackerH-1][station-1] = 0;
-							logData(Trackers,&data.Station[station-1],trackerIdx,
-							    station,fpStation,&Stations[station-1],StationsHwInfo);
-						}
-						ISD_GetTrackingData( currentTrackerH, &data );
+						if(validStation[trackerIdx][j])
+							logStationRing(&stationRings[currentTrackerH-1][j],trackerIdx,
+										   j+1,logStations,&Stations[station-1],StationsHwInfo,
+										   &numRecordsSkipped[currentTrackerH-1][j],numRecordsToSkip);
 					}
 				}
-				// Logging: All stations on selected tracker
-				else if(logType == 2 && fpStations)
+#if defined UNIX
+				// Logging: All stations on all trackers, each polled by its own thread; this
+				// is the merge stage, taking the oldest sample any of them has queued
+				else if(logType == 3 && logAll &&
+						startTrackerWorkers(Trackers, numOpenTrackers, validStation))
 				{
-					ISD_GetTrackingData( currentTrackerH, &data );
-
-					while(data.Station[station-1].NewData == TRUE)
+					while( mergeTrackerWorkers( trackerWorkers, numTrackerWorkers, &pose, &ext ) )
 					{
-						for(j=0; j < ISD_MAX_STATIONS; j++)
+						i = pose.tracker - 1;
+						j = pose.station - 1;
+						if(numRecordsSkipped[i][j] < numRecordsToSkip)
 						{
-							if(numRecordsSkipped[currentTrackerH-1][j] < numRecordsToSkip)
-							{
-								numRecordsSkipped[currentTrackerH-1][j]++;
-							}
-							else
+							numRecordsSkipped[i][j]++;
+						}
+						else
+						{
+							numRecordsSkipped[i][j] = 0;
+							if( (record = asyncLogReserve( logAll )) != NULL )
 							{
-								numRecordsSkipped[currentTrackerH-1][j] = 0;
-								if(validStation[trackerIdx][j])
-									logData(Trackers,&data.Station[j],trackerIdx,
-											j+1,fpStations,&Stations[station-1],StationsHwInfo);
+								record->pose = pose;
+								record->ext = ext;
+								logPlanMark( record, &Stations[station-1], &StationsHwInfo[i][j] );
+								asyncLogCommit( logAll );
 							}
 						}
-						ISD_GetTrackingData( currentTrackerH, &data );
 					}
 				}
+#endif
 				// Logging: All stations on all trackers
-				else if(logType == 3 && fpAll)
+				else if(logType == 3 && logAll)
 				{
 					for(i=0; i < numOpenTrackers; i++)
 					{
-						// Get all data for all trackers (into alternateTrackerData, 
-						// so we don't mess up the display)
-						ISD_GetTrackingData( Trackers[i], &alternateTrackerData );
-
-						while(alternateTrackerData.Station[station-1].NewData == TRUE)
+						for(j=0; j < ISD_MAX_STATIONS; j++)
 						{
-							for(j=0; j < ISD_MAX_STATIONS; j++)
-							{
-								if(numRecordsSkipped[i][j] < numRecordsToSkip)
-								{
-									numRecordsSkipped[i][j]++;
-								}
-								else
-								{
-									numRecordsSkipped[i][j] = 0;
-									if(validStation[i][j])
-										logData(Trackers,&alternateTrackerData.Station[j],i,
-												j+1,fpAll,&Stations[station-1],StationsHwInfo);
-								}
-							}
-							ISD_GetTrackingData( Trackers[i], &alternateTrackerData );
+							if(validStation[i][j])
+								logStationRing(&stationRings[Trackers[i]-1][j],i,
+											   j+1,logAll,&Stations[station-1],StationsHwInfo,
+											   &numRecordsSkipped[i][j],numRecordsToSkip);
 						}
 					}
 				} else { // Logging is turned off
 
-					// Get the latest data for display purposes, since we're using the Ring Buffer
-					ISD_GetTrackingData( currentTrackerH, &data );
-					
-					while(data.Station[station-1].NewData == TRUE)
+					// Keep up with the ring buffers, so logging starts from now when turned on
+					for(j=0; j < ISD_MAX_STATIONS; j++)
 					{
-						ISD_GetTrackingData( currentTrackerH, &data );
+						if(validStation[trackerIdx][j])
+							logStationRing(&stationRings[currentTrackerH-1][j],trackerIdx,
+										   j+1,NULL,&Stations[station-1],StationsHwInfo,
+										   &numRecordsSkipped[currentTrackerH-1][j],numRecordsToSkip);
 					}
 				}
 
-				// Get the data one more time for display purposes, if logging
-				ISD_GetTrackingData( currentTrackerH, &data );
+				// The draining above queried the current station's latest data for display;
+				// a station without a ring buffer is read the usual way, and one drained by
+				// another thread is queried here
+#if defined UNIX
+				if( numTrackerWorkers > 0 && stationRings[currentTrackerH-1][station-1].buffer )
+				{
+					ISD_RingBufferQuery( currentTrackerH, station, &data.Station[station-1], &head, &tail );
+					shown = &data.Station[station-1];
+				}
+				else
+#endif
+				if( stationRings[currentTrackerH-1][station-1].buffer )
+				{
+					shown = &stationRings[currentTrackerH-1][station-1].current;
+				}
+				else
+				{
+					ISD_GetTrackingData( currentTrackerH, &data );
+					shown = &data.Station[station-1];
+				}
 			}
 
 			// Data display from current station
@@ -1378,30 +1691,54 @@ int main()
 				if( currentTrackerH > 0 )
 				{
 					showStationData( currentTrackerH, &TrackerInfo,
-									 &Stations[station-1], &data.Station[station-1],
+									 &Stations[station-1], shown,
 									 &StationsHwInfo[currentTrackerH-1][station-1],
-									 showTemp);
+#if defined UNIX
+									 showTemp, &pace,
+#else
+									 showTemp, NULL,
+#endif
+									 logType == 1 ? logStation :
+									 logType == 2 ? logStations :
+									 logType == 3 ? logAll : NULL);
 				}
 			}
 #ifdef _WIN32
 			Sleep( 2 );
 #elif defined UNIX
-			usleep(5e3);
+			// Poll again just after the current station's next record is due, rather than
+			// every 5 ms whatever the rate; see pace.h
+			if( currentTrackerH > 0 )
+			{
+				double stamp = pose_station_time( shown );
+
+				pace_set_rate( &pace, TrackerInfo.RecordsPerSec );
+				pace_update( &pace, !pace.locked || stamp > pace.last, stamp );
+				pace_account( &pace );
+				unlockTrackerLibrary();
+				pace_sleep( &pace );
+				lockTrackerLibrary();
+			}
+			else
+			{
+				unlockTrackerLibrary();
+				usleep(5e3);
+				lockTrackerLibrary();
+			}
 #endif
 		}
 
+#if defined UNIX
+		stopTrackerWorkers();
+		unlockTrackerLibrary();
+#endif
 		printf( "Closing ismain application\n" );
 		ISD_CloseTracker( currentTrackerH );
 
 		// Close any open files
-		if(fpStation)
-			fclose(fpStation);
-
-		if(fpStations)
-			fclose(fpStations);
-
-		if(fpAll)
-			fclose(fpAll);
+		closeLog(&logStation);
+		closeLog(&logStations);
+		closeLog(&logAll);
 		exit(0);
 	}
 }
@@ -0,0 +1,133 @@
+//==========================================================================================
+//
+//    File Name:      reccheck.c
+//    Description:    Checks that a flight recorder (see flightrec.h) reads back what was
+//                    written to it, after a clean close and after a crash
+//
+//    Comments:       Writes 2500 records into a 1000-slot recorder twice. The first
+//                    is closed, and should read back as the newest 1000 in order.
+//                    The second is left as a power cut would leave it: never closed,
+//                    one slot torn, and one slot as it was a lap before, its newer
+//                    contents never written back. That should read back as the
+//                    other 998 in order, with one bad slot and one stale one, and
+//                    opening the recorder again should keep it as scratch.rec.1.
+//
+//                        make reccheck && ./reccheck [scratch.rec]
+//
+//==========================================================================================
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "flightrec.h"
+
+#define CAPACITY		1000
+#define RECORDS			2500
+#define STALE_SLOT		100		// holds 1101 a lap before 2101
+#define TORN_SLOT		300		// 2301
+
+static void store( FlightRec *rec, uint32_t from, uint32_t to )
+{
+	AsyncLog log;
+	LogRecord r;
+	uint32_t i;
+
+	memset( &log, 0, sizeof(log) );
+	log.context = rec;
+	for( i = from; i <= to; i++ )
+	{
+		memset( &r, 0, sizeof(r) );
+		r.pose.tracker = 0;
+		r.pose.station = 1;
+		r.pose.time_s = i;
+		r.pose.time = i * 0.01f;
+		r.pose.euler[0] = (float) i;
+		flightRecStore( &log, &r );
+	}
+}
+
+// Reads path back; the records should number from first to last, in order, with
+// records of them there and bad and stale slots as given
+static int check( const char *what, const char *path, uint32_t first, uint32_t last,
+				  uint64_t records, uint64_t bad, uint64_t stale, Bool closed )
+{
+	FlightRecReader rd;
+	LogRecord r;
+	uint32_t previous = first - 1, wrong = 0;
+	int failed;
+
+	if( !flightRecRead( &rd, path ) )
+	{
+		printf( "%s: couldn't read %s (%s)\n", what, path, strerror(errno) );
+		return 1;
+	}
+	while( flightRecNext( &rd, &r ) )
+	{
+		if( r.pose.seq <= previous || r.pose.seq > last ||
+			r.pose.time_s != r.pose.seq || r.pose.euler[0] != (float) r.pose.seq )
+		{
+			if( wrong++ < 5 )
+				printf( "%s: record %u after %u\n", what, r.pose.seq, previous );
+		}
+		previous = r.pose.seq;
+	}
+
+	failed = wrong || rd.records != records || rd.bad != bad || rd.stale != stale ||
+			 (rd.header->closedSeq != 0) != closed;
+	printf( "%s: %llu records, %llu bad, %llu stale, %s: %s\n", what,
+			(unsigned long long) rd.records, (unsigned long long) rd.bad,
+			(unsigned long long) rd.stale, rd.header->closedSeq ? "closed" : "not closed",
+			failed ? "FAILED" : "ok" );
+	flightRecDone( &rd );
+	return failed;
+}
+
+int main( int argc, char **argv )
+{
+	const char *path = argc > 1 ? argv[1] : "reccheck.rec";
+	char kept[4096];
+	FlightRecSlot before;
+	FlightRec rec;
+	int failed;
+
+	if( !flightRecOpen( &rec, path, CAPACITY ) )
+	{
+		fprintf( stderr, "Couldn't create %s (%s)\n", path, strerror(errno) );
+		return 1;
+	}
+	store( &rec, 1, RECORDS );
+	flightRecClose( &rec );
+	failed = check( "closed", path, RECORDS - CAPACITY + 1, RECORDS, CAPACITY, 0, 0, TRUE );
+
+	if( !flightRecOpen( &rec, path, CAPACITY ) )
+		return 1;
+	failed |= rec.kept != 0;
+	store( &rec, 1, RECORDS - CAPACITY / 2 );
+	before = rec.slots[STALE_SLOT];
+	store( &rec, RECORDS - CAPACITY / 2 + 1, RECORDS );
+
+	// The crash: a page that never went back to disk, a slot half written, and no close
+	rec.slots[STALE_SLOT] = before;
+	rec.slots[TORN_SLOT].euler[1] = 1.0f;
+	munmap( rec.map, rec.size );
+	close( rec.fd );
+
+	failed |= check( "crashed", path, RECORDS - CAPACITY + 1, RECORDS, CAPACITY - 2, 1, 1, FALSE );
+
+	// Starting again mustn't wipe what the crash left
+	if( !flightRecOpen( &rec, path, CAPACITY ) )
+		return 1;
+	flightRecClose( &rec );
+	snprintf( kept, sizeof(kept), "%s.%d", path, rec.kept );
+	printf( "reopened: crashed recording kept as %s: %s\n", rec.kept ? kept : "nothing",
+			rec.kept == 1 ? "ok" : "FAILED" );
+	failed |= rec.kept != 1;
+	if( rec.kept )
+		failed |= check( "kept", kept, RECORDS - CAPACITY + 1, RECORDS, CAPACITY - 2, 1, 1, FALSE );
+	unlink( kept );
+	unlink( path );
+	return failed;
+}
@@ -0,0 +1,58 @@
+//==========================================================================================
+//
+//    File Name:      recdump.c
+//    Description:    Writes a flight recorder file (see flightrec.h) out as a station log
+//
+//    Comments:       Recovers the records oldest-first, the same after a crash or power
+//                    cut as after a clean close, and writes them to stdout as the data
+//                    lines of alldata.log under its column header, with what it found
+//                    on stderr.
+//
+//                        make recdump && ./recdump [alldata.rec] > alldata.csv
+//
+//==========================================================================================
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "flightrec.h"
+#include "logplan.h"
+
+int main( int argc, char **argv )
+{
+	static LogPlan plans[LOGPLAN_COUNT];
+	const char *path = argc > 1 ? argv[1] : "alldata.rec";
+	char line[ASYNCLOG_LINE_MAX];
+	double osTimeOffset = 0.0;
+	FlightRecReader rd;
+	LogRecord r;
+	time_t started;
+
+	if( !flightRecRead( &rd, path ) )
+	{
+		fprintf( stderr, "Couldn't read %s as a flight recorder (%s)\n", path, strerror(errno) );
+		return 1;
+	}
+
+	logPlanInit( plans );
+	fputs( LOGPLAN_HEADER, stdout );
+	while( flightRecNext( &rd, &r ) )
+	{
+		// The first record's OS time is zero, as logRow in main.c has it
+		if( osTimeOffset == 0.0 )
+			osTimeOffset = r.ext.os_time_s + r.ext.os_time_us * 1.0e-6 - r.pose.time;
+		fwrite( line, 1, logPlanFormat( &plans[logPlanIndex(&r)], &r, osTimeOffset, line ), stdout );
+	}
+
+	started = (time_t) rd.header->started;
+	fprintf( stderr, "%s: started %s", path, ctime( &started ) );
+	fprintf( stderr, "%llu records of %u slots, newest %llu, %llu bad, %llu stale, %s\n",
+		(unsigned long long) rd.records, rd.capacity, (unsigned long long) rd.newest,
+		(unsigned long long) rd.bad, (unsigned long long) rd.stale,
+		rd.header->closedSeq == 0 ? "not closed (recovered)" :
+		rd.header->closedSeq == rd.newest ? "closed cleanly" : "closed, but records are missing" );
+	flightRecDone( &rd );
+	return fflush( stdout ) == 0 ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+//==========================================================================================
+//
+//    File Name:      stationring.c
+//    Description:    Bulk reads of a station's ring buffer, see stationring.h
+//
+//==========================================================================================
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stationring.h"
+
+Bool stationRingOpen( StationRing *ring, ISD_TRACKER_HANDLE tracker, WORD station, DWORD size )
+{
+	if( ring->buffer && ring->size != size )
+	{
+		stationRingClose( ring );
+	}
+	if( !ring->buffer )
+	{
+		ring->buffer = (ISD_STATION_DATA_TYPE *) calloc( size, sizeof(ISD_STATION_DATA_TYPE) );
+		if( !ring->buffer )
+			return FALSE;
+	}
+	else
+	{
+		ISD_RingBufferStop( ring->tracker, ring->station );
+	}
+
+	ring->tracker = tracker;
+	ring->station = station;
+	ring->size = size;
+	ring->last = 0;
+	ring->lastSeconds = 0;
+	ring->lastMicroSec = 0;
+	ring->started = FALSE;
+	ring->overruns = 0;
+	memset( ring->buffer, 0, size * sizeof(ISD_STATION_DATA_TYPE) );
+	memset( &ring->current, 0, sizeof(ring->current) );
+
+	if( !ISD_RingBufferSetup( tracker, station, ring->buffer, size ) ||
+		!ISD_RingBufferStart( tracker, station ) )
+	{
+		stationRingClose( ring );
+		return FALSE;
+	}
+	return TRUE;
+}
+
+void stationRingClose( StationRing *ring )
+{
+	if( ring->buffer )
+	{
+		ISD_RingBufferStop( ring->tracker, ring->station );
+		free( ring->buffer );
+	}
+	memset( ring, 0, sizeof(*ring) );
+}
+
+// Samples from index a round to index b
+static DWORD ringDistance( const StationRing *ring, DWORD a, DWORD b )
+{
+	return (b + ring->size - a) % ring->size;
+}
+
+// A slot the library has never written to is still all zeros, from stationRingOpen
+static Bool written( const ISD_STATION_DATA_TYPE *s )
+{
+	static const ISD_STATION_DATA_TYPE zero;
+
+	return memcmp( s, &zero, sizeof(zero) ) != 0;
+}
+
+// Newer than the last sample handed on, by TimeStampSeconds and TimeStampMicroSec; never
+// where those are 0, as with time stamps off
+static Bool newer( const StationRing *ring, const ISD_STATION_DATA_TYPE *s )
+{
+	if( ring->lastSeconds == 0 && ring->lastMicroSec == 0 )
+		return FALSE;
+	return s->TimeStampSeconds > ring->lastSeconds ||
+		   (s->TimeStampSeconds == ring->lastSeconds && s->TimeStampMicroSec > ring->lastMicroSec);
+}
+
+int stationRingDrain( StationRing *ring, StationSpan spans[2] )
+{
+	DWORD head, tail, start, n;
+
+	if( !ring->buffer ||
+		!ISD_RingBufferQuery( ring->tracker, ring->station, &ring->current, &head, &tail ) ||
+		head >= ring->size || tail >= ring->size )
+	{
+		return 0;
+	}
+
+	if( !ring->started )
+	{
+		// Everything there; head == tail is one sample or none
+		if( !written( &ring->buffer[head] ) )
+			return 0;
+		start = tail;
+	}
+	else if( head == ring->last && !newer( ring, &ring->buffer[head] ) )
+	{
+		// head hasn't moved, and no time stamp says a whole lap came in since
+		return 0;
+	}
+	else
+	{
+		// Everything after the last we handed on, unless the library has written over
+		// where we left off (the oldest sample still there is past it, or newer than
+		// it): we fell a lap behind, so start from the oldest
+		start = (ring->last + 1) % ring->size;
+		if( head == ring->last ||
+			ringDistance( ring, tail, start ) > ringDistance( ring, tail, head ) ||
+			(tail != start && newer( ring, &ring->buffer[tail] )) )
+		{
+			ring->overruns++;
+			start = tail;
+		}
+	}
+	n = ringDistance( ring, start, head ) + 1;
+
+	ring->last = head;
+	ring->lastSeconds = ring->buffer[head].TimeStampSeconds;
+	ring->lastMicroSec = ring->buffer[head].TimeStampMicroSec;
+	ring->started = TRUE;
+
+	spans[0].data = &ring->buffer[start];
+	if( start + n <= ring->size )
+	{
+		spans[0].count = n;
+		return 1;
+	}
+	spans[0].count = ring->size - start;
+	spans[1].data = ring->buffer;
+	spans[1].count = n - spans[0].count;
+	return 2;
+}
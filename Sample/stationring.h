@@ -0,0 +1,62 @@
+//==========================================================================================
+//
+//    File Name:      stationring.h
+//    Description:    Bulk reads of a station's ring buffer
+//
+//    Comments:       ISD_GetTrackingData hands back one sample per call, and every
+//                    call copies a whole ISD_TRACKING_DATA_TYPE (all ISD_MAX_STATIONS
+//                    stations) to read one. A StationRing gives the library a buffer
+//                    of our own in ISD_RingBufferSetup and reads it in place: one
+//                    ISD_RingBufferQuery for the head and tail indices, and every
+//                    sample that came in since the last drain is handed on as at
+//                    most two spans (two when the new samples wrap around the end).
+//                    What is new is told by how far head has moved, not by the
+//                    samples' float TimeStamp, which is 0 with time stamps off and
+//                    too coarse to tell samples apart after about 18 hours.
+//
+//                        StationSpan spans[2];
+//                        int i, n = stationRingDrain( &ring, spans );
+//                        for( i = 0; i < n; i++ )
+//                            ...spans[i].count samples at spans[i].data
+//
+//                    The spans point into the ring, so use them before the library
+//                    gets round to overwriting them (size samples later).
+//
+//==========================================================================================
+
+#ifndef STATIONRING_H
+#define STATIONRING_H
+
+#include "isense.h"
+
+typedef struct
+{
+	ISD_STATION_DATA_TYPE	*data;
+	DWORD					count;
+} StationSpan;
+
+typedef struct
+{
+	ISD_TRACKER_HANDLE		tracker;
+	WORD					station;
+	ISD_STATION_DATA_TYPE	*buffer;	// ours, handed to ISD_RingBufferSetup
+	DWORD					size;		// samples in buffer
+	DWORD					last;		// index of the newest sample handed on
+	DWORD					lastSeconds;	// its TimeStampSeconds and TimeStampMicroSec
+	DWORD					lastMicroSec;
+	Bool					started;	// handed on anything yet
+	DWORD					overruns;	// drains that found samples written over before they got to them
+	ISD_STATION_DATA_TYPE	current;	// the newest sample, from the last query
+} StationRing;
+
+// Sets up and starts the library's ring buffer for a station in a buffer of size samples;
+// again on an open ring starts it over. FALSE if the library refused.
+Bool stationRingOpen( StationRing *ring, ISD_TRACKER_HANDLE tracker, WORD station, DWORD size );
+
+// Stops the library writing to the ring and frees it
+void stationRingClose( StationRing *ring );
+
+// Everything new since the last drain as up to two spans, oldest first; returns how many
+int stationRingDrain( StationRing *ring, StationSpan spans[2] );
+
+#endif
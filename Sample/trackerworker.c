@@ -0,0 +1,189 @@
+//==========================================================================================
+//
+//    File Name:      trackerworker.c
+//    Description:    A polling thread per tracker, see trackerworker.h
+//
+//==========================================================================================
+
+#include <stdio.h>
+#include <string.h>
+
+#include "trackerworker.h"
+
+#if defined(UNIX)
+
+#define WORKER_MASK		(WORKER_QUEUE - 1)
+
+static pthread_mutex_t libraryLock = PTHREAD_MUTEX_INITIALIZER;
+
+void lockTrackerLibrary( void )
+{
+	pthread_mutex_lock( &libraryLock );
+}
+
+void unlockTrackerLibrary( void )
+{
+	pthread_mutex_unlock( &libraryLock );
+}
+
+//==========================================================================================
+//
+//  Queues one station's samples for the merge stage; whatever doesn't fit is dropped
+//  rather than making the worker wait
+//
+//==========================================================================================
+static void queueSpan( TrackerWorker *w, WORD station, const StationSpan *span, double now )
+{
+	unsigned int head = atomic_load_explicit( &w->head, memory_order_relaxed );
+	unsigned int tail = atomic_load_explicit( &w->tail, memory_order_acquire );
+	DWORD k;
+
+	for( k = 0; k < span->count; k++ )
+	{
+		if( head - tail == WORKER_QUEUE )
+		{
+			atomic_fetch_add_explicit( &w->dropped, span->count - k, memory_order_relaxed );
+			break;
+		}
+		pose_from_station( &w->samples[head & WORKER_MASK], &w->extended[head & WORKER_MASK],
+						   w->trackerNum + 1, station, &span->data[k] );
+		w->queued[head & WORKER_MASK] = now;
+		head++;
+	}
+	atomic_store_explicit( &w->head, head, memory_order_release );
+}
+
+static void *workerThread( void *arg )
+{
+	TrackerWorker *w = (TrackerWorker *) arg;
+	ISD_TRACKER_INFO_TYPE info;
+	StationSpan spans[2];
+	WORD j;
+	int s, n;
+
+	while( atomic_load_explicit( &w->running, memory_order_relaxed ) )
+	{
+		int fresh = 0;
+		double newest = 0, now;
+
+		pace_sleep( &w->pace );
+		now = pace_now();
+
+		for( j = 0; j < ISD_MAX_STATIONS; j++ )
+		{
+			if( !w->valid[j] )
+				continue;
+
+			lockTrackerLibrary();
+			n = stationRingDrain( &w->rings[j], spans );
+			unlockTrackerLibrary();
+			for( s = 0; s < n; s++ )
+			{
+				queueSpan( w, j+1, &spans[s], now );
+				atomic_fetch_add_explicit( &w->received, spans[s].count, memory_order_relaxed );
+			}
+			if( n > 0 )
+			{
+				StationSpan *last = &spans[n-1];
+				double stamp = pose_station_time( &last->data[last->count-1] );
+
+				if( !fresh || stamp > newest )
+					newest = stamp;
+				fresh = 1;
+			}
+		}
+
+		lockTrackerLibrary();
+		if( ISD_GetCommInfo( w->tracker, &info ) )
+			pace_set_rate( &w->pace, info.RecordsPerSec );
+		unlockTrackerLibrary();
+		pace_update( &w->pace, fresh, newest );
+		pace_account( &w->pace );
+	}
+	return NULL;
+}
+
+Bool startTrackerWorker( TrackerWorker *w, ISD_TRACKER_HANDLE tracker, WORD trackerNum,
+						 StationRing *rings, const WORD *valid )
+{
+	memset( w, 0, sizeof(*w) );
+	w->tracker = tracker;
+	w->trackerNum = trackerNum;
+	w->rings = rings;
+	w->valid = valid;
+	pace_init( &w->pace, 0 );
+	atomic_store( &w->running, 1 );
+
+	if( pthread_create( &w->thread, NULL, workerThread, w ) != 0 )
+	{
+		atomic_store( &w->running, 0 );
+		return FALSE;
+	}
+	return TRUE;
+}
+
+void stopTrackerWorker( TrackerWorker *w )
+{
+	if( !atomic_exchange( &w->running, 0 ) )
+		return;
+	pthread_join( w->thread, NULL );
+}
+
+// When the sample reached the host
+static double osTime( const struct pose_extended *x )
+{
+	return x->os_time_s + x->os_time_us * 1.0e-6;
+}
+
+Bool mergeTrackerWorkers( TrackerWorker *w, int n, struct pose_sample *s, struct pose_extended *x )
+{
+	TrackerWorker *oldest = NULL;
+	unsigned int tail;
+	double latency;
+	int i;
+
+	for( i = 0; i < n; i++ )
+	{
+		tail = atomic_load_explicit( &w[i].tail, memory_order_relaxed );
+		if( tail == atomic_load_explicit( &w[i].head, memory_order_acquire ) )
+			continue;
+		if( !oldest || osTime( &w[i].extended[tail & WORKER_MASK] ) <
+					   osTime( &oldest->extended[oldest->tail & WORKER_MASK] ) )
+			oldest = &w[i];
+	}
+	if( !oldest )
+		return FALSE;
+
+	tail = atomic_load_explicit( &oldest->tail, memory_order_relaxed );
+	*s = oldest->samples[tail & WORKER_MASK];
+	*x = oldest->extended[tail & WORKER_MASK];
+	latency = pace_now() - oldest->queued[tail & WORKER_MASK];
+	atomic_store_explicit( &oldest->tail, tail + 1, memory_order_release );
+
+	oldest->merged++;
+	oldest->latencySum += latency;
+	if( latency > oldest->latencyMax )
+		oldest->latencyMax = latency;
+	return TRUE;
+}
+
+void printTrackerWorkers( const TrackerWorker *w, int n )
+{
+	unsigned long overruns;
+	int i, j;
+
+	for( i = 0; i < n; i++ )
+	{
+		overruns = 0;
+		for( j = 0; j < ISD_MAX_STATIONS; j++ )
+			overruns += w[i].rings[j].overruns;
+
+		printf( "Tracker %d: %lu samples, %lu dropped, %lu overruns, latency %.2f/%.2f ms, "
+				"polled %.2f ms late, %.1f%%CPU\n",
+				w[i].trackerNum + 1, (unsigned long) w[i].received, (unsigned long) w[i].dropped,
+				overruns, w[i].merged ? w[i].latencySum / w[i].merged * 1e3 : 0.0,
+				w[i].latencyMax * 1e3, w[i].pace.late_mean * 1e3, w[i].pace.cpu * 100 );
+	}
+}
+
+#endif
@@ -0,0 +1,86 @@
+//==========================================================================================
+//
+//    File Name:      trackerworker.h
+//    Description:    A polling thread per tracker, for logging all trackers at once
+//
+//    Comments:       Walking every tracker from one loop means one slow tracker (or
+//                    one with a lot of stations) makes all the others late. Instead
+//                    each tracker gets a TrackerWorker: a thread that sleeps until
+//                    the tracker's next record is due (see pace.h), drains its
+//                    stations' ring buffers and queues the samples, lock-free, for
+//                    the merge stage, which is whoever calls mergeTrackerWorkers.
+//
+//                    Each worker keeps its own counters: samples received, dropped
+//                    because the merge stage fell a whole queue behind, and how long
+//                    samples waited between being drained and being merged.
+//
+//                    Nothing says the InterSense library can be called from two
+//                    threads at once, so every call to it, the workers' and the main
+//                    loop's, is made holding lockTrackerLibrary's lock.
+//
+//==========================================================================================
+
+#ifndef TRACKERWORKER_H
+#define TRACKERWORKER_H
+
+#if defined(UNIX)
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "isense.h"
+#include "stationring.h"
+#include "../pose.h"
+#include "../pace.h"
+
+#define WORKER_QUEUE	512		// samples a tracker can get ahead of the merge stage, a power of two
+
+typedef struct
+{
+	// set by startTrackerWorker
+	ISD_TRACKER_HANDLE		tracker;
+	WORD					trackerNum;		// index into Trackers, 0-based as logData takes it
+	StationRing				*rings;			// the tracker's ISD_MAX_STATIONS ring buffers
+	const WORD				*valid;			// and which of them to drain
+	pthread_t				thread;
+	atomic_int				running;
+
+	// the worker's
+	struct pace				pace;
+	atomic_ulong			received;		// samples drained from the ring buffers
+	atomic_ulong			dropped;		// samples the merge stage had no room for
+
+	// queue from the worker to the merge stage, head and tail on their own lines
+	_Alignas(POSE_LINE) atomic_uint head;
+	_Alignas(POSE_LINE) atomic_uint tail;
+	struct pose_sample		samples[WORKER_QUEUE];
+	struct pose_extended	extended[WORKER_QUEUE];
+	double					queued[WORKER_QUEUE];	// pace_now() when drained
+
+	// the merge stage's
+	unsigned long			merged;
+	double					latencySum, latencyMax;	// drained to merged, seconds
+} TrackerWorker;
+
+// Starts a thread draining the valid stations of tracker; FALSE if it couldn't
+Bool startTrackerWorker( TrackerWorker *w, ISD_TRACKER_HANDLE tracker, WORD trackerNum,
+						 StationRing *rings, const WORD *valid );
+
+// Stops and joins it, without the library lock held; safe on one that isn't running
+void stopTrackerWorker( TrackerWorker *w );
+
+// Held around every call into the library while workers may be running
+void lockTrackerLibrary( void );
+void unlockTrackerLibrary( void );
+
+// Takes the sample at the heads of n workers' queues that reached the host first (by
+// OS time stamp; the trackers' own clocks are unrelated) into s and x; FALSE when they
+// are all empty
+Bool mergeTrackerWorkers( TrackerWorker *w, int n, struct pose_sample *s, struct pose_extended *x );
+
+// One line per worker: samples, drops, ring buffer overruns, latency and polling stats
+void printTrackerWorkers( const TrackerWorker *w, int n );
+
+#endif
+
+#endif
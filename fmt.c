@@ -0,0 +1,95 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fmt.h"
+
+static const char digits2[201] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+static const unsigned long long powers10[FMT_DECIMALS_MAX + 1] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000
+};
+
+/* exactly width digits of v, zero padded */
+static char *
+put_digits (char *p, unsigned long long v, int width)
+{
+        char *end = p + width;
+        char *q = end;
+
+        while (q - p >= 2) {
+                q -= 2;
+                memcpy (q, digits2 + (v % 100) * 2, 2);
+                v /= 100;
+        }
+        if (q > p)
+                *p = '0' + v % 10;
+        return end;
+}
+
+static int
+count_digits (unsigned long long v)
+{
+        int n = 1;
+        while (v >= 10) {
+                v /= 10;
+                n++;
+        }
+        return n;
+}
+
+char *
+fmt_uint (char *p, unsigned long long v)
+{
+        return put_digits (p, v, count_digits (v));
+}
+
+char *
+fmt_fixed (char *p, float v, int decimals)
+{
+        return fmt_fixed_d (p, v, decimals);
+}
+
+char *
+fmt_fixed_d (char *p, double v, int decimals)
+{
+        double a;
+        unsigned long long scaled, ipart;
+
+        if (decimals < 0)
+                decimals = 0;
+        else if (decimals > FMT_DECIMALS_MAX)
+                decimals = FMT_DECIMALS_MAX;
+
+        /* NaN fails the comparison too */
+        a = v < 0 ? -v : v;
+        if (!(a < 1e9))
+                return p + snprintf (p, FMT_FIXED_MAX + 1, "%.*e", decimals, v);
+
+        /* like printf, a negative value that rounds to zero still gets its sign */
+        scaled = (unsigned long long) (a * powers10[decimals] + 0.5);
+        if (signbit (v))
+                *p++ = '-';
+
+        ipart = scaled / powers10[decimals];
+        p = fmt_uint (p, ipart);
+        if (decimals > 0) {
+                *p++ = '.';
+                p = put_digits (p, scaled - ipart * powers10[decimals], decimals);
+        }
+        return p;
+}
+
+char *
+fmt_fixed_n (char *p, const float *v, int n, int decimals, char sep)
+{
+        int i;
+        for (i = 0; i < n; i++) {
+                p = fmt_fixed (p, v[i], decimals);
+                *p++ = sep;
+        }
+        return p;
+}
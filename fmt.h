@@ -0,0 +1,42 @@
+/*
+ * Fixed-precision float formatting with integer arithmetic, for output
+ * paths that need text at the sample rate (Max patches, CSV logs).
+ *
+ * No allocation, no locale, no stdio on the fast path: the value is scaled
+ * by 10^decimals, rounded half away from zero, and written two digits at
+ * a time. Negative values keep their sign even when they round to zero,
+ * as with printf ("-0.00"). Values of 1e9 and up, NaN and infinities
+ * fall back to snprintf in %e form, so nothing is ever cut short.
+ *
+ *      char line[64], *p = line;
+ *      p = fmt_fixed_n (p, euler, 3, 2, ',');      // "12.34,-5.67,89.00,"
+ *      p[-1] = '\r'; *p++ = '\n';
+ */
+
+#ifndef FMT_H
+#define FMT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FMT_DECIMALS_MAX 6
+#define FMT_FIXED_MAX   18              /* longest fmt_fixed output */
+
+/* writes v with decimals (0..FMT_DECIMALS_MAX) digits after the point at p, returns the end */
+char *fmt_fixed (char *p, float v, int decimals);
+
+/* the same for a double, e.g. a timestamp a float can't hold to the decimals asked for */
+char *fmt_fixed_d (char *p, double v, int decimals);
+
+/* n values, each followed by sep, returns the end */
+char *fmt_fixed_n (char *p, const float *v, int n, int decimals, char sep);
+
+/* writes an unsigned integer at p, returns the end */
+char *fmt_uint (char *p, unsigned long long v);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
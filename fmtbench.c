@@ -0,0 +1,85 @@
+/*
+ * Microbenchmark: the forwarder's ASCII sample line (Euler to 2 decimals,
+ * position to 3, comma separated, CRLF) built with fmt.c against the same
+ * line from snprintf. Also counts lines where the two disagree, which
+ * should only be ties that snprintf rounds to even.
+ *
+ *      make fmtbench && ./fmtbench [lines]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fmt.h"
+
+#define NSAMPLES 4096                   /* cycled through, small enough to stay in cache */
+
+static double
+now (void)
+{
+        struct timespec ts;
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t
+line_fmt (char *out, const float *euler, const float *pos)
+{
+        char *p = out;
+        p = fmt_fixed_n (p, euler, 3, 2, ',');
+        p = fmt_fixed_n (p, pos, 3, 3, ',');
+        p[-1] = '\r';
+        *p++ = '\n';
+        return p - out;
+}
+
+static size_t
+line_snprintf (char *out, const float *euler, const float *pos)
+{
+        return snprintf (out, 128, "%.2f,%.2f,%.2f,%.3f,%.3f,%.3f\r\n",
+                         euler[0], euler[1], euler[2], pos[0], pos[1], pos[2]);
+}
+
+int
+main (int argc, char **argv)
+{
+        static float euler[NSAMPLES][3], pos[NSAMPLES][3];
+        long lines = argc > 1 ? atol (argv[1]) : 2000000;
+        char a[128], b[128];
+        unsigned long sum = 0, mismatches = 0;
+        double t0, t_fmt, t_snprintf;
+        long i;
+        int k;
+
+        srand (1);
+        for (i = 0; i < NSAMPLES; i++)
+                for (k = 0; k < 3; k++) {
+                        euler[i][k] = rand () / (float) RAND_MAX * 360.0f - 180.0f;
+                        pos[i][k] = rand () / (float) RAND_MAX * 6.0f - 3.0f;
+                }
+
+        for (i = 0; i < NSAMPLES; i++) {
+                size_t n = line_fmt (a, euler[i], pos[i]);
+                if (n != line_snprintf (b, euler[i], pos[i]) || memcmp (a, b, n) != 0)
+                        mismatches++;
+        }
+
+        t0 = now ();
+        for (i = 0; i < lines; i++)
+                sum += line_fmt (a, euler[i % NSAMPLES], pos[i % NSAMPLES]);
+        t_fmt = now () - t0;
+
+        t0 = now ();
+        for (i = 0; i < lines; i++)
+                sum += line_snprintf (b, euler[i % NSAMPLES], pos[i % NSAMPLES]);
+        t_snprintf = now () - t0;
+
+        printf ("%ld lines (%lu bytes)\n", lines, sum);
+        printf ("fmt_fixed  %7.1f ns/line\n", t_fmt / lines * 1e9);
+        printf ("snprintf   %7.1f ns/line\n", t_snprintf / lines * 1e9);
+        printf ("speedup    %7.1fx, %lu of %d lines differ from snprintf\n",
+                t_snprintf / t_fmt, mismatches, NSAMPLES);
+        return 0;
+}
@@ -0,0 +1,658 @@
+#include <math.h>
+#include <string.h>
+
+#include "frame.h"
+
+#define EULER_SCALE     (32768.0f / 180.0f)
+#define QUAT_SCALE      32767.0f
+#define POSITION_SCALE  2000.0f
+#define ANGVEL_SCALE    1000.0f
+#define ACCEL_SCALE     500.0f
+#define SQRT1_2         0.70710678f     /* bound on all but the largest quaternion component */
+
+/* floats in each FRAME_WIRE field, in bit order */
+static const int field_channels[FRAME_FIELDS] = { 3, 4, 3, 3, 3 };
+
+static const struct {
+        const char *name;
+        unsigned bit;
+} field_names[] = {
+        { "euler", FRAME_EULER },
+        { "quat", FRAME_QUAT },
+        { "pos", FRAME_POSITION },
+        { "angvel", FRAME_ANGVEL },
+        { "accel", FRAME_ACCEL },
+        { "time", FRAME_TIME },
+};
+
+int
+frame_parse_fields (const char *s, unsigned *fields)
+{
+        unsigned got = 0;
+        size_t i, n;
+
+        while (*s) {
+                n = strcspn (s, ",");
+                for (i = 0; i < sizeof field_names / sizeof field_names[0]; i++)
+                        if (strlen (field_names[i].name) == n
+                            && strncmp (s, field_names[i].name, n) == 0)
+                                break;
+                if (i == sizeof field_names / sizeof field_names[0])
+                        return -1;
+                got |= field_names[i].bit;
+                s += n;
+                if (*s == ',')
+                        s++;
+        }
+        if (!got)
+                return -1;
+        *fields = got;
+        return 0;
+}
+
+/* CRC-16/CCITT-FALSE (poly 0x1021, init 0xffff), a nibble at a time */
+unsigned short
+frame_crc16 (const unsigned char *p, size_t len)
+{
+        static const unsigned short table[16] = {
+                0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+                0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+        };
+        unsigned short crc = 0xffff;
+
+        while (len--) {
+                crc = (crc << 4) ^ table[(crc >> 12) ^ (*p >> 4)];
+                crc = (crc << 4) ^ table[(crc >> 12) ^ (*p & 0x0f)];
+                p++;
+        }
+        return crc;
+}
+
+/* CRC-8 (poly 0x07), for the short delta frames */
+static unsigned char
+crc8 (const unsigned char *p, size_t len)
+{
+        unsigned crc = 0;
+        int i;
+
+        while (len--) {
+                crc ^= *p++;
+                for (i = 0; i < 8; i++)
+                        crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) & 0xff : (crc << 1) & 0xff;
+        }
+        return crc;
+}
+
+static unsigned char *
+put16 (unsigned char *p, unsigned v)
+{
+        p[0] = v & 0xff;
+        p[1] = (v >> 8) & 0xff;
+        return p + 2;
+}
+
+static unsigned
+get16 (const unsigned char *p)
+{
+        return p[0] | (p[1] << 8);
+}
+
+static unsigned char *
+put_f32 (unsigned char *p, float f)
+{
+        unsigned int v;
+        memcpy (&v, &f, 4);
+        p = put16 (p, v & 0xffff);
+        return put16 (p, v >> 16);
+}
+
+static float
+get_f32 (const unsigned char *p)
+{
+        unsigned int v = get16 (p) | (unsigned int) get16 (p + 2) << 16;
+        float f;
+        memcpy (&f, &v, 4);
+        return f;
+}
+
+/* LEB128: 7 bits a byte, low first, top bit set on all but the last */
+static unsigned char *
+put_var (unsigned char *p, unsigned long v)
+{
+        while (v >= 0x80) {
+                *p++ = (v & 0x7f) | 0x80;
+                v >>= 7;
+        }
+        *p++ = v;
+        return p;
+}
+
+/* NULL if it runs past end or is longer than 32 bits */
+static const unsigned char *
+get_var (const unsigned char *p, const unsigned char *end, unsigned long *v)
+{
+        int shift;
+
+        *v = 0;
+        for (shift = 0; shift < 35 && p < end; shift += 7) {
+                *v |= (unsigned long) (*p & 0x7f) << shift;
+                if (!(*p++ & 0x80))
+                        return p;
+        }
+        return NULL;
+}
+
+/* small magnitudes of either sign become small unsigned numbers */
+static unsigned long
+zigzag (long v)
+{
+        return v < 0 ? ((unsigned long) -(v + 1) << 1) | 1 : (unsigned long) v << 1;
+}
+
+static long
+unzigzag (unsigned long v)
+{
+        return (v & 1) ? -(long) (v >> 1) - 1 : (long) (v >> 1);
+}
+
+static float *
+field_values (struct frame_sample *s, int field)
+{
+        switch (field) {
+        case 0: return s->euler;
+        case 1: return s->quat;
+        case 2: return s->position;
+        case 3: return s->angvel;
+        default: return s->accel;
+        }
+}
+
+static unsigned char *
+put_fixed (unsigned char *p, const float *v, int n, float scale)
+{
+        int i;
+        for (i = 0; i < n; i++) {
+                float x = v[i] * scale;
+                if (x > 32767.0f)
+                        x = 32767.0f;
+                else if (x < -32767.0f)
+                        x = -32767.0f;
+                p = put16 (p, (unsigned short) (short) (x < 0 ? x - 0.5f : x + 0.5f));
+        }
+        return p;
+}
+
+static const unsigned char *
+get_fixed (const unsigned char *p, float *v, int n, float scale)
+{
+        int i;
+        for (i = 0; i < n; i++, p += 2)
+                v[i] = (short) get16 (p) / scale;
+        return p;
+}
+
+size_t
+frame_quat_size (int bits)
+{
+        return (3 + 2 + 3 * bits + 7) / 8;
+}
+
+double
+frame_quat_error (int bits)
+{
+        /* 2 sqrt(3) steps of sqrt(2) / (2^bits - 1) for the worst case in frame.h */
+        return 2.0 * 2.4494897 / ((1 << bits) - 1) * 57.295780;
+}
+
+static unsigned char *
+put_quat3 (unsigned char *p, const float *q, int bits)
+{
+        unsigned long long v;
+        unsigned max = (1u << bits) - 1;
+        int big = 0, shift = 5, i;
+        float sign;
+
+        for (i = 1; i < 4; i++)
+                if (q[i] * q[i] > q[big] * q[big])
+                        big = i;
+        sign = q[big] < 0 ? -1.0f : 1.0f;
+
+        v = (bits - FRAME_QUAT_BITS_MIN) | big << 3;
+        for (i = 0; i < 4; i++) {
+                float x;
+                if (i == big)
+                        continue;
+                x = (q[i] * sign + SQRT1_2) * (max / (2 * SQRT1_2)) + 0.5f;
+                if (x < 0)
+                        x = 0;
+                else if (x > max)
+                        x = max;
+                v |= (unsigned long long) x << shift;
+                shift += bits;
+        }
+        for (i = 0; i < shift; i += 8, v >>= 8)
+                *p++ = v & 0xff;
+        return p;
+}
+
+/* NULL if the width isn't one we send */
+static const unsigned char *
+get_quat3 (const unsigned char *p, float *q, int *bits)
+{
+        unsigned long long v = 0;
+        unsigned max;
+        int big, n, i;
+        float sum = 0;
+
+        *bits = (*p & 0x07) + FRAME_QUAT_BITS_MIN;
+        if (*bits > FRAME_QUAT_BITS_MAX)
+                return NULL;
+        n = frame_quat_size (*bits);
+        for (i = n - 1; i >= 0; i--)
+                v = v << 8 | p[i];
+        max = (1u << *bits) - 1;
+
+        big = (v >> 3) & 0x03;
+        v >>= 5;
+        for (i = 0; i < 4; i++) {
+                if (i == big)
+                        continue;
+                q[i] = (v & max) * (2 * SQRT1_2 / max) - SQRT1_2;
+                sum += q[i] * q[i];
+                v >>= *bits;
+        }
+        q[big] = sum < 1 ? sqrtf (1 - sum) : 0;
+        return p + n;
+}
+
+static size_t
+field_bytes (unsigned fields, int quat_bits)
+{
+        return ((fields & FRAME_EULER) ? 6 : 0)
+                + ((fields & FRAME_QUAT) ? (quat_bits ? frame_quat_size (quat_bits) : 8) : 0)
+                + ((fields & FRAME_POSITION) ? 6 : 0) + ((fields & FRAME_ANGVEL) ? 6 : 0)
+                + ((fields & FRAME_ACCEL) ? 6 : 0);
+}
+
+/* COBS: every 0 becomes the distance to the next one, so 0 only appears as the delimiter */
+static size_t
+cobs_encode (const unsigned char *in, size_t len, unsigned char *out)
+{
+        unsigned char *code = out, *p = out + 1;
+        size_t i;
+
+        for (i = 0; i < len; i++) {
+                if (in[i] == 0) {
+                        *code = p - code;
+                        code = p++;
+                } else {
+                        *p++ = in[i];
+                        if (p - code == 0xff) {
+                                *code = 0xff;
+                                code = p++;
+                        }
+                }
+        }
+        *code = p - code;
+        *p++ = 0;
+        return p - out;
+}
+
+static int
+cobs_decode (const unsigned char *in, size_t len, unsigned char *out, size_t *outlen)
+{
+        size_t i = 0, n = 0;
+
+        while (i < len) {
+                unsigned code = in[i++];
+                unsigned j;
+                if (code == 0 || i + code - 1 > len)
+                        return -1;
+                for (j = 1; j < code; j++)
+                        out[n++] = in[i++];
+                if (code != 0xff && i < len)
+                        out[n++] = 0;
+        }
+        *outlen = n;
+        return 0;
+}
+
+size_t
+frame_encode (const struct frame_sample *s, unsigned char *out)
+{
+        unsigned char raw[FRAME_RAW_MAX], *p = raw;
+        unsigned fields = s->fields & FRAME_WIRE;
+
+        *p++ = (s->quat_bits ? FRAME_PACKED : FRAME_VERSION) << 5 | fields;
+        *p++ = ((s->tracker - 1) & 0x1f) << 3 | ((s->station - 1) & 0x07);
+        *p++ = s->seq & 0xff;
+        p = put16 (p, s->time_ms);
+        if (fields & FRAME_EULER)
+                p = put_fixed (p, s->euler, 3, EULER_SCALE);
+        if ((fields & FRAME_QUAT) && s->quat_bits)
+                p = put_quat3 (p, s->quat, s->quat_bits);
+        else if (fields & FRAME_QUAT)
+                p = put_fixed (p, s->quat, 4, QUAT_SCALE);
+        if (fields & FRAME_POSITION)
+                p = put_fixed (p, s->position, 3, POSITION_SCALE);
+        if (fields & FRAME_ANGVEL)
+                p = put_fixed (p, s->angvel, 3, ANGVEL_SCALE);
+        if (fields & FRAME_ACCEL)
+                p = put_fixed (p, s->accel, 3, ACCEL_SCALE);
+        p = put16 (p, frame_crc16 (raw, p - raw));
+
+        return cobs_encode (raw, p - raw, out);
+}
+
+static int
+decode_plain (const unsigned char *raw, size_t n, struct frame_sample *s)
+{
+        const unsigned char *p = raw;
+        int packed = (raw[0] >> 5) == FRAME_PACKED;
+        size_t quat_at = 5 + ((raw[0] & FRAME_EULER) ? 6 : 0);
+        int quat_bits = 0;
+
+        /* the packed quaternion's size is in its first byte */
+        if (packed && (raw[0] & FRAME_QUAT)) {
+                if (n <= quat_at)
+                        return -1;
+                quat_bits = (raw[quat_at] & 0x07) + FRAME_QUAT_BITS_MIN;
+                if (quat_bits > FRAME_QUAT_BITS_MAX)
+                        return -1;
+        }
+        if (n < 7 || n != 5 + field_bytes (raw[0] & FRAME_WIRE, quat_bits) + 2)
+                return -1;
+        if (frame_crc16 (raw, n - 2) != get16 (raw + n - 2))
+                return -1;
+
+        memset (s, 0, sizeof *s);
+        s->fields = *p++ & FRAME_WIRE;
+        s->tracker = (*p >> 3) + 1;
+        s->station = (*p++ & 0x07) + 1;
+        s->seq = *p++;
+        s->time_ms = get16 (p);
+        p += 2;
+        if (s->fields & FRAME_EULER)
+                p = get_fixed (p, s->euler, 3, EULER_SCALE);
+        if ((s->fields & FRAME_QUAT) && packed)
+                p = get_quat3 (p, s->quat, &s->quat_bits);
+        else if (s->fields & FRAME_QUAT)
+                p = get_fixed (p, s->quat, 4, QUAT_SCALE);
+        if (s->fields & FRAME_POSITION)
+                p = get_fixed (p, s->position, 3, POSITION_SCALE);
+        if (s->fields & FRAME_ANGVEL)
+                p = get_fixed (p, s->angvel, 3, ANGVEL_SCALE);
+        if (s->fields & FRAME_ACCEL)
+                p = get_fixed (p, s->accel, 3, ACCEL_SCALE);
+        return 0;
+}
+
+int
+frame_decode (const unsigned char *packet, size_t len, struct frame_sample *s)
+{
+        unsigned char raw[FRAME_MAX];
+        size_t n;
+
+        if (len > FRAME_MAX || cobs_decode (packet, len, raw, &n) != 0 || n < 1)
+                return -1;
+        if ((raw[0] >> 5) != FRAME_VERSION && (raw[0] >> 5) != FRAME_PACKED)
+                return -1;
+        return decode_plain (raw, n, s);
+}
+
+/*
+ * Delta coding, see frame.h. Both ends keep the values in resolution
+ * steps, and the encoder sends the difference from what the receiver has
+ * rather than from the last raw sample, so quantisation error never
+ * accumulates.
+ */
+
+void
+frame_delta_default_res (float *res)
+{
+        res[0] = 0.01f;                 /* degrees */
+        res[1] = 0.0001f;
+        res[2] = 0.0001f;               /* meters */
+        res[3] = 0.001f;                /* rad/s */
+        res[4] = 0.002f;                /* m/s^2 */
+}
+
+void
+frame_delta_init (struct frame_delta_encoder *e, int slot, unsigned fields,
+                  const float *res, int key_every)
+{
+        memset (e, 0, sizeof *e);
+        e->slot = slot & (FRAME_SLOTS - 1);
+        e->fields = fields & FRAME_WIRE;
+        memcpy (e->res, res, sizeof e->res);
+        e->key_every = key_every > 0 ? key_every : 1;
+        e->since_key = -1;
+        e->seq = 0xf;                   /* so the first frame is 0 */
+}
+
+void
+frame_delta_resync (struct frame_delta_encoder *e)
+{
+        e->since_key = -1;
+}
+
+static long
+quantise (float v, float res)
+{
+        double x = v / res;
+        if (!(x > -1e9 && x < 1e9))     /* and NaN */
+                x = x > 0 ? 1e9 : x < 0 ? -1e9 : 0;
+        return (long) (x < 0 ? x - 0.5 : x + 0.5);
+}
+
+size_t
+frame_delta_encode (struct frame_delta_encoder *e, const struct frame_sample *s,
+                    unsigned char *out)
+{
+        unsigned char raw[FRAME_RAW_MAX], *p = raw;
+        long q[FRAME_CHANNELS];
+        int i, j, n = 0;
+
+        for (i = 0; i < FRAME_FIELDS; i++) {
+                const float *v;
+                if (!(e->fields & (1u << i)))
+                        continue;
+                v = field_values ((struct frame_sample *) s, i);
+                for (j = 0; j < field_channels[i]; j++)
+                        q[n++] = quantise (v[j], e->res[i]);
+        }
+
+        e->seq = (e->seq + 1) & 0xf;
+        if (e->since_key < 0 || e->since_key + 1 >= e->key_every) {
+                *p++ = FRAME_KEYFRAME << 5 | e->fields;
+                *p++ = ((s->tracker - 1) & 0x1f) << 3 | ((s->station - 1) & 0x07);
+                *p++ = e->slot << 4 | e->seq;
+                p = put16 (p, s->time_ms);
+                for (i = 0; i < FRAME_FIELDS; i++)
+                        if (e->fields & (1u << i))
+                                p = put_f32 (p, e->res[i]);
+                for (i = 0; i < n; i++)
+                        p = put_var (p, zigzag (q[i]));
+                p = put16 (p, frame_crc16 (raw, p - raw));
+                e->since_key = 0;
+        } else {
+                *p++ = 0x80 | e->slot << 4 | e->seq;
+                p = put_var (p, (s->time_ms - e->time_ms) & 0xffff);
+                for (i = 0; i < n; i++)
+                        p = put_var (p, zigzag (q[i] - e->q[i]));
+                *p = crc8 (raw, p - raw);
+                p++;
+                e->since_key++;
+        }
+
+        memcpy (e->q, q, n * sizeof q[0]);
+        e->time_ms = s->time_ms;
+        return cobs_encode (raw, p - raw, out);
+}
+
+static void
+slot_sample (const struct frame_slot *sl, struct frame_sample *s)
+{
+        int i, j, n = 0;
+
+        memset (s, 0, sizeof *s);
+        s->tracker = sl->tracker;
+        s->station = sl->station;
+        s->seq = sl->seq;
+        s->time_ms = sl->time_ms;
+        s->fields = sl->fields;
+        for (i = 0; i < FRAME_FIELDS; i++) {
+                float *v;
+                if (!(sl->fields & (1u << i)))
+                        continue;
+                v = field_values (s, i);
+                for (j = 0; j < field_channels[i]; j++, n++)
+                        v[j] = sl->q[n] * sl->res[i];
+        }
+}
+
+static int
+channel_count (unsigned fields)
+{
+        int i, n = 0;
+        for (i = 0; i < FRAME_FIELDS; i++)
+                if (fields & (1u << i))
+                        n += field_channels[i];
+        return n;
+}
+
+static int
+decode_keyframe (struct frame_decoder *d, const unsigned char *raw, size_t n,
+                 struct frame_sample *s)
+{
+        const unsigned char *p = raw + 5, *end = raw + n - 2;
+        struct frame_slot t;
+        unsigned long v;
+        int i, nq;
+
+        if (n < 7 || frame_crc16 (raw, n - 2) != get16 (raw + n - 2))
+                return -1;
+
+        memset (&t, 0, sizeof t);
+        t.fields = raw[0] & FRAME_WIRE;
+        t.tracker = (raw[1] >> 3) + 1;
+        t.station = (raw[1] & 0x07) + 1;
+        t.seq = raw[2] & 0xf;
+        t.time_ms = get16 (raw + 3);
+        for (i = 0; i < FRAME_FIELDS; i++) {
+                if (!(t.fields & (1u << i)))
+                        continue;
+                if (p + 4 > end)
+                        return -1;
+                t.res[i] = get_f32 (p);
+                p += 4;
+        }
+        nq = channel_count (t.fields);
+        for (i = 0; i < nq; i++) {
+                if (!(p = get_var (p, end, &v)))
+                        return -1;
+                t.q[i] = unzigzag (v);
+        }
+        if (p != end)
+                return -1;
+
+        t.valid = 1;
+        d->slots[(raw[2] >> 4) & (FRAME_SLOTS - 1)] = t;
+        slot_sample (&t, s);
+        return 0;
+}
+
+/* 0 decoded, -1 bad, 1 good but the slot is waiting for a keyframe */
+static int
+decode_delta (struct frame_decoder *d, const unsigned char *raw, size_t n,
+              struct frame_sample *s)
+{
+        struct frame_slot *sl = &d->slots[(raw[0] >> 4) & (FRAME_SLOTS - 1)];
+        const unsigned char *p = raw + 1, *end = raw + n - 1;
+        unsigned seq = raw[0] & 0xf;
+        long q[FRAME_CHANNELS];
+        unsigned long dt, v;
+        int i, nq;
+
+        if (n < 3 || crc8 (raw, n - 1) != raw[n - 1])
+                return -1;
+        if (!sl->valid || seq != ((sl->seq + 1) & 0xf)) {
+                sl->valid = 0;
+                return 1;
+        }
+
+        nq = channel_count (sl->fields);
+        if (!(p = get_var (p, end, &dt)))
+                goto bad;
+        for (i = 0; i < nq; i++) {
+                if (!(p = get_var (p, end, &v)))
+                        goto bad;
+                q[i] = sl->q[i] + unzigzag (v);
+        }
+        if (p != end)
+                goto bad;
+
+        memcpy (sl->q, q, nq * sizeof q[0]);
+        sl->seq = seq;
+        sl->time_ms = (sl->time_ms + dt) & 0xffff;
+        slot_sample (sl, s);
+        return 0;
+
+bad:
+        sl->valid = 0;
+        return -1;
+}
+
+/* any kind of frame, see frame_decode_byte */
+static int
+decode_packet (struct frame_decoder *d, const unsigned char *packet, size_t len,
+               struct frame_sample *s)
+{
+        unsigned char raw[FRAME_MAX];
+        size_t n;
+
+        if (len > FRAME_MAX || cobs_decode (packet, len, raw, &n) != 0 || n < 1)
+                return -1;
+        if (raw[0] & 0x80)
+                return decode_delta (d, raw, n, s);
+        if ((raw[0] >> 5) == FRAME_KEYFRAME)
+                return decode_keyframe (d, raw, n, s);
+        if ((raw[0] >> 5) == FRAME_VERSION || (raw[0] >> 5) == FRAME_PACKED)
+                return decode_plain (raw, n, s);
+        return -1;
+}
+
+void
+frame_decoder_init (struct frame_decoder *d)
+{
+        memset (d, 0, sizeof *d);
+}
+
+int
+frame_decode_byte (struct frame_decoder *d, unsigned char c, struct frame_sample *s)
+{
+        int r;
+
+        if (c != 0) {
+                if (d->len == sizeof d->buf)
+                        d->overflow = 1;
+                else
+                        d->buf[d->len++] = c;
+                return 0;
+        }
+
+        /* back to back delimiters are just idle line */
+        if (d->len == 0 && !d->overflow)
+                return 0;
+
+        r = d->overflow ? -1 : decode_packet (d, d->buf, d->len, s);
+        d->len = 0;
+        d->overflow = 0;
+        if (r == 0)
+                d->frames++;
+        else if (r > 0)
+                d->stale++;
+        else
+                d->errors++;
+        return r == 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * Compact binary sample frames for the serial output, with a matching
+ * decoder for whatever sits on the other end (C or C++).
+ *
+ * A frame, before framing, is little endian:
+ *
+ *      u8   version << 5 | field mask
+ *      u8   station id: (tracker - 1) << 3 | (station - 1)
+ *      u8   sequence number, per stream, wraps
+ *      u16  tracker timestamp in ms, wraps every 65.5 s
+ *      s16  fields in mask order, each a fixed-point value:
+ *           Euler       3 x 180/32768 degrees (yaw, pitch, roll)
+ *           Quaternion  4 x 1/32767 (w, x, y, z)
+ *           Position    3 x 0.5 mm
+ *           AngVel      3 x 1/1000 rad/s (AngularVelNavFrame)
+ *           Accel       3 x 1/500 m/s^2 (AccelNavFrame)
+ *      u16  CRC-16/CCITT-FALSE of everything above
+ *
+ * which is then COBS encoded and terminated with a 0 byte, so a receiver
+ * can join a stream anywhere and resynchronises at the next 0. Euler plus
+ * position comes to 21 bytes on the wire: 180 Hz of 6-DOF fits in 38400
+ * baud 8N1, where the ASCII output managed a single angle at ~60 Hz.
+ *
+ * A frame with version 0 (FRAME_PACKED) is the same except that its
+ * quaternion is packed smallest-three: the largest component is dropped
+ * (and made positive, q and -q being the same rotation) and the other
+ * three, which lie within +-1/sqrt(2), go as bits-wide unsigned steps:
+ *
+ *      3 bits   bits - 10
+ *      2 bits   index of the dropped component
+ *      3 x bits the others in w, x, y, z order
+ *
+ * LSB first, padded to a byte. The worst case is a quaternion near
+ * (1/2, 1/2, 1/2, 1/2) with every error the same sign:
+ *
+ *      bits    10     11     12     13     14     15     16    (s16 x 4)
+ *      bytes   5      5      6      6      6      7      7      8
+ *      deg     0.274  0.137  0.069  0.034  0.017  0.0086 0.0043 0.0035
+ *
+ * For several stations on one slow link there is also a delta coding.
+ * Values are quantised to a resolution per field (0.01 deg for Euler by
+ * default) and sent as periodic keyframes plus changes since the previous
+ * frame of the same station:
+ *
+ *   keyframe   u8   3 << 5 | field mask
+ *              u8   station id
+ *              u8   slot << 4 | sequence number (4 bits)
+ *              u16  tracker timestamp in ms
+ *              f32  resolution of each field present
+ *              var  each value in resolution steps
+ *              u16  CRC-16/CCITT-FALSE
+ *
+ *   delta      u8   1 << 7 | slot << 4 | sequence number
+ *              var  ms since the slot's previous frame
+ *              var  each value's change in resolution steps
+ *              u8   CRC-8 (poly 0x07)
+ *
+ * where var is a zigzag LEB128 varint. The slot (0..7) names a station on
+ * the link and is bound to its station id by the keyframes. A delta only
+ * applies on top of the frame right before it in its slot's sequence;
+ * after a gap or a bad frame the slot waits for its next keyframe. An
+ * orientation-only delta at head-tracking speeds is 8 bytes on the wire,
+ * so two IC4s at 180 Hz take about 76% of 38400 baud.
+ *
+ * One decoder takes every kind of frame:
+ *
+ *      struct frame_decoder d;
+ *      struct frame_sample s;
+ *      frame_decoder_init (&d);
+ *      while (read (fd, &c, 1) == 1)
+ *              if (frame_decode_byte (&d, c, &s))
+ *                      ...use s
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRAME_VERSION   2               /* 1 had a 4 bit mask and no Accel */
+#define FRAME_PACKED    0               /* version field of a frame with a smallest-three quaternion */
+#define FRAME_KEYFRAME  3               /* version field of a delta keyframe */
+#define FRAME_FIELDS    5               /* bits in FRAME_WIRE */
+#define FRAME_CHANNELS  16              /* floats in all of them */
+#define FRAME_SLOTS     8               /* delta-coded stations per link */
+
+enum {
+        FRAME_EULER     = 1 << 0,
+        FRAME_QUAT      = 1 << 1,
+        FRAME_POSITION  = 1 << 2,
+        FRAME_ANGVEL    = 1 << 3,
+        FRAME_ACCEL     = 1 << 4,
+        FRAME_WIRE      = 0x1f,                         /* what a frame can carry */
+        FRAME_TIME      = 1 << 5,                       /* text output only, frames always have it */
+        FRAME_ALL       = 0x3f
+};
+
+#define FRAME_RAW_MAX   (5 + 4 * FRAME_FIELDS + 5 * FRAME_CHANNELS + 2)  /* keyframe, every field */
+#define FRAME_MAX       (FRAME_RAW_MAX + 2)             /* + COBS overhead and delimiter */
+
+#define FRAME_QUAT_BITS_MIN 10
+#define FRAME_QUAT_BITS_MAX 16
+
+struct frame_sample {
+        int     tracker;                /* 1..32 */
+        int     station;                /* 1..8 */
+        unsigned seq;                   /* 0..255 */
+        unsigned time_ms;               /* 0..65535 */
+        unsigned fields;                /* FRAME_* present */
+        int     quat_bits;              /* 0: four s16, or 10..16: smallest three per component */
+        float   euler[3];
+        float   quat[4];
+        float   position[3];
+        float   angvel[3];
+        float   accel[3];
+};
+
+/* what a receiver knows about one delta-coded station */
+struct frame_slot {
+        int     valid;                  /* 0 until a keyframe, and again after a gap */
+        int     tracker, station;
+        unsigned fields, seq, time_ms;
+        float   res[FRAME_FIELDS];
+        long    q[FRAME_CHANNELS];      /* values in resolution steps */
+};
+
+struct frame_decoder {
+        unsigned char buf[FRAME_MAX];
+        size_t  len;
+        int     overflow;               /* dropping bytes until the next delimiter */
+        unsigned long frames;           /* decoded */
+        unsigned long errors;           /* bad COBS, length, version or CRC */
+        unsigned long stale;            /* good deltas dropped while waiting for a keyframe */
+        struct frame_slot slots[FRAME_SLOTS];
+};
+
+/* the sending side of one delta-coded station */
+struct frame_delta_encoder {
+        int     slot;
+        unsigned fields;                /* FRAME_WIRE bits */
+        float   res[FRAME_FIELDS];
+        int     key_every;              /* frames from one keyframe to the next */
+        int     since_key;              /* -1: the next frame is a keyframe */
+        unsigned seq, time_ms;
+        long    q[FRAME_CHANNELS];      /* what the receiver has */
+};
+
+/* parses a comma separated list of euler, quat, pos, angvel, accel, time; -1 if unknown */
+int frame_parse_fields (const char *s, unsigned *fields);
+
+/* encodes s's fields into out (at least FRAME_MAX bytes), returns the length */
+size_t frame_encode (const struct frame_sample *s, unsigned char *out);
+
+/* bytes a smallest-three quaternion takes at bits (FRAME_QUAT_BITS_MIN..MAX) per component */
+size_t frame_quat_size (int bits);
+
+/* worst-case rotation error of that, in degrees */
+double frame_quat_error (int bits);
+
+void frame_decoder_init (struct frame_decoder *d);
+
+/* feeds one byte from the stream, returns 1 when it completed a good frame */
+int frame_decode_byte (struct frame_decoder *d, unsigned char c, struct frame_sample *s);
+
+/* decodes one plain or packed frame (COBS, without its delimiter), returns 0 or -1 if it's bad */
+int frame_decode (const unsigned char *packet, size_t len, struct frame_sample *s);
+
+/* Euler 0.01 deg, quaternion 1e-4, position 0.1 mm, 1 mrad/s, 2 mm/s^2 */
+void frame_delta_default_res (float *res);
+
+/* fields are FRAME_* bits, res one resolution per FRAME_WIRE field */
+void frame_delta_init (struct frame_delta_encoder *e, int slot, unsigned fields,
+                       const float *res, int key_every);
+
+/* makes the next frame a keyframe, e.g. after the queue dropped one */
+void frame_delta_resync (struct frame_delta_encoder *e);
+
+/* encodes s as a keyframe or delta into out (FRAME_MAX bytes), returns the length */
+size_t frame_delta_encode (struct frame_delta_encoder *e, const struct frame_sample *s,
+                           unsigned char *out);
+
+unsigned short frame_crc16 (const unsigned char *p, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,632 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE                     /* fopencookie */
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "iob.h"
+
+enum { BLOCK_FREE, BLOCK_FILLING, BLOCK_PENDING, BLOCK_INFLIGHT };
+
+#define RES_NONE        INT_MIN         /* no completion seen for the block yet */
+
+struct iob_ring {
+        int     error;                  /* for good: no block is written or reused after */
+        int     *state;                 /* per block, BLOCK_* */
+        off_t   *off;                   /* file offset each block goes to */
+        int     *res;                   /* completion result */
+        int     *pending;               /* full blocks not yet submitted, in order */
+        int     npending;
+        int     *inflight;              /* submitted chain, in order */
+        int     ninflight;
+        int     ndone;
+#if defined(__linux__)
+        int     fd;                     /* -1 for the plain backend */
+        int     fixed;                  /* blocks are registered buffers */
+        void    *sq_ptr, *cq_ptr;
+        size_t  sq_len, cq_len, sqes_len;
+        unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+        unsigned *cq_head, *cq_tail, *cq_mask;
+        struct io_uring_sqe *sqes;
+        struct io_uring_cqe *cqes;
+#endif
+};
+
+int
+iob_parse_backend (const char *name, enum iob_backend *backend)
+{
+        if (strcmp (name, "plain") == 0)
+                *backend = IOB_PLAIN;
+        else if (strcmp (name, "uring") == 0)
+                *backend = IOB_URING;
+        else
+                return -1;
+        return 0;
+}
+
+const char *
+iob_backend_name (enum iob_backend backend)
+{
+        return backend == IOB_URING ? "uring" : "plain";
+}
+
+/* keeps what a nonblock fd wouldn't take, in order */
+static int
+park (struct iob *b, const unsigned char *p, size_t len)
+{
+        if (b->carry_len + len > b->carry_cap) {
+                size_t cap = (b->carry_len + len) * 2;
+                unsigned char *c = (unsigned char *) realloc (b->carry, cap);
+                if (!c)
+                        return -1;
+                b->carry = c;
+                b->carry_cap = cap;
+        }
+        memcpy (b->carry + b->carry_len, p, len);
+        b->carry_len += len;
+        return 0;
+}
+
+/* writes all of p, waiting out EAGAIN on non-blocking fds unless b->nonblock */
+static int
+write_all (struct iob *b, const unsigned char *p, size_t len, off_t off)
+{
+        if (b->carry_len > 0)
+                return park (b, p, len);
+
+        while (len > 0) {
+                ssize_t n = off < 0 ? write (b->fd, p, len) : pwrite (b->fd, p, len, off);
+                b->syscalls++;
+                b->writes++;
+                if (n > 0) {
+                        p += n;
+                        len -= n;
+                        if (off >= 0)
+                                off += n;
+                } else if (n < 0 && errno == EAGAIN && b->nonblock && off < 0) {
+                        return park (b, p, len);
+                } else if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+                        struct pollfd pfd;
+                        pfd.fd = b->fd;
+                        pfd.events = POLLOUT;
+                        poll (&pfd, 1, 100);
+                        b->syscalls++;
+                } else {
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+#if defined(__linux__)
+
+static int
+ring_setup (struct iob *b, unsigned entries)
+{
+        struct iob_ring *r = b->ring;
+        struct io_uring_params p;
+        int i;
+
+        memset (&p, 0, sizeof p);
+        r->fd = syscall (__NR_io_uring_setup, entries, &p);
+        if (r->fd < 0)
+                return -1;
+
+        r->sq_len = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+        r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+        r->sqes_len = p.sq_entries * sizeof (struct io_uring_sqe);
+
+        r->sq_ptr = mmap (0, r->sq_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+        r->cq_ptr = mmap (0, r->cq_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        r->sqes = (struct io_uring_sqe *) mmap (0, r->sqes_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+        if (r->sq_ptr == MAP_FAILED || r->cq_ptr == MAP_FAILED
+            || (void *) r->sqes == MAP_FAILED) {
+                close (r->fd);
+                r->fd = -1;
+                return -1;
+        }
+
+        r->sq_head = (unsigned *) ((char *) r->sq_ptr + p.sq_off.head);
+        r->sq_tail = (unsigned *) ((char *) r->sq_ptr + p.sq_off.tail);
+        r->sq_mask = (unsigned *) ((char *) r->sq_ptr + p.sq_off.ring_mask);
+        r->sq_array = (unsigned *) ((char *) r->sq_ptr + p.sq_off.array);
+        r->cq_head = (unsigned *) ((char *) r->cq_ptr + p.cq_off.head);
+        r->cq_tail = (unsigned *) ((char *) r->cq_ptr + p.cq_off.tail);
+        r->cq_mask = (unsigned *) ((char *) r->cq_ptr + p.cq_off.ring_mask);
+        r->cqes = (struct io_uring_cqe *) ((char *) r->cq_ptr + p.cq_off.cqes);
+
+        /* registered buffers save the kernel pinning and mapping the pages
+         * on every write; RLIMIT_MEMLOCK may refuse, plain WRITE still works */
+        struct iovec *iov = (struct iovec *) calloc (b->nblocks, sizeof *iov);
+        if (iov) {
+                for (i = 0; i < b->nblocks; i++) {
+                        iov[i].iov_base = b->blocks + (size_t) i * b->block_size;
+                        iov[i].iov_len = b->block_size;
+                }
+                r->fixed = syscall (__NR_io_uring_register, r->fd,
+                                    IORING_REGISTER_BUFFERS, iov, b->nblocks) == 0;
+                free (iov);
+        }
+        return 0;
+}
+
+static void
+ring_teardown (struct iob_ring *r)
+{
+        if (r->fd < 0)
+                return;
+        munmap (r->sqes, r->sqes_len);
+        munmap (r->cq_ptr, r->cq_len);
+        munmap (r->sq_ptr, r->sq_len);
+        close (r->fd);
+        r->fd = -1;
+}
+
+/*
+ * gives up on the ring once io_uring_enter() itself fails. SQEs the kernel
+ * never took go with it, and blocks it took but never completed stay
+ * BLOCK_INFLIGHT, so nothing it might still be reading is refilled
+ */
+static void
+ring_fail (struct iob *b)
+{
+        b->ring->error = 1;
+        ring_teardown (b->ring);
+}
+
+/* submits the pending blocks as one linked chain */
+static void
+ring_submit (struct iob *b)
+{
+        struct iob_ring *r = b->ring;
+        unsigned tail = *r->sq_tail;
+        int i;
+
+        for (i = 0; i < r->npending; i++) {
+                int blk = r->pending[i];
+                unsigned idx = tail & *r->sq_mask;
+                struct io_uring_sqe *sqe = &r->sqes[idx];
+
+                memset (sqe, 0, sizeof *sqe);
+                sqe->opcode = r->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+                sqe->fd = b->fd;
+                sqe->addr = (unsigned long) (b->blocks + (size_t) blk * b->block_size);
+                sqe->len = b->fill[blk];
+                sqe->off = r->off[blk] < 0 ? (__u64) -1 : (__u64) r->off[blk];
+                sqe->buf_index = blk;
+                sqe->user_data = blk;
+                /* the link keeps blocks in order on ttys and pipes */
+                if (i + 1 < r->npending)
+                        sqe->flags = IOSQE_IO_LINK;
+                r->sq_array[idx] = idx;
+                tail++;
+
+                r->state[blk] = BLOCK_INFLIGHT;
+                r->res[blk] = RES_NONE;
+                r->inflight[r->ninflight++] = blk;
+        }
+        __atomic_store_n (r->sq_tail, tail, __ATOMIC_RELEASE);
+
+        int n = r->npending;
+        r->npending = 0;
+        while (n > 0) {
+                int done = syscall (__NR_io_uring_enter, r->fd, n, 0, 0, NULL, 0);
+                b->syscalls++;
+                b->writes++;
+                if (done < 0 && errno == EINTR)
+                        continue;
+                if (done < 0) {
+                        ring_fail (b);
+                        break;
+                }
+                n -= done;
+        }
+}
+
+/*
+ * waits for the in-flight chain; anything short or cancelled is finished
+ * with write(), unless the stream has already failed
+ */
+static void
+ring_wait (struct iob *b)
+{
+        struct iob_ring *r = b->ring;
+        int i;
+
+        while (r->ndone < r->ninflight && !r->error) {
+                unsigned head = *r->cq_head;
+                unsigned tail = __atomic_load_n (r->cq_tail, __ATOMIC_ACQUIRE);
+                if (head == tail) {
+                        if (syscall (__NR_io_uring_enter, r->fd, 0, 1,
+                                     IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+                                ring_fail (b);
+                                break;
+                        }
+                        b->syscalls++;
+                        continue;
+                }
+                for (; head != tail; head++) {
+                        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+                        r->res[cqe->user_data] = cqe->res;
+                        r->ndone++;
+                }
+                __atomic_store_n (r->cq_head, head, __ATOMIC_RELEASE);
+        }
+
+        for (i = 0; i < r->ninflight; i++) {
+                int blk = r->inflight[i];
+                int res = r->res[blk];
+                size_t len = b->fill[blk];
+                size_t done = res > 0 ? (size_t) res : 0;
+
+                if (res == RES_NONE)
+                        continue;
+                if (res < 0 && res != -EAGAIN && res != -ECANCELED && res != -EINTR)
+                        r->error = 1;
+                else if (!r->error && done < len
+                         && write_all (b, b->blocks + (size_t) blk * b->block_size + done,
+                                       len - done, r->off[blk] < 0 ? -1 : r->off[blk] + (off_t) done) != 0)
+                        r->error = 1;
+                b->fill[blk] = 0;
+                r->state[blk] = BLOCK_FREE;
+        }
+        r->ninflight = 0;
+        r->ndone = 0;
+}
+
+#endif /* __linux__ */
+
+static int
+use_ring (const struct iob *b)
+{
+#if defined(__linux__)
+        return b->ring->fd >= 0;
+#else
+        (void) b;
+        return 0;
+#endif
+}
+
+/* hands a full block to the backend */
+static void
+queue_block (struct iob *b, int blk)
+{
+        struct iob_ring *r = b->ring;
+
+        r->off[blk] = b->offset;
+        if (b->offset >= 0)
+                b->offset += b->fill[blk];
+        b->bytes += b->fill[blk];
+
+        if (!use_ring (b)) {
+                if (write_all (b, b->blocks + (size_t) blk * b->block_size,
+                               b->fill[blk], r->off[blk]) != 0)
+                        r->error = 1;
+                b->fill[blk] = 0;
+                r->state[blk] = BLOCK_FREE;
+                return;
+        }
+
+#if defined(__linux__)
+        r->state[blk] = BLOCK_PENDING;
+        r->pending[r->npending++] = blk;
+        if (r->npending >= b->batch) {
+                /* one chain in flight at a time so streams stay ordered */
+                ring_wait (b);
+                if (!r->error)
+                        ring_submit (b);
+        }
+#endif
+}
+
+/* picks the next block to fill, waiting for the ring if they're all busy */
+static void
+next_block (struct iob *b)
+{
+        struct iob_ring *r = b->ring;
+        int i;
+
+        for (;;) {
+                if (r->error)
+                        return;
+                for (i = 0; i < b->nblocks; i++) {
+                        if (r->state[i] == BLOCK_FREE) {
+                                r->state[i] = BLOCK_FILLING;
+                                b->cur = i;
+                                return;
+                        }
+                }
+#if defined(__linux__)
+                ring_wait (b);
+                if (r->npending > 0 && !r->error)
+                        ring_submit (b);
+#endif
+        }
+}
+
+int
+iob_init (struct iob *b, int fd, enum iob_backend backend,
+          size_t block_size, int nblocks, int batch)
+{
+        memset (b, 0, sizeof *b);
+        b->fd = fd;
+        b->offset = lseek (fd, 0, SEEK_CUR);
+        if (b->offset < 0)
+                b->offset = -1;
+        b->block_size = block_size;
+        b->nblocks = nblocks < 2 ? 2 : nblocks;
+        b->batch = batch < 1 ? 1 : (batch > b->nblocks - 1 ? b->nblocks - 1 : batch);
+
+        b->ring = (struct iob_ring *) calloc (1, sizeof *b->ring);
+        b->blocks = (unsigned char *) malloc ((size_t) b->nblocks * block_size);
+        b->fill = (size_t *) calloc (b->nblocks, sizeof *b->fill);
+        if (!b->ring || !b->blocks || !b->fill)
+                goto fail;
+#if defined(__linux__)
+        b->ring->fd = -1;
+#endif
+        b->ring->state = (int *) calloc (b->nblocks, sizeof (int));
+        b->ring->off = (off_t *) calloc (b->nblocks, sizeof (off_t));
+        b->ring->res = (int *) calloc (b->nblocks, sizeof (int));
+        b->ring->pending = (int *) calloc (b->nblocks, sizeof (int));
+        b->ring->inflight = (int *) calloc (b->nblocks, sizeof (int));
+        if (!b->ring->state || !b->ring->off || !b->ring->res
+            || !b->ring->pending || !b->ring->inflight)
+                goto fail;
+
+        b->backend = IOB_PLAIN;
+#if defined(__linux__)
+        if (backend == IOB_URING && ring_setup (b, b->nblocks) == 0)
+                b->backend = IOB_URING;
+#else
+        (void) backend;
+#endif
+
+        b->cur = 0;
+        b->ring->state[0] = BLOCK_FILLING;
+        return 0;
+
+fail:
+        iob_destroy (b);
+        return -1;
+}
+
+int
+iob_write (struct iob *b, const void *p, size_t len)
+{
+        const unsigned char *src = (const unsigned char *) p;
+
+        if (b->ring->error)
+                return -1;
+        while (len > 0) {
+                size_t room = b->block_size - b->fill[b->cur];
+                size_t n = len < room ? len : room;
+                memcpy (b->blocks + (size_t) b->cur * b->block_size + b->fill[b->cur], src, n);
+                b->fill[b->cur] += n;
+                src += n;
+                len -= n;
+                if (b->fill[b->cur] == b->block_size) {
+                        queue_block (b, b->cur);
+                        next_block (b);
+                        if (b->ring->error)
+                                return -1;
+                }
+        }
+        return b->ring->error ? -1 : 0;
+}
+
+size_t
+iob_pending (const struct iob *b)
+{
+        return b->carry_len;
+}
+
+int
+iob_flush (struct iob *b)
+{
+        if (b->ring->error)
+                return -1;
+        if (b->carry_len > 0) {
+                ssize_t n = write (b->fd, b->carry, b->carry_len);
+                b->syscalls++;
+                b->writes++;
+                if (n > 0) {
+                        memmove (b->carry, b->carry + n, b->carry_len - n);
+                        b->carry_len -= n;
+                } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                        b->ring->error = 1;
+                        return -1;
+                }
+                if (b->carry_len > 0)
+                        return 1;
+        }
+
+        if (b->fill[b->cur] > 0) {
+                queue_block (b, b->cur);
+                next_block (b);
+        }
+#if defined(__linux__)
+        if (use_ring (b)) {
+                ring_wait (b);
+                if (b->ring->npending > 0 && !b->ring->error) {
+                        ring_submit (b);
+                        ring_wait (b);
+                }
+        }
+#endif
+        if (b->ring->error)
+                return -1;
+        return b->carry_len > 0 ? 1 : 0;
+}
+
+void
+iob_destroy (struct iob *b)
+{
+        if (b->ring) {
+                if (b->ring->state && b->blocks && b->fill) {
+                        /* give parked bytes a moment, but don't hang on a stuck reader */
+                        int tries = 10;
+                        while (iob_flush (b) == 1 && tries-- > 0) {
+                                struct pollfd pfd;
+                                pfd.fd = b->fd;
+                                pfd.events = POLLOUT;
+                                poll (&pfd, 1, 100);
+                        }
+                }
+#if defined(__linux__)
+                ring_teardown (b->ring);
+#endif
+                free (b->ring->state);
+                free (b->ring->off);
+                free (b->ring->res);
+                free (b->ring->pending);
+                free (b->ring->inflight);
+                free (b->ring);
+        }
+        free (b->blocks);
+        free (b->fill);
+        free (b->carry);
+        memset (b, 0, sizeof *b);
+        b->fd = -1;
+}
+
+/*
+ * stdio streams over an iob. The stream itself is unbuffered: the iob
+ * blocks already batch the small fprintf()s into large writes.
+ */
+
+#define IOB_STREAMS 8
+
+static struct {
+        FILE    *fp;
+        struct iob *b;
+} streams[IOB_STREAMS];
+
+struct iob *
+iob_of (FILE *fp)
+{
+        int i;
+        for (i = 0; i < IOB_STREAMS; i++)
+                if (streams[i].fp == fp)
+                        return streams[i].b;
+        return NULL;
+}
+
+static ssize_t
+stream_write (void *cookie, const char *p, size_t len)
+{
+        return iob_write ((struct iob *) cookie, p, len) == 0 ? (ssize_t) len : -1;
+}
+
+/* only position queries; ftell() is how the log writers spot a new file */
+static off_t
+stream_tell (struct iob *b, off_t off, int whence)
+{
+        off_t pos = (off_t) b->bytes + (off_t) b->fill[b->cur];
+        if ((whence == SEEK_CUR && off == 0) || (whence == SEEK_SET && off == pos))
+                return pos;
+        errno = ESPIPE;
+        return -1;
+}
+
+static int
+stream_close (void *cookie)
+{
+        struct iob *b = (struct iob *) cookie;
+        int fd = b->fd;
+        int i, ret;
+
+        for (i = 0; i < IOB_STREAMS; i++)
+                if (streams[i].b == b)
+                        streams[i].fp = NULL, streams[i].b = NULL;
+        ret = iob_flush (b);
+        iob_destroy (b);
+        free (b);
+        return close (fd) == 0 ? ret : -1;
+}
+
+#if defined(__APPLE__) || defined(__FreeBSD__)
+static int
+stream_write_bsd (void *cookie, const char *p, int len)
+{
+        return (int) stream_write (cookie, p, len);
+}
+
+static fpos_t
+stream_seek_bsd (void *cookie, fpos_t off, int whence)
+{
+        return stream_tell ((struct iob *) cookie, off, whence);
+}
+#else
+static int
+stream_seek (void *cookie, off64_t *off, int whence)
+{
+        off_t pos = stream_tell ((struct iob *) cookie, *off, whence);
+        if (pos < 0)
+                return -1;
+        *off = pos;
+        return 0;
+}
+#endif
+
+FILE *
+iob_fopen (const char *path, enum iob_backend backend)
+{
+        int i, fd;
+        FILE *fp = NULL;
+        struct iob *b;
+
+        for (i = 0; i < IOB_STREAMS && streams[i].fp; i++)
+                ;
+        if (i == IOB_STREAMS)
+                return NULL;
+
+        fd = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+                return NULL;
+        b = (struct iob *) malloc (sizeof *b);
+        if (!b || iob_init (b, fd, backend, 64 * 1024, 8, 4) != 0) {
+                free (b);
+                close (fd);
+                return NULL;
+        }
+
+#if defined(__APPLE__) || defined(__FreeBSD__)
+        fp = funopen (b, NULL, stream_write_bsd, stream_seek_bsd, stream_close);
+#else
+        {
+                cookie_io_functions_t io;
+                io.read = NULL;
+                io.write = stream_write;
+                io.seek = stream_seek;
+                io.close = stream_close;
+                fp = fopencookie (b, "w", io);
+        }
+#endif
+        if (!fp) {
+                iob_destroy (b);
+                free (b);
+                close (fd);
+                return NULL;
+        }
+        setvbuf (fp, NULL, _IONBF, 0);
+        streams[i].fp = fp;
+        streams[i].b = b;
+        return fp;
+}
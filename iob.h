@@ -0,0 +1,102 @@
+/*
+ * Block-buffered output with interchangeable backends, so the serial
+ * writer and the log writers can be A/B'd between plain write() and
+ * io_uring without touching the callers.
+ *
+ * Callers append bytes with iob_write(); full blocks are handed to the
+ * backend and iob_flush() pushes out whatever is left and waits for it.
+ *
+ *   plain  one write() (or pwrite()) per full block
+ *   uring  blocks are registered buffers; full blocks become linked
+ *          IORING_OP_WRITE_FIXED SQEs, submitted `batch` at a time with
+ *          one io_uring_enter(), while the caller fills the next ones
+ */
+
+#ifndef IOB_H
+#define IOB_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum iob_backend {
+        IOB_PLAIN,
+        IOB_URING
+};
+
+struct iob_ring;
+
+struct iob {
+        enum iob_backend backend;
+        int     fd;
+        off_t   offset;                 /* next file offset, -1 for ttys, pipes... */
+        size_t  block_size;
+        int     nblocks;
+        int     batch;                  /* full blocks per submission (uring) */
+        unsigned char *blocks;          /* nblocks * block_size */
+        size_t  *fill;                  /* bytes used in each block */
+        int     cur;                    /* block being filled */
+        struct iob_ring *ring;
+
+        /*
+         * With nonblock set, bytes a non-blocking fd won't take are parked
+         * in carry rather than waited for; iob_flush() retries them, and
+         * anything written meanwhile queues up behind them.
+         */
+        int     nonblock;
+        unsigned char *carry;
+        size_t  carry_len, carry_cap;
+
+        /* for comparing backends */
+        unsigned long long bytes;
+        unsigned long long syscalls;
+        unsigned long long writes;      /* of those, write()s and io_uring submits */
+};
+
+int iob_parse_backend (const char *name, enum iob_backend *backend);
+const char *iob_backend_name (enum iob_backend backend);
+
+/*
+ * Sets up b to write to fd. Asking for IOB_URING where io_uring isn't
+ * available quietly gives IOB_PLAIN; check b->backend. Returns 0 on
+ * success, -1 if out of memory.
+ */
+int iob_init (struct iob *b, int fd, enum iob_backend backend,
+              size_t block_size, int nblocks, int batch);
+
+/*
+ * queues len bytes, returns -1 if an earlier block failed to write. A
+ * failed iob stays failed: iob_write() and iob_flush() return -1 without
+ * writing anything more
+ */
+int iob_write (struct iob *b, const void *p, size_t len);
+
+/*
+ * writes everything queued and waits for it to land; in nonblock mode
+ * returns 1 if some of it is still parked, see iob_pending()
+ */
+int iob_flush (struct iob *b);
+
+/* bytes parked by a nonblock iob, waiting for the fd to become writable */
+size_t iob_pending (const struct iob *b);
+
+/* flushes and frees b; fd stays open */
+void iob_destroy (struct iob *b);
+
+/*
+ * A stdio stream over a new file at path, for fprintf-style log writers.
+ * fclose() flushes, closes the file and releases the iob; stats are
+ * available through iob_of() until then.
+ */
+FILE *iob_fopen (const char *path, enum iob_backend backend);
+struct iob *iob_of (FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,48 +1,467 @@
 /**
  * Serial port example.
- * Compile with: g++ main.cpp -lpthread -o main
- * 
+ * Compile with: make
+ *
  * Cymait http://cymait.com
  **/
 
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
 #include <fcntl.h>
-#include <stdlib.h>
-#include <pthread.h>
+#include <poll.h>
 #include <termios.h>
 
 
 #include <unistd.h>
 #include <sys/uio.h>
 
+#include "serial.h"
+#include "frame.h"
+
 
-#define BUFFER_SIZE 128
-#define BAUDRATE    B9600
+#define BUFFER_SIZE 65536
+
+static volatile sig_atomic_t quit = 0;
 
 void usage(char* cmd) {
-    std::cerr << "usage: " << cmd << " slave|master [device, only in slave mode]" << std::endl;
+    std::cerr << "usage: " << cmd << " [-s] [-l] [-b baud] [-f 8N1] [-c none|rtscts|xonxoff] slave|master|relay|latency|decode [device, in slave, relay, latency and decode mode]" << std::endl;
+    std::cerr << "  relay    wire a new PTY straight to device, in place of socat" << std::endl;
+    std::cerr << "  latency  time single bytes through a new PTY, or through device with TX looped to RX" << std::endl;
+    std::cerr << "  decode   print the binary frames (ismain -e binary) arriving on device" << std::endl;
+    std::cerr << "  -s     print bytes/sec and syscalls/sec to stderr once a second" << std::endl;
+    std::cerr << "  -b     any integer baud rate (default 9600)" << std::endl;
+    std::cerr << "  -f     data bits, parity and stop bits (default 8N1)" << std::endl;
+    std::cerr << "  -c     flow control (default none)" << std::endl;
+    std::cerr << "  -l     low latency: no driver batching, 1 ms USB latency timer, VMIN 1/VTIME 0" << std::endl;
     exit(1);
 }
 
-void* reader_thread(void* pointer) {
-    int fd = (int)(size_t)pointer;
-    char inputbyte;
-    while (read(fd, &inputbyte, 1) == 1) {
-        std::cout << inputbyte;
-        std::cout.flush();
+void on_signal(int) {
+    quit = 1;
+}
+
+/* running totals, sampled once a second for the rate report */
+struct bridge_stats {
+    unsigned long long to_port;     /* bytes stdin -> fd (relay: pty -> tty) */
+    unsigned long long from_port;   /* bytes fd -> stdout (relay: tty -> pty) */
+    unsigned long long syscalls;    /* poll + read + write (+ splice) */
+};
+
+/*
+ * One direction of the bridge. Data is read in chunks of up to BUFFER_SIZE
+ * and only read again once the previous chunk has been fully written, so a
+ * slow writer applies backpressure to its reader instead of growing memory.
+ */
+struct pump {
+    int in, out;
+    bool eof;
+    size_t head, tail;              /* pending bytes are buf[head, tail) */
+    unsigned long long* count;
+    char buf[BUFFER_SIZE];
+};
+
+static bool pump_empty(const pump& p) {
+    return p.head == p.tail;
+}
+
+/* returns false when the input side is finished (EOF or hangup) */
+static bool pump_read(pump& p, bridge_stats& st) {
+    ssize_t n = read(p.in, p.buf, sizeof(p.buf));
+    st.syscalls++;
+    if (n > 0) {
+        p.head = 0;
+        p.tail = n;
+        return true;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return true;
+    p.eof = true;
+    return false;
+}
+
+/* returns false if the output side is gone */
+static bool pump_write(pump& p, bridge_stats& st) {
+    ssize_t n = write(p.out, p.buf + p.head, p.tail - p.head);
+    st.syscalls++;
+    if (n > 0) {
+        p.head += n;
+        *p.count += n;
+        return true;
+    }
+    return n < 0 && (errno == EAGAIN || errno == EINTR);
+}
+
+static double now_seconds() {
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void report(const bridge_stats& cur, const bridge_stats& last, double dt, bool final) {
+    fprintf(stderr, "%s%10.0f B/s in %10.0f B/s out %8.0f syscalls/s%s",
+            final ? "\n" : "\r",
+            (cur.to_port - last.to_port) / dt,
+            (cur.from_port - last.from_port) / dt,
+            (cur.syscalls - last.syscalls) / dt,
+            final ? "\n" : "");
+}
+
+/*
+ * Moves data in both directions between stdin/stdout and fd from a single
+ * poll() loop. Returns when fd hangs up or on SIGINT/SIGTERM; EOF on stdin
+ * only stops the stdin -> fd direction.
+ */
+void bridge(int fd, bool show_stats) {
+    static pump up, down;
+    bridge_stats st, last;
+    memset(&st, 0, sizeof(st));
+    last = st;
+
+    up.in = STDIN_FILENO;  up.out = fd;             up.count = &st.to_port;
+    down.in = fd;          down.out = STDOUT_FILENO; down.count = &st.from_port;
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    double start = now_seconds(), last_report = start;
+
+    while (!quit) {
+        /* 0: stdin, 1: stdout, 2: fd */
+        struct pollfd pfd[3];
+        pfd[0].fd = STDIN_FILENO;
+        pfd[0].events = (!up.eof && pump_empty(up)) ? POLLIN : 0;
+        pfd[1].fd = STDOUT_FILENO;
+        pfd[1].events = pump_empty(down) ? 0 : POLLOUT;
+        pfd[2].fd = fd;
+        pfd[2].events = (pump_empty(down) ? POLLIN : 0) | (pump_empty(up) ? 0 : POLLOUT);
+
+        int ready = poll(pfd, 3, show_stats ? 1000 : -1);
+        st.syscalls++;
+        if (ready < 0 && errno != EINTR) break;
+
+        if (ready > 0) {
+            if ((pfd[0].events & POLLIN) && (pfd[0].revents & (POLLIN | POLLHUP)))
+                pump_read(up, st);
+            if ((pfd[2].events & POLLIN) && (pfd[2].revents & (POLLIN | POLLHUP | POLLERR))) {
+                if (!pump_read(down, st)) break;
+            }
+            if ((pfd[2].events & POLLOUT) && (pfd[2].revents & POLLOUT)) {
+                if (!pump_write(up, st)) break;
+            }
+            if ((pfd[1].events & POLLOUT) && (pfd[1].revents & (POLLOUT | POLLERR))) {
+                if (!pump_write(down, st)) break;
+            }
+        }
+
+        double now = now_seconds();
+        if (show_stats && now - last_report >= 1.0) {
+            report(st, last, now - last_report, false);
+            last = st;
+            last_report = now;
+        }
+    }
+
+    if (show_stats) {
+        memset(&last, 0, sizeof(last));
+        report(st, last, now_seconds() - start, true);
+    }
+}
+
+/*
+ * One direction of the relay. Where the kernel allows it bytes go
+ * in -> pipe -> out with splice(), so they never enter user space. Not
+ * every tty driver implements splice; the first EINVAL switches the
+ * direction over to plain read()/write() through its pump for good.
+ */
+struct channel {
+    pump p;
+    int pipefd[2];
+    size_t queued;                  /* bytes sitting in the pipe */
+    bool spliced;
+};
+
+static bool channel_empty(const channel& c) {
+    return c.spliced ? c.queued == 0 : pump_empty(c.p);
+}
+
+static void channel_init(channel& c, int in, int out, unsigned long long* count) {
+    memset(&c.p, 0, offsetof(pump, buf));
+    c.p.in = in;
+    c.p.out = out;
+    c.p.count = count;
+    c.queued = 0;
+    c.spliced = false;
+#if defined(__linux__)
+    c.spliced = pipe(c.pipefd) == 0;
+#endif
+}
+
+static void channel_fallback(channel& c) {
+    c.spliced = false;
+    /* anything already in the pipe goes out through the pump first */
+    ssize_t n = c.queued ? read(c.pipefd[0], c.p.buf, c.queued) : 0;
+    c.p.head = 0;
+    c.p.tail = n > 0 ? n : 0;
+    c.queued = 0;
+    close(c.pipefd[0]);
+    close(c.pipefd[1]);
+}
+
+static bool channel_read(channel& c, bridge_stats& st) {
+#if defined(__linux__)
+    if (c.spliced) {
+        ssize_t n = splice(c.p.in, 0, c.pipefd[1], 0, BUFFER_SIZE,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        st.syscalls++;
+        if (n > 0) {
+            c.queued += n;
+            return true;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) return true;
+        if (n < 0 && errno == EINVAL) channel_fallback(c);
+        else return false;
+    }
+#endif
+    return pump_read(c.p, st);
+}
+
+static bool channel_write(channel& c, bridge_stats& st) {
+#if defined(__linux__)
+    if (c.spliced) {
+        ssize_t n = splice(c.pipefd[0], 0, c.p.out, 0, c.queued,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        st.syscalls++;
+        if (n > 0) {
+            c.queued -= n;
+            *c.p.count += n;
+            return true;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) return true;
+        if (n < 0 && errno == EINVAL) channel_fallback(c);
+        else return false;
+    }
+#endif
+    return pump_write(c.p, st);
+}
+
+/*
+ * Relays between a PTY master and a physical tty from one poll() loop,
+ * replacing `socat pty,raw,echo=0 <tty>`. Returns when either side hangs
+ * up or on SIGINT/SIGTERM.
+ */
+void relay(int pty, int tty, bool show_stats) {
+    static channel up, down;
+    bridge_stats st, last;
+    memset(&st, 0, sizeof(st));
+    last = st;
+
+    channel_init(up, pty, tty, &st.to_port);
+    channel_init(down, tty, pty, &st.from_port);
+
+    fcntl(pty, F_SETFL, fcntl(pty, F_GETFL) | O_NONBLOCK);
+    fcntl(tty, F_SETFL, fcntl(tty, F_GETFL) | O_NONBLOCK);
+
+    double start = now_seconds(), last_report = start;
+
+    while (!quit) {
+        /* 0: pty, 1: tty */
+        struct pollfd pfd[2];
+        pfd[0].fd = pty;
+        pfd[0].events = (channel_empty(up) ? POLLIN : 0) | (channel_empty(down) ? 0 : POLLOUT);
+        pfd[1].fd = tty;
+        pfd[1].events = (channel_empty(down) ? POLLIN : 0) | (channel_empty(up) ? 0 : POLLOUT);
+
+        int ready = poll(pfd, 2, show_stats ? 1000 : -1);
+        st.syscalls++;
+        if (ready < 0 && errno != EINTR) break;
+
+        if (ready > 0) {
+            if ((pfd[0].events & POLLIN) && (pfd[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+                if (!channel_read(up, st)) break;
+            }
+            if ((pfd[1].events & POLLIN) && (pfd[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+                if (!channel_read(down, st)) break;
+            }
+            if ((pfd[1].events & POLLOUT) && (pfd[1].revents & (POLLOUT | POLLERR))) {
+                if (!channel_write(up, st)) break;
+            }
+            if ((pfd[0].events & POLLOUT) && (pfd[0].revents & (POLLOUT | POLLERR))) {
+                if (!channel_write(down, st)) break;
+            }
+        }
+
+        double now = now_seconds();
+        if (show_stats && now - last_report >= 1.0) {
+            report(st, last, now - last_report, false);
+            last = st;
+            last_report = now;
+        }
+    }
+
+    if (show_stats) {
+        fprintf(stderr, "\npty -> tty: %s, tty -> pty: %s",
+                up.spliced ? "splice" : "read/write",
+                down.spliced ? "splice" : "read/write");
+        memset(&last, 0, sizeof(last));
+        report(st, last, now_seconds() - start, true);
+    }
+}
+
+/* CLOCK_MONOTONIC, in microseconds, for timing single bytes */
+static double monotonic_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+/* what the driver actually agreed to, after serial_configure */
+static void print_latency_settings(const char* name, int fd) {
+    struct serial_latency lat;
+    serial_get_latency(fd, &lat);
+
+    fprintf(stderr, "%s: ASYNC_LOW_LATENCY %s", name,
+            lat.async_low_latency < 0 ? "n/a" : lat.async_low_latency ? "on" : "off");
+    if (lat.timer_ms < 0)
+        fprintf(stderr, ", no latency_timer\n");
+    else
+        fprintf(stderr, ", latency_timer %d ms\n", lat.timer_ms);
+}
+
+/*
+ * Writes single bytes into in and times how long each takes to come out of
+ * out: the two ends of a PTY, or one tty with TX wired to RX. Prints the
+ * spread in microseconds.
+ */
+static int measure_latency(int in, int out, int rounds) {
+    std::vector<double> us;
+    char c = 0x55, r;
+
+    tcflush(out, TCIFLUSH);
+    for (int i = 0; i < rounds && !quit; i++) {
+        struct pollfd pfd = { out, POLLIN, 0 };
+        double start = monotonic_us();
+        if (write(in, &c, 1) != 1) {
+            perror("write");
+            return -1;
+        }
+        if (poll(&pfd, 1, 1000) != 1 || read(out, &r, 1) != 1) {
+            std::cerr << "nothing came back within a second, is the port looped back?" << std::endl;
+            return -1;
+        }
+        us.push_back(monotonic_us() - start);
+        usleep(1000);
     }
+    if (us.empty()) return -1;
 
+    std::sort(us.begin(), us.end());
+    double sum = 0;
+    for (size_t i = 0; i < us.size(); i++) sum += us[i];
+    fprintf(stderr, "%zu bytes: min %.0f us, median %.0f us, mean %.0f us, p99 %.0f us, max %.0f us\n",
+            us.size(), us[0], us[us.size() / 2], sum / us.size(),
+            us[us.size() * 99 / 100], us.back());
     return 0;
 }
 
+/* prints every frame arriving on fd until EOF or a signal */
+static void decode(int fd) {
+    struct frame_decoder d;
+    struct frame_sample s;
+    unsigned char buf[4096];
+    ssize_t n;
+
+    frame_decoder_init(&d);
+    while (!quit && (n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            perror("read");
+            break;
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            if (!frame_decode_byte(&d, buf[i], &s)) continue;
+
+            printf("T%d.S%d #%3u %5u ms", s.tracker, s.station, s.seq, s.time_ms);
+            if (s.fields & FRAME_EULER)
+                printf("  euler %7.2f %7.2f %7.2f", s.euler[0], s.euler[1], s.euler[2]);
+            if (s.fields & FRAME_QUAT)
+                printf("  quat %6.3f %6.3f %6.3f %6.3f", s.quat[0], s.quat[1], s.quat[2], s.quat[3]);
+            if (s.fields & FRAME_POSITION)
+                printf("  pos %7.3f %7.3f %7.3f", s.position[0], s.position[1], s.position[2]);
+            if (s.fields & FRAME_ANGVEL)
+                printf("  angvel %6.3f %6.3f %6.3f", s.angvel[0], s.angvel[1], s.angvel[2]);
+            if (s.fields & FRAME_ACCEL)
+                printf("  accel %7.3f %7.3f %7.3f", s.accel[0], s.accel[1], s.accel[2]);
+            printf("\n");
+        }
+        fflush(stdout);
+    }
+    fprintf(stderr, "%lu frames, %lu bad, %lu stale\n", d.frames, d.errors, d.stale);
+}
+
+/* opens a new PTY master, returning it and the slave we hold open */
+int open_master(int& slave_fd) {
+    int fd = open("/dev/ptmx", O_RDWR | O_NOCTTY);
+    if (fd == -1) return -1;
+
+    grantpt(fd);
+    unlockpt(fd);
+
+    char* pts_name = ptsname(fd);
+    std::cerr << "ptsname: " << pts_name << std::endl;
+
+    /* keep the slave open ourselves so the master doesn't report a
+     * hangup before (or between) clients connecting to it */
+    slave_fd = open(pts_name, O_RDWR | O_NOCTTY);
+    return fd;
+}
+
 int main(int argc, char** argv) {
+    bool show_stats = false;
+
+    /* serial port parameters */
+    struct serial_config cfg;
+    serial_default_config(&cfg);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "slb:f:c:")) != -1) {
+        switch (opt) {
+        case 's':
+            show_stats = true;
+            break;
+        case 'l':
+            cfg.low_latency = 1;
+            break;
+        case 'b':
+            cfg.baud = atoi(optarg);
+            if (cfg.baud <= 0) usage(argv[0]);
+            break;
+        case 'f':
+            if (serial_parse_framing(optarg, &cfg) != 0) usage(argv[0]);
+            break;
+        case 'c':
+            if (serial_parse_flow(optarg, &cfg) != 0) usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    argv[optind - 1] = argv[0];
+    argv += optind - 1;
+    argc -= optind - 1;
+
     if (argc < 2) usage(argv[0]);
 
     int fd = 0;
+    int tty = -1;
+    int slave_fd = -1;
     std::string mode = argv[1];
 
     if (mode == "slave") {
@@ -55,51 +474,108 @@ int main(int argc, char** argv) {
         }
 
     }else if (mode=="master") {
-        fd = open("/dev/ptmx", O_RDWR | O_NOCTTY);
+        fd = open_master(slave_fd);
         if (fd == -1) {
             std::cerr << "error opening file" << std::endl;
             return -1;
         }
+    }else if (mode=="relay") {
+        if (argc < 3) usage(argv[1]);
 
-        grantpt(fd);
-        unlockpt(fd);
+        tty = open(argv[2], O_RDWR | O_NOCTTY);
+        if (tty == -1) {
+            std::cerr << "error opening " << argv[2] << std::endl;
+            return -1;
+        }
 
-        char* pts_name = ptsname(fd);
-        std::cerr << "ptsname: " << pts_name << std::endl;
+        fd = open_master(slave_fd);
+        if (fd == -1) {
+            std::cerr << "error opening file" << std::endl;
+            return -1;
+        }
+        if (serial_configure(tty, &cfg) != 0) return -1;
+        if (cfg.low_latency) print_latency_settings(argv[2], tty);
+    }else if (mode=="decode") {
+        if (argc < 3) usage(argv[1]);
+
+        fd = open(argv[2], O_RDONLY | O_NOCTTY);
+        if (fd == -1) {
+            std::cerr << "error opening " << argv[2] << std::endl;
+            return -1;
+        }
+        if (isatty(fd) && serial_configure(fd, &cfg) != 0) return -1;
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_signal;
+        sigaction(SIGINT, &sa, 0);
+        sigaction(SIGTERM, &sa, 0);
+        decode(fd);
+        close(fd);
+        return 0;
+    }else if (mode=="latency") {
+        int in, out;
+        if (argc >= 3) {
+            /* a real port with a loopback plug */
+            in = out = open(argv[2], O_RDWR | O_NOCTTY);
+            if (in == -1) {
+                std::cerr << "error opening " << argv[2] << std::endl;
+                return -1;
+            }
+            if (serial_configure(in, &cfg) != 0) return -1;
+            print_latency_settings(argv[2], in);
+        } else {
+            in = open_master(out);
+            if (in == -1 || out == -1) {
+                std::cerr << "error opening PTY" << std::endl;
+                return -1;
+            }
+            if (serial_configure(out, &cfg) != 0) return -1;
+            print_latency_settings(ptsname(in), out);
+        }
+        int r = measure_latency(in, out, 1000);
+        if (out != in) close(out);
+        close(in);
+        return r;
     } else {
         usage(argv[1]);
     }
 
-    /* serial port parameters */
-    struct termios newtio;
-    memset(&newtio, 0, sizeof(newtio));
-    struct termios oldtio;
-    tcgetattr(fd, &oldtio);
-
-    newtio = oldtio;
-    newtio.c_cflag = BAUDRATE | CS8 | CLOCAL | CREAD;
-    newtio.c_iflag = 0;
-    newtio.c_oflag = 0;
-    newtio.c_lflag = 0;
-    newtio.c_cc[VMIN] = 1;
-    newtio.c_cc[VTIME] = 0;
-    tcflush(fd, TCIFLUSH);
-
-    cfsetispeed(&newtio, BAUDRATE);
-    cfsetospeed(&newtio, BAUDRATE);
-    tcsetattr(fd, TCSANOW, &newtio);
-
-    /* start reader thread */
-    pthread_t thread;
-    pthread_create(&thread, 0, reader_thread, (void*) fd);
-
-    /* read from stdin and send it to the serial port */
-    char c;
-    while (true) {
-        std::cin >> c;
-        write(fd, &c, 1);
+    serial_configure(fd, &cfg);
+    if (mode == "slave" && cfg.low_latency) print_latency_settings(argv[2], fd);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, 0);
+    sigaction(SIGTERM, &sa, 0);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (tty != -1) {
+        relay(fd, tty, show_stats);
+        close(tty);
+        close(slave_fd);
+        close(fd);
+        return 0;
     }
 
+    /* pass keystrokes through as they are typed, including whitespace;
+     * ISIG stays on so ^C still gets us out */
+    struct termios oldstdin;
+    bool stdin_tty = isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &oldstdin) == 0;
+    if (stdin_tty) {
+        struct termios rawstdin = oldstdin;
+        rawstdin.c_lflag &= ~(ICANON | ECHO);
+        rawstdin.c_iflag &= ~(ICRNL | IXON);
+        rawstdin.c_cc[VMIN] = 1;
+        rawstdin.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &rawstdin);
+    }
+
+    bridge(fd, show_stats);
+
+    if (stdin_tty) tcsetattr(STDIN_FILENO, TCSANOW, &oldstdin);
+    if (slave_fd != -1) close(slave_fd);
     close(fd);
     return 0;
 }
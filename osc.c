@@ -0,0 +1,146 @@
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "osc.h"
+
+#define SLIP_END        0xc0
+#define SLIP_ESC        0xdb
+#define SLIP_ESC_END    0xdc
+#define SLIP_ESC_ESC    0xdd
+
+/* OSC strings end in at least one 0, padded to a multiple of 4 */
+static size_t
+padded (size_t len)
+{
+        return (len + 4) & ~(size_t) 3;
+}
+
+static unsigned char *
+put32 (unsigned char *p, unsigned int v)
+{
+        p[0] = v >> 24;
+        p[1] = v >> 16;
+        p[2] = v >> 8;
+        p[3] = v;
+        return p + 4;
+}
+
+int
+osc_template_init (struct osc_template *t, const char *address, int nargs)
+{
+        size_t alen = strlen (address);
+        int i;
+
+        if (alen >= OSC_ADDRESS_MAX || nargs < 1 || nargs > OSC_ARGS_MAX)
+                return -1;
+        memset (t, 0, sizeof *t);
+        memcpy (t->head, address, alen);
+        t->len = padded (alen);
+        t->head[t->len] = ',';
+        for (i = 0; i < nargs; i++)
+                t->head[t->len + 1 + i] = 'f';
+        t->len += padded (1 + nargs);
+        t->nargs = nargs;
+        return 0;
+}
+
+void
+osc_bundle_begin (struct osc_bundle *b, unsigned char *buf, size_t cap)
+{
+        b->buf = buf;
+        b->cap = cap;
+        memcpy (buf, "#bundle\0", 8);
+        put32 (buf + 8, 0);
+        put32 (buf + 12, 1);            /* the special time tag for "now" */
+        b->len = OSC_BUNDLE_HEAD;
+}
+
+int
+osc_bundle_add (struct osc_bundle *b, const struct osc_template *t, const float *args)
+{
+        size_t size = t->len + 4 * t->nargs;
+        unsigned char *p = b->buf + b->len;
+        unsigned int v;
+        int i;
+
+        if (b->len + 4 + size > b->cap)
+                return -1;
+        p = put32 (p, size);
+        memcpy (p, t->head, t->len);
+        p += t->len;
+        for (i = 0; i < t->nargs; i++) {
+                memcpy (&v, &args[i], 4);
+                p = put32 (p, v);
+        }
+        b->len = p - b->buf;
+        return 0;
+}
+
+size_t
+osc_slip_encode (const unsigned char *in, size_t len, unsigned char *out)
+{
+        unsigned char *p = out;
+        size_t i;
+
+        *p++ = SLIP_END;
+        for (i = 0; i < len; i++) {
+                if (in[i] == SLIP_END) {
+                        *p++ = SLIP_ESC;
+                        *p++ = SLIP_ESC_END;
+                } else if (in[i] == SLIP_ESC) {
+                        *p++ = SLIP_ESC;
+                        *p++ = SLIP_ESC_ESC;
+                } else {
+                        *p++ = in[i];
+                }
+        }
+        *p++ = SLIP_END;
+        return p - out;
+}
+
+int
+osc_udp_open (const char *hostport)
+{
+        char host[256];
+        const char *colon = strrchr (hostport, ':');
+        struct addrinfo hints, *res, *ai;
+        int fd = -1, err;
+
+        if (!colon || colon == hostport || (size_t) (colon - hostport) >= sizeof host) {
+                fprintf (stderr, "osc: expected host:port, got %s\n", hostport);
+                return -1;
+        }
+        memcpy (host, hostport, colon - hostport);
+        host[colon - hostport] = '\0';
+
+        memset (&hints, 0, sizeof hints);
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+        err = getaddrinfo (host, colon + 1, &hints, &res);
+        if (err != 0) {
+                fprintf (stderr, "osc: %s: %s\n", hostport, gai_strerror (err));
+                return -1;
+        }
+        for (ai = res; ai; ai = ai->ai_next) {
+                fd = socket (ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+                if (fd < 0)
+                        continue;
+                if (connect (fd, ai->ai_addr, ai->ai_addrlen) == 0)
+                        break;
+                close (fd);
+                fd = -1;
+        }
+        freeaddrinfo (res);
+        if (fd < 0) {
+                fprintf (stderr, "osc: can't reach %s\n", hostport);
+                return -1;
+        }
+
+        /* a receiver that isn't keeping up loses datagrams, it never stalls us */
+        fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+        return fd;
+}
@@ -0,0 +1,73 @@
+/*
+ * OSC 1.0 output of tracker samples, for Max, Pd, TouchDesigner and the
+ * like: one bundle per sample holding a message per field,
+ *
+ *      /ic4/1/euler fff
+ *      /ic4/1/quat ffff
+ *
+ * sent SLIP framed over a serial port (OSC 1.1 style, END on both sides)
+ * or as one UDP datagram each.
+ *
+ * Each message's address and type tags are laid out once, padded and
+ * ready, in a template; adding it to a bundle is a memcpy and the floats
+ * in network byte order. Bundles are built in the caller's buffer, so
+ * nothing is allocated per sample.
+ *
+ *      struct osc_template euler;
+ *      osc_template_init (&euler, "/ic4/1/euler", 3);
+ *      ...
+ *      struct osc_bundle b;
+ *      osc_bundle_begin (&b, buf, sizeof buf);
+ *      osc_bundle_add (&b, &euler, sample.euler);
+ *      n = osc_slip_encode (buf, b.len, wire);
+ */
+
+#ifndef OSC_H
+#define OSC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OSC_ADDRESS_MAX 48              /* address pattern, with its terminator */
+#define OSC_ARGS_MAX    4               /* floats per message */
+#define OSC_HEAD_MAX    (OSC_ADDRESS_MAX + OSC_ARGS_MAX + 4)    /* both padded */
+#define OSC_MESSAGE_MAX (4 + OSC_HEAD_MAX + 4 * OSC_ARGS_MAX)   /* with its size */
+#define OSC_BUNDLE_HEAD 16              /* "#bundle" and the time tag */
+
+/* SLIP frame of len bytes at worst: everything escaped, plus both ENDs */
+#define OSC_SLIP_MAX(len) (2 * (len) + 2)
+
+struct osc_template {
+        unsigned char head[OSC_HEAD_MAX];       /* address and type tags, padded to 4 */
+        size_t  len;
+        int     nargs;
+};
+
+struct osc_bundle {
+        unsigned char *buf;
+        size_t  cap, len;
+};
+
+/* nargs float arguments (1..OSC_ARGS_MAX), returns -1 if the address is too long */
+int osc_template_init (struct osc_template *t, const char *address, int nargs);
+
+/* starts a bundle in buf (at least OSC_BUNDLE_HEAD bytes), time tag "immediately" */
+void osc_bundle_begin (struct osc_bundle *b, unsigned char *buf, size_t cap);
+
+/* appends a message of t with its floats, returns -1 if it doesn't fit */
+int osc_bundle_add (struct osc_bundle *b, const struct osc_template *t, const float *args);
+
+/* SLIP frames len bytes into out (OSC_SLIP_MAX (len) bytes), returns the length */
+size_t osc_slip_encode (const unsigned char *in, size_t len, unsigned char *out);
+
+/* a non-blocking UDP socket connected to "host:port", or -1 with a message */
+int osc_udp_open (const char *hostport);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,155 @@
+#include <errno.h>
+#include <time.h>
+
+#include "pace.h"
+
+#define PERIOD_GAIN     0.05            /* how fast the period follows the timestamps */
+#define OFFSET_GAIN     0.5             /* and the phase follows where polling caught a record */
+#define OFFSET_CREEP    20e-6           /* how much earlier to look after a record was already there */
+
+double
+pace_now (void)
+{
+        struct timespec ts;
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double
+thread_cpu (void)
+{
+        struct timespec ts;
+        if (clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+                return 0;
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void
+pace_init (struct pace *p, double hz)
+{
+        p->period = 1.0 / (hz > 0 ? hz : 180);
+        p->offset = p->last = 0;
+        p->due = pace_now ();
+        p->locked = 0;
+        p->polling = 0;
+        p->hits = p->misses = 0;
+        p->late_sum = p->late_max = 0;
+        p->window = p->due;
+        p->cpu_start = thread_cpu ();
+        p->cpu = p->late_mean = p->late_worst = p->miss_rate = 0;
+}
+
+void
+pace_set_rate (struct pace *p, double hz)
+{
+        double period;
+
+        if (hz <= 0)
+                return;
+        period = 1.0 / hz;
+        /* RecordsPerSec is a whole number, only a big change beats the timestamps */
+        if (period < p->period * 0.8 || period > p->period * 1.25)
+                p->period = period;
+}
+
+void
+pace_sleep_until (double t)
+{
+        struct timespec ts;
+
+#if defined(__linux__)
+        ts.tv_sec = (time_t) t;
+        ts.tv_nsec = (long) ((t - ts.tv_sec) * 1e9);
+        while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+                ;
+#else
+        double d = t - pace_now ();
+        if (d <= 0)
+                return;
+        ts.tv_sec = (time_t) d;
+        ts.tv_nsec = (long) ((d - ts.tv_sec) * 1e9);
+        while (nanosleep (&ts, &ts) != 0 && errno == EINTR)
+                ;
+#endif
+}
+
+void
+pace_sleep (const struct pace *p)
+{
+        pace_sleep_until (p->due);
+}
+
+void
+pace_update (struct pace *p, int fresh, double newest)
+{
+        double now = pace_now ();
+        double seen = now - newest;
+        double expected;
+
+        if (fresh) {
+                if (!p->locked) {
+                        p->offset = seen;
+                        p->locked = 1;
+                } else {
+                        /* several records may have come since the last one we saw */
+                        double gap = newest - p->last;
+                        long n = (long) (gap / p->period + 0.5);
+                        double late = seen - p->offset;
+
+                        if (n < 1)
+                                n = 1;
+                        if (gap / n > p->period * 0.5 && gap / n < p->period * 2)
+                                p->period += (gap / n - p->period) * PERIOD_GAIN;
+
+                        if (late < 0)
+                                late = 0;
+                        p->late_sum += late;
+                        if (late > p->late_max)
+                                p->late_max = late;
+
+                        /*
+                         * a record found on the first look may have been there for a while,
+                         * so look a little earlier next time; one that short polling caught
+                         * says when records really arrive
+                         */
+                        if (p->polling)
+                                p->offset += (seen - p->offset) * OFFSET_GAIN;
+                        else
+                                p->offset = (seen < p->offset ? seen : p->offset) - OFFSET_CREEP;
+                }
+                p->last = newest;
+                p->polling = 0;
+                p->hits++;
+                p->due = newest + p->period + p->offset + PACE_MARGIN;
+                if (p->due < now)
+                        p->due = now;   /* behind already, go again */
+                return;
+        }
+
+        /* nothing yet: poll soon, or less keenly once the tracker looks stopped */
+        p->misses++;
+        p->polling = 1;
+        expected = p->last + p->period + p->offset;
+        p->due = now + (now - expected > 2 * p->period ? p->period / 2 : PACE_POLL);
+}
+
+void
+pace_account (struct pace *p)
+{
+        double now = pace_now ();
+        double cpu;
+        unsigned long polls = p->hits + p->misses;
+
+        if (now - p->window < 1.0)
+                return;
+        cpu = thread_cpu ();
+        p->cpu = (cpu - p->cpu_start) / (now - p->window);
+        p->late_mean = p->hits ? p->late_sum / p->hits : 0;
+        p->late_worst = p->late_max;
+        p->miss_rate = polls ? (double) p->misses / polls : 0;
+
+        p->hits = p->misses = 0;
+        p->late_sum = p->late_max = 0;
+        p->window = now;
+        p->cpu_start = cpu;
+}
@@ -0,0 +1,87 @@
+/*
+ * Paces a polling loop to a tracker's record rate, instead of spinning on
+ * ISD_GetTrackingData or sleeping a fixed few ms between calls.
+ *
+ * The period is learnt from the record timestamps, seeded by
+ * RecordsPerSec. The phase comes from when records first show up: the
+ * offset (host time - record timestamp) from the tracker's clock to "the
+ * record is there" is found by looking: the loop sleeps until just after
+ * the next record is due, and when a poll comes up empty polls every
+ * PACE_POLL until it shows up, which says when it really arrived. A
+ * record that was already there on the first look pulls the next look a
+ * little earlier, so the wakes settle around the arrivals and follow
+ * jitter and drift either way, at the cost of the odd empty poll.
+ *
+ *      struct pace p;
+ *      pace_init (&p, 180);
+ *      for (;;) {
+ *              pace_sleep (&p);
+ *              ...poll
+ *              pace_update (&p, got_one, newest_timestamp);
+ *              pace_account (&p);
+ *      }
+ *
+ * pace_account publishes, about once a second, the polling thread's CPU
+ * use, how long after a record was due it was picked up ("late"), and
+ * how many polls found nothing.
+ */
+
+#ifndef PACE_H
+#define PACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PACE_MARGIN     100e-6          /* wake this long after a record is due */
+#define PACE_POLL       250e-6          /* and poll this often when it isn't there yet */
+
+struct pace {
+        double  period;                 /* seconds between records */
+        double  offset;                 /* host time - record timestamp, at the earliest */
+        double  last;                   /* timestamp of the newest record */
+        double  due;                    /* host time of the next poll */
+        int     locked;                 /* seen a record to take the phase from */
+        int     polling;                /* the last poll found nothing */
+
+        /* since the last time pace_account published */
+        unsigned long hits, misses;
+        double  late_sum, late_max;
+        double  window, cpu_start;
+
+        /* published by pace_account, for other threads to show */
+        volatile double cpu;            /* fraction of a core */
+        volatile double late_mean, late_worst;  /* seconds */
+        volatile double miss_rate;      /* empty polls per poll */
+};
+
+/* CLOCK_MONOTONIC, in seconds */
+double pace_now (void);
+
+/* a record every 1/hz seconds to start with */
+void pace_init (struct pace *p, double hz);
+
+/* takes a new RecordsPerSec, if it's a real change from what the timestamps say */
+void pace_set_rate (struct pace *p, double hz);
+
+/* sleeps until p is due */
+void pace_sleep (const struct pace *p);
+
+/* sleeps until host time t (pace_now's clock) */
+void pace_sleep_until (double t);
+
+/*
+ * after a poll: fresh if it found a record, newest the timestamp of the newest one
+ * in seconds, exact (see pose_station_time) rather than the float TimeStamp, which
+ * after a few hours is too coarse to tell one record period from the next
+ */
+void pace_update (struct pace *p, int fresh, double newest);
+
+/* publishes the stats at most once a second, call from the polling thread */
+void pace_account (struct pace *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * The record samples travel in between the SDK and everything that
+ * queues, encodes or logs them.
+ *
+ * ISD_STATION_DATA_TYPE is 444 bytes, most of it reserved floats, 4 byte
+ * button Bools and fields nothing here reads, so copying it per sample
+ * per station moves seven cache lines to use one. A pose_sample is one
+ * aligned cache line with what every output wants: ids, tracking status,
+ * the timestamp (as a float and exact), Euler, quaternion and position.
+ * The rest of what the logs write (rates, accelerations, magnetometer,
+ * inputs) goes in a pose_extended of two lines, filled in only when
+ * someone asked for it:
+ *
+ *      #include "isense.h"             // first, for pose_from_station
+ *      #include "../pose.h"
+ *
+ *      struct pose_sample s;
+ *      struct pose_extended x;
+ *      pose_from_station (&s, want_rates ? &x : NULL, tracker, station, &data.Station[station - 1]);
+ *
+ * Queues keep the two in parallel arrays, so the common case never
+ * touches the extended one.
+ */
+
+#ifndef POSE_H
+#define POSE_H
+
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POSE_LINE       64              /* bytes in a cache line */
+
+#ifdef __cplusplus
+#define POSE_ALIGNED    alignas (POSE_LINE)
+#else
+#define POSE_ALIGNED    _Alignas (POSE_LINE)
+#endif
+
+enum {
+        POSE_EXTENDED   = 1 << 0,       /* the pose_extended that goes with it is filled in */
+        POSE_INPUTS     = 1 << 1,       /* its buttons and analog were asked for */
+};
+
+struct pose_sample {
+        POSE_ALIGNED unsigned int seq;  /* set by whatever queues it */
+        unsigned char tracker;          /* 1-based */
+        unsigned char station;          /* 1-based */
+        unsigned char status;           /* TrackingStatus, 0-255 */
+        unsigned char flags;            /* POSE_* */
+        float   time;                   /* TimeStamp, seconds */
+        float   euler[3];               /* yaw, pitch, roll in degrees */
+        float   quat[4];                /* w, x, y, z */
+        float   position[3];            /* meters */
+        unsigned int time_s, time_us;   /* TimeStampSeconds and MicroSec, which don't lose precision */
+        unsigned char comm;             /* CommIntegrity, percent */
+        unsigned char meas;             /* MeasQuality */
+        unsigned char battery_state;    /* 0 n/a, 1 low, 2 ok */
+        unsigned char pad;
+};
+
+struct pose_extended {
+        POSE_ALIGNED float angvel[3];   /* AngularVelNavFrame, rad/s */
+        float   accel[3];               /* AccelNavFrame, m/s^2 */
+        float   angvel_body[3];
+        float   angvel_raw[3];
+        float   accel_body[3];
+        float   velocity[3];            /* VelocityNavFrame, m/s */
+        float   mag[3];                 /* MagBodyFrame, gauss */
+        float   compass_yaw;            /* degrees */
+        float   still_time;
+        float   battery;                /* volts */
+        float   temperature;            /* degrees C */
+        unsigned int os_time_s, os_time_us;
+        short   analog[2];              /* joystick axes */
+        unsigned char buttons;          /* bit i is button i */
+        unsigned char aux[4];
+        unsigned char aux_inputs;       /* how many of aux were asked for and the station has */
+};
+
+/* fails to compile if the layouts above stop fitting their lines */
+typedef char pose_sample_fits[sizeof (struct pose_sample) == POSE_LINE ? 1 : -1];
+typedef char pose_extended_fits[sizeof (struct pose_extended) == 2 * POSE_LINE ? 1 : -1];
+
+#ifdef _ISD_isenseh
+/*
+ * the record's timestamp in seconds from TimeStampSeconds and MicroSec; the
+ * float TimeStamp's step is 1 ms after 2.3 h and 7.8 ms after 18 h
+ */
+static inline double
+pose_station_time (const ISD_STATION_DATA_TYPE *st)
+{
+        return st->TimeStampSeconds + st->TimeStampMicroSec * 1e-6;
+}
+
+/* fills s, and x unless it's NULL, from one station's SDK record; leaves seq alone */
+static inline void
+pose_from_station (struct pose_sample *s, struct pose_extended *x, int tracker, int station,
+                   const ISD_STATION_DATA_TYPE *st)
+{
+        int i;
+
+        s->tracker = tracker;
+        s->station = station;
+        s->status = st->TrackingStatus;
+        s->flags = x ? POSE_EXTENDED : 0;
+        s->time = st->TimeStamp;
+        memcpy (s->euler, st->Euler, sizeof s->euler);
+        memcpy (s->quat, st->Quaternion, sizeof s->quat);
+        memcpy (s->position, st->Position, sizeof s->position);
+        s->time_s = st->TimeStampSeconds;
+        s->time_us = st->TimeStampMicroSec;
+        s->comm = st->CommIntegrity;
+        s->meas = st->MeasQuality;
+        s->battery_state = st->BatteryState;
+        s->pad = 0;
+        if (!x)
+                return;
+
+        memcpy (x->angvel, st->AngularVelNavFrame, sizeof x->angvel);
+        memcpy (x->accel, st->AccelNavFrame, sizeof x->accel);
+        memcpy (x->angvel_body, st->AngularVelBodyFrame, sizeof x->angvel_body);
+        memcpy (x->angvel_raw, st->AngularVelRaw, sizeof x->angvel_raw);
+        memcpy (x->accel_body, st->AccelBodyFrame, sizeof x->accel_body);
+        memcpy (x->velocity, st->VelocityNavFrame, sizeof x->velocity);
+        memcpy (x->mag, st->MagBodyFrame, sizeof x->mag);
+        x->compass_yaw = st->CompassYaw;
+        x->still_time = st->StillTime;
+        x->battery = st->BatteryLevel;
+        x->temperature = st->Temperature;
+        x->os_time_s = st->OSTimeStampSeconds;
+        x->os_time_us = st->OSTimeStampMicroSec;
+        x->analog[0] = st->AnalogData[0];
+        x->analog[1] = st->AnalogData[1];
+        x->buttons = 0;
+        for (i = 0; i < ISD_MAX_BUTTONS && i < 8; i++)
+                x->buttons |= (st->ButtonState[i] ? 1 : 0) << i;
+        memcpy (x->aux, st->AuxInputs, sizeof x->aux);
+        x->aux_inputs = 0;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Worst-case rotation error of the smallest-three quaternion packing in
+ * frame.c, for each width, measured against the bound frame_quat_error()
+ * gives. Samples random orientations plus the neighbourhood of
+ * (1/2, 1/2, 1/2, 1/2), where the bound is reached, and round trips each
+ * through frame_encode/frame_decode.
+ *
+ *      make quatbench && ./quatbench [samples]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "frame.h"
+
+static double
+uniform (void)
+{
+        return rand () / (double) RAND_MAX * 2.0 - 1.0;
+}
+
+static void
+random_quat (float *q, int near_half)
+{
+        double n = 0;
+        int i;
+
+        do {
+                n = 0;
+                for (i = 0; i < 4; i++) {
+                        q[i] = near_half ? 0.5 + uniform () * 0.01 : uniform ();
+                        n += q[i] * q[i];
+                }
+        } while (n > 1 || n < 1e-6);
+        n = sqrt (n);
+        for (i = 0; i < 4; i++)
+                q[i] /= n;
+}
+
+/*
+ * angle of the rotation from a to b, in degrees, from the chord between
+ * them (b normalised, on a's side), which unlike acos of the dot product
+ * stays accurate for tiny angles
+ */
+static double
+rotation_error (const float *a, const float *b)
+{
+        double n = 0, dot = 0, chord = 0, d;
+        int i;
+
+        for (i = 0; i < 4; i++) {
+                n += (double) b[i] * b[i];
+                dot += (double) a[i] * b[i];
+        }
+        n = (dot < 0 ? -1 : 1) / sqrt (n);
+        for (i = 0; i < 4; i++) {
+                d = a[i] - b[i] * n;
+                chord += d * d;
+        }
+        return 4 * asin (sqrt (chord) / 2) * 180 / M_PI;
+}
+
+static double
+worst (int bits, long samples)
+{
+        struct frame_sample s = { 1, 1, 0, 0, FRAME_QUAT }, d;
+        unsigned char frame[FRAME_MAX];
+        double max = 0, e;
+        long i;
+
+        s.quat_bits = bits;
+        for (i = 0; i < samples; i++) {
+                random_quat (s.quat, i & 1);
+                size_t n = frame_encode (&s, frame);
+                if (frame_decode (frame, n - 1, &d) != 0 || d.quat_bits != bits) {
+                        fprintf (stderr, "%d bits: frame %ld didn't decode\n", bits, i);
+                        exit (1);
+                }
+                e = rotation_error (s.quat, d.quat);
+                if (e > max)
+                        max = e;
+        }
+        return max;
+}
+
+int
+main (int argc, char **argv)
+{
+        long samples = argc > 1 ? atol (argv[1]) : 1000000;
+        int bits;
+
+        srand (1);
+        printf ("bits  bytes  bound deg  measured deg  (%ld samples)\n", samples);
+        for (bits = FRAME_QUAT_BITS_MIN; bits <= FRAME_QUAT_BITS_MAX; bits++)
+                printf ("%4d  %5zu  %9.5f  %12.5f\n", bits, frame_quat_size (bits),
+                        frame_quat_error (bits), worst (bits, samples));
+        printf ("s16   %5d  %9.5f  %12.5f\n", 8, 2.0 / 32767 * 180 / M_PI, worst (0, samples));
+        return 0;
+}
@@ -0,0 +1,125 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE                     /* pthread_setaffinity_np */
+#endif
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "rt.h"
+
+void
+rt_default (struct rt_request *rq)
+{
+        rq->cpu = -1;
+        rq->priority = 0;
+}
+
+int
+rt_parse (const char *s, struct rt_request *rq)
+{
+        char *end;
+
+        rt_default (rq);
+        if (*s != ':') {
+                rq->cpu = strtol (s, &end, 10);
+                if (end == s || rq->cpu < 0)
+                        return -1;
+                s = end;
+        }
+        if (*s == ':') {
+                rq->priority = strtol (s + 1, &end, 10);
+                if (end == s + 1 || rq->priority < 1 || rq->priority > 99)
+                        return -1;
+                s = end;
+        }
+        return *s == '\0' ? 0 : -1;
+}
+
+static int
+apply_cpu (pthread_t thread, int cpu)
+{
+#if defined(__linux__)
+        cpu_set_t set;
+        int err;
+
+        if (cpu >= CPU_SETSIZE) {
+                fprintf (stderr, " cpu %d refused (no such cpu)", cpu);
+                return -1;
+        }
+        CPU_ZERO (&set);
+        CPU_SET (cpu, &set);
+        err = pthread_setaffinity_np (thread, sizeof set, &set);
+        if (err == 0)
+                err = pthread_getaffinity_np (thread, sizeof set, &set);
+        if (err == 0 && (CPU_COUNT (&set) != 1 || !CPU_ISSET (cpu, &set)))
+                err = EINVAL;
+        if (err != 0) {
+                fprintf (stderr, " cpu %d refused (%s)", cpu, strerror (err));
+                return -1;
+        }
+        fprintf (stderr, " cpu %d granted", cpu);
+        return 0;
+#else
+        /* macOS only has affinity tags, which are hints between threads */
+        (void) thread;
+        fprintf (stderr, " cpu %d not supported here", cpu);
+        return -1;
+#endif
+}
+
+static int
+apply_priority (pthread_t thread, int priority)
+{
+        struct sched_param sp;
+        int policy, err;
+
+        memset (&sp, 0, sizeof sp);
+        sp.sched_priority = priority;
+        err = pthread_setschedparam (thread, SCHED_FIFO, &sp);
+        if (err == 0)
+                err = pthread_getschedparam (thread, &policy, &sp);
+        if (err == 0 && (policy != SCHED_FIFO || sp.sched_priority != priority))
+                err = EPERM;
+        if (err != 0) {
+                fprintf (stderr, " SCHED_FIFO %d refused (%s%s)", priority, strerror (err),
+                         err == EPERM ? "; needs CAP_SYS_NICE or ulimit -r" : "");
+                return -1;
+        }
+        fprintf (stderr, " SCHED_FIFO %d granted", priority);
+        return 0;
+}
+
+int
+rt_apply (pthread_t thread, const char *name, const struct rt_request *rq)
+{
+        int r = 0;
+
+        if (rq->cpu < 0 && rq->priority <= 0)
+                return 0;
+
+        fprintf (stderr, "%s:", name);
+        if (rq->cpu >= 0 && apply_cpu (thread, rq->cpu) != 0)
+                r = -1;
+        if (rq->cpu >= 0 && rq->priority > 0)
+                fprintf (stderr, ",");
+        if (rq->priority > 0 && apply_priority (thread, rq->priority) != 0)
+                r = -1;
+        fprintf (stderr, "\n");
+        return r;
+}
+
+int
+rt_lock_memory (void)
+{
+        if (mlockall (MCL_CURRENT | MCL_FUTURE) != 0) {
+                fprintf (stderr, "memory: mlockall refused (%s%s)\n", strerror (errno),
+                         errno == ENOMEM || errno == EPERM ? "; raise ulimit -l" : "");
+                return -1;
+        }
+        fprintf (stderr, "memory: locked\n");
+        return 0;
+}
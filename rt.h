@@ -0,0 +1,47 @@
+/*
+ * Real-time scheduling, CPU affinity and memory locking for the threads
+ * that must not be preempted: acquisition, the serial writer, the logger.
+ *
+ *      struct rt_request rq;
+ *      rt_parse ("2:80", &rq);         // core 2, SCHED_FIFO priority 80
+ *      rt_apply (thread, "acquisition", &rq);
+ *      ...start every thread, then
+ *      rt_lock_memory ();
+ *
+ * Everything is best effort. Each call reads back what the kernel actually
+ * granted and reports it on stderr; a refused request leaves the thread
+ * running as it was. SCHED_FIFO needs CAP_SYS_NICE or an rtprio limit
+ * (ulimit -r), mlockall a memlock limit (ulimit -l) covering the process.
+ */
+
+#ifndef RT_H
+#define RT_H
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rt_request {
+        int     cpu;                    /* core to pin to, -1 to leave alone */
+        int     priority;               /* SCHED_FIFO 1..99, 0 to leave alone */
+};
+
+/* nothing requested */
+void rt_default (struct rt_request *rq);
+
+/* parses "cpu", "cpu:priority" or ":priority", returns -1 if malformed */
+int rt_parse (const char *s, struct rt_request *rq);
+
+/* applies rq to thread and reports as name, returns -1 if anything was refused */
+int rt_apply (pthread_t thread, const char *name, const struct rt_request *rq);
+
+/* mlockall of everything mapped now and later, returns -1 if refused */
+int rt_lock_memory (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,50 +1,337 @@
 #include <errno.h>
-#include <fcntl.h> 
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <termios.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
+
+#if defined(__APPLE__)
+#include <IOKit/serial/ioss.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/serial.h>
+#endif
+
+#include "serial.h"
+
+#if defined(__linux__)
+/*
+ * <asm/termbits.h> can't be included next to <termios.h>, so mirror the
+ * kernel's struct termios2 here; TCGETS2/TCSETS2 come from <sys/ioctl.h>.
+ */
+struct termios2 {
+        tcflag_t c_iflag;
+        tcflag_t c_oflag;
+        tcflag_t c_cflag;
+        tcflag_t c_lflag;
+        cc_t     c_line;
+        cc_t     c_cc[19];
+        speed_t  c_ispeed;
+        speed_t  c_ospeed;
+};
+#ifndef BOTHER
+#define BOTHER  0010000
+#endif
+#ifndef IBSHIFT
+#define IBSHIFT 16
+#endif
+#endif
+
+static const struct {
+        int     rate;
+        speed_t code;
+} std_rates[] = {
+        { 50, B50 }, { 75, B75 }, { 110, B110 }, { 134, B134 }, { 150, B150 },
+        { 200, B200 }, { 300, B300 }, { 600, B600 }, { 1200, B1200 },
+        { 1800, B1800 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 },
+        { 19200, B19200 }, { 38400, B38400 },
+#ifdef B57600
+        { 57600, B57600 },
+#endif
+#ifdef B115200
+        { 115200, B115200 },
+#endif
+#ifdef B230400
+        { 230400, B230400 },
+#endif
+#ifdef B460800
+        { 460800, B460800 },
+#endif
+#ifdef B921600
+        { 921600, B921600 },
+#endif
+};
+
+/* the Bxxxx constant for rate, or B0 if there isn't one */
+static speed_t
+std_rate_code (int rate)
+{
+        size_t i;
+        for (i = 0; i < sizeof std_rates / sizeof std_rates[0]; i++)
+                if (std_rates[i].rate == rate)
+                        return std_rates[i].code;
+        return B0;
+}
+
+void
+serial_default_config (struct serial_config *cfg)
+{
+        cfg->baud = 9600;
+        cfg->data_bits = 8;
+        cfg->parity = 'N';
+        cfg->stop_bits = 1;
+        cfg->flow = SERIAL_FLOW_NONE;
+        cfg->vmin = 1;
+        cfg->vtime = 0;
+        cfg->raw = 1;
+        cfg->low_latency = 0;
+}
 
 int
-set_interface_attribs (int fd, int speed, int parity)
+serial_parse_framing (const char *s, struct serial_config *cfg)
+{
+        if (strlen (s) != 3 || s[0] < '5' || s[0] > '8')
+                return -1;
+        if (s[1] != 'N' && s[1] != 'E' && s[1] != 'O'
+            && s[1] != 'n' && s[1] != 'e' && s[1] != 'o')
+                return -1;
+        if (s[2] != '1' && s[2] != '2')
+                return -1;
+
+        cfg->data_bits = s[0] - '0';
+        cfg->parity = s[1] & ~0x20;     // upper case
+        cfg->stop_bits = s[2] - '0';
+        return 0;
+}
+
+int
+serial_parse_flow (const char *s, struct serial_config *cfg)
+{
+        if (strcmp (s, "none") == 0)
+                cfg->flow = SERIAL_FLOW_NONE;
+        else if (strcmp (s, "rtscts") == 0)
+                cfg->flow = SERIAL_FLOW_RTSCTS;
+        else if (strcmp (s, "xonxoff") == 0)
+                cfg->flow = SERIAL_FLOW_XONXOFF;
+        else
+                return -1;
+        return 0;
+}
+
+int
+serial_set_baud (int fd, int baud)
+{
+        speed_t code = std_rate_code (baud);
+        struct termios tty;
+
+        if (baud <= 0) {
+                errno = EINVAL;
+                return -1;
+        }
+
+        if (code != B0) {
+                if (tcgetattr (fd, &tty) != 0)
+                        return -1;
+                cfsetospeed (&tty, code);
+                cfsetispeed (&tty, code);
+                return tcsetattr (fd, TCSANOW, &tty);
+        }
+
+#if defined(__linux__)
+        {
+                struct termios2 tio;
+                if (ioctl (fd, TCGETS2, &tio) != 0)
+                        return -1;
+                tio.c_cflag &= ~CBAUD;
+                tio.c_cflag |= BOTHER;
+                tio.c_cflag &= ~(CBAUD << IBSHIFT);
+                tio.c_cflag |= BOTHER << IBSHIFT;
+                tio.c_ispeed = baud;
+                tio.c_ospeed = baud;
+                return ioctl (fd, TCSETS2, &tio);
+        }
+#elif defined(__APPLE__)
+        {
+                speed_t speed = baud;
+                return ioctl (fd, IOSSIOSPEED, &speed);
+        }
+#else
+        errno = EINVAL;
+        return -1;
+#endif
+}
+
+#if defined(__linux__)
+/*
+ * The latency_timer of the USB adapter behind fd, e.g.
+ * /sys/class/tty/ttyUSB0/device/latency_timer. Only FTDI-style drivers
+ * have one; for anything else the path simply doesn't exist.
+ */
+static int
+latency_timer_path (int fd, char *path, size_t size)
+{
+        const char *name = ttyname (fd);
+        const char *base;
+
+        if (!name)
+                return -1;
+        base = strrchr (name, '/');
+        base = base ? base + 1 : name;
+        snprintf (path, size, "/sys/class/tty/%s/device/latency_timer", base);
+        return 0;
+}
+
+static int
+read_latency_timer (int fd)
+{
+        char path[128], buf[16];
+        int tfd, n;
+
+        if (latency_timer_path (fd, path, sizeof path) != 0)
+                return -1;
+        tfd = open (path, O_RDONLY);
+        if (tfd < 0)
+                return -1;
+        n = read (tfd, buf, sizeof buf - 1);
+        close (tfd);
+        if (n <= 0)
+                return -1;
+        buf[n] = '\0';
+        return atoi (buf);
+}
+
+static void
+write_latency_timer (int fd, int ms)
+{
+        char path[128], buf[16];
+        int tfd, n;
+
+        if (latency_timer_path (fd, path, sizeof path) != 0)
+                return;
+        tfd = open (path, O_WRONLY);
+        if (tfd < 0)
+                return;
+        n = snprintf (buf, sizeof buf, "%d\n", ms);
+        if (write (tfd, buf, n) != n)
+                fprintf (stderr, "error %d writing %s\n", errno, path);
+        close (tfd);
+}
+
+/* best effort, see serial_configure */
+static void
+set_low_latency (int fd)
+{
+        struct serial_struct ss;
+
+        if (ioctl (fd, TIOCGSERIAL, &ss) == 0) {
+                ss.flags |= ASYNC_LOW_LATENCY;
+                ioctl (fd, TIOCSSERIAL, &ss);
+        }
+        write_latency_timer (fd, 1);
+}
+#endif
+
+void
+serial_get_latency (int fd, struct serial_latency *lat)
+{
+        lat->async_low_latency = -1;
+        lat->timer_ms = -1;
+#if defined(__linux__)
+        {
+                struct serial_struct ss;
+                if (ioctl (fd, TIOCGSERIAL, &ss) == 0)
+                        lat->async_low_latency = (ss.flags & ASYNC_LOW_LATENCY) != 0;
+                lat->timer_ms = read_latency_timer (fd);
+        }
+#endif
+}
+
+int
+serial_configure (int fd, const struct serial_config *cfg)
 {
         struct termios tty;
         memset (&tty, 0, sizeof tty);
         if (tcgetattr (fd, &tty) != 0)
         {
-                error_message ("error %d from tcgetattr", errno);
+                fprintf (stderr, "error %d from tcgetattr\n", errno);
                 return -1;
         }
 
-        cfsetospeed (&tty, speed);
-        cfsetispeed (&tty, speed);
-
-        tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;     // 8-bit chars
-        // disable IGNBRK for mismatched speed tests; otherwise receive break
-        // as \000 chars
-        tty.c_iflag &= ~IGNBRK;         // disable break processing
-        tty.c_lflag = 0;                // no signaling chars, no echo,
-                                        // no canonical processing
-        tty.c_oflag = 0;                // no remapping, no delays
-        tty.c_cc[VMIN]  = 0;            // read doesn't block
-        tty.c_cc[VTIME] = 5;            // 0.5 seconds read timeout
+        if (cfg->raw)
+                cfmakeraw (&tty);
 
-        tty.c_iflag &= ~(IXON | IXOFF | IXANY); // shut off xon/xoff ctrl
+        tty.c_cflag &= ~CSIZE;
+        switch (cfg->data_bits) {
+        case 5: tty.c_cflag |= CS5; break;
+        case 6: tty.c_cflag |= CS6; break;
+        case 7: tty.c_cflag |= CS7; break;
+        default: tty.c_cflag |= CS8; break;
+        }
+
+        tty.c_cflag &= ~(PARENB | PARODD);
+        if (cfg->parity == 'E')
+                tty.c_cflag |= PARENB;
+        else if (cfg->parity == 'O')
+                tty.c_cflag |= PARENB | PARODD;
+
+        if (cfg->stop_bits == 2)
+                tty.c_cflag |= CSTOPB;
+        else
+                tty.c_cflag &= ~CSTOPB;
+
+        tty.c_cflag &= ~CRTSCTS;
+        tty.c_iflag &= ~(IXON | IXOFF | IXANY);
+        if (cfg->flow == SERIAL_FLOW_RTSCTS)
+                tty.c_cflag |= CRTSCTS;
+        else if (cfg->flow == SERIAL_FLOW_XONXOFF)
+                tty.c_iflag |= IXON | IXOFF;
 
         tty.c_cflag |= (CLOCAL | CREAD);// ignore modem controls,
                                         // enable reading
-        tty.c_cflag &= ~(PARENB | PARODD);      // shut off parity
-        tty.c_cflag |= parity;
-        tty.c_cflag &= ~CSTOPB;
-        tty.c_cflag &= ~CRTSCTS;
+        /* VTIME would hold a byte back waiting for the next one */
+        tty.c_cc[VMIN]  = cfg->low_latency ? 1 : cfg->vmin;
+        tty.c_cc[VTIME] = cfg->low_latency ? 0 : cfg->vtime;
 
+        /* a placeholder for now if the rate isn't standard, see below */
+        speed_t code = std_rate_code (cfg->baud);
+        cfsetospeed (&tty, code != B0 ? code : B38400);
+        cfsetispeed (&tty, code != B0 ? code : B38400);
+
+        tcflush (fd, TCIFLUSH);
         if (tcsetattr (fd, TCSANOW, &tty) != 0)
         {
-                error_message ("error %d from tcsetattr", errno);
+                fprintf (stderr, "error %d from tcsetattr\n", errno);
+                return -1;
+        }
+
+        if (code == B0 && serial_set_baud (fd, cfg->baud) != 0)
+        {
+                fprintf (stderr, "error %d setting %d baud\n", errno, cfg->baud);
                 return -1;
         }
+
+#if defined(__linux__)
+        if (cfg->low_latency)
+                set_low_latency (fd);
+#endif
         return 0;
 }
 
+int
+set_interface_attribs (int fd, int speed, int parity)
+{
+        struct serial_config cfg;
+        serial_default_config (&cfg);
+        cfg.baud = speed;
+        cfg.parity = (parity & PARENB) ? ((parity & PARODD) ? 'O' : 'E') : 'N';
+        cfg.vmin = 0;                   // read doesn't block
+        cfg.vtime = 5;                  // 0.5 seconds read timeout
+        return serial_configure (fd, &cfg);
+}
+
 void
 set_blocking (int fd, int should_block)
 {
@@ -52,7 +339,7 @@ set_blocking (int fd, int should_block)
         memset (&tty, 0, sizeof tty);
         if (tcgetattr (fd, &tty) != 0)
         {
-                error_message ("error %d from tggetattr", errno);
+                fprintf (stderr, "error %d from tggetattr\n", errno);
                 return;
         }
 
@@ -60,26 +347,5 @@ set_blocking (int fd, int should_block)
         tty.c_cc[VTIME] = 5;            // 0.5 seconds read timeout
 
         if (tcsetattr (fd, TCSANOW, &tty) != 0)
-                error_message ("error %d setting term attributes", errno);
-}
-
-
-...
-char *portname = "/dev/ttyUSB1"
- ...
-int fd = open (portname, O_RDWR | O_NOCTTY | O_SYNC);
-if (fd < 0)
-{
-        error_message ("error %d opening %s: %s", errno, portname, strerror (errno));
-        return;
+                fprintf (stderr, "error %d setting term attributes\n", errno);
 }
-
-set_interface_attribs (fd, B115200, 0);  // set speed to 115,200 bps, 8n1 (no parity)
-set_blocking (fd, 0);                // set no blocking
-
-write (fd, "hello!\n", 7);           // send 7 character greeting
-
-usleep ((7 + 25) * 100);             // sleep enough to transmit the 7 plus
-                                     // receive 25:  approx 100 uS per char transmit
-char buf [100];
-int n = read (fd, buf, sizeof buf);  // read up to 100 characters if ready to read
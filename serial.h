@@ -0,0 +1,85 @@
+/*
+ * Serial port configuration shared by main.cpp and test/main.c.
+ *
+ * Example, 115200 8N1 raw with a non-blocking read:
+ *
+ *      int fd = open ("/dev/ttyUSB1", O_RDWR | O_NOCTTY | O_SYNC);
+ *      struct serial_config cfg;
+ *      serial_default_config (&cfg);
+ *      cfg.baud = 115200;
+ *      cfg.vmin = 0;
+ *      cfg.vtime = 5;           // 0.5 seconds read timeout
+ *      serial_configure (fd, &cfg);
+ */
+
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum serial_flow {
+        SERIAL_FLOW_NONE,
+        SERIAL_FLOW_RTSCTS,             /* hardware */
+        SERIAL_FLOW_XONXOFF             /* software */
+};
+
+struct serial_config {
+        int     baud;                   /* any integer rate, not a Bxxxx constant */
+        int     data_bits;              /* 5..8 */
+        char    parity;                 /* 'N', 'E' or 'O' */
+        int     stop_bits;              /* 1 or 2 */
+        enum serial_flow flow;
+        int     vmin;                   /* VMIN/VTIME as in termios(3) */
+        int     vtime;
+        int     raw;                    /* no echo, signals or byte mangling */
+        int     low_latency;            /* hand bytes over as soon as they arrive,
+                                           see serial_configure */
+};
+
+/* the driver-side latency settings of a port, for reporting */
+struct serial_latency {
+        int     async_low_latency;      /* 1 on, 0 off, -1 can't tell (a PTY, not Linux) */
+        int     timer_ms;               /* USB adapter latency_timer, -1 if it has none */
+};
+
+/* 9600 8N1, no flow control, raw, read blocks for at least one byte */
+void serial_default_config (struct serial_config *cfg);
+
+/* parses "8N1"-style framing into cfg, returns -1 if malformed */
+int serial_parse_framing (const char *s, struct serial_config *cfg);
+
+/* parses "none", "rtscts" or "xonxoff", returns -1 if unknown */
+int serial_parse_flow (const char *s, struct serial_config *cfg);
+
+/*
+ * Applies cfg to fd and flushes pending input. Rates without a Bxxxx
+ * constant go through termios2/BOTHER on Linux and IOSSIOSPEED on macOS.
+ *
+ * With low_latency set, reads are VMIN 1/VTIME 0 whatever cfg says, the
+ * driver is asked for ASYNC_LOW_LATENCY (TIOCSSERIAL) and a USB adapter's
+ * latency_timer in sysfs is dropped to 1 ms (FTDI defaults to 16). Those
+ * last two need a real UART and usually root; when they are refused the
+ * port still works, check serial_get_latency for what stuck.
+ *
+ * Returns 0 on success, -1 with errno set otherwise.
+ */
+int serial_configure (int fd, const struct serial_config *cfg);
+
+/* fills lat with fd's current driver-side latency settings */
+void serial_get_latency (int fd, struct serial_latency *lat);
+
+/* changes only the baud rate, see serial_configure */
+int serial_set_baud (int fd, int baud);
+
+/* 8N1 raw at speed (an integer rate) with parity flags PARENB/PARODD or 0 */
+int set_interface_attribs (int fd, int speed, int parity);
+
+void set_blocking (int fd, int should_block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
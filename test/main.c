@@ -15,51 +15,486 @@
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <math.h>
 
 #include "isense.h"
+#include "txqueue.h"
+#include "outloop.h"
+#include "ports.h"
+#include "spsc.h"
+#include "../serial.h"
+#include "../rt.h"
+#include "../frame.h"
+#include "../fmt.h"
+#include "../osc.h"
+#include "../pace.h"
+#include "plan.h"
+
+void usage(char* cmd) {
+  fprintf(stderr, "usage: %s [-b baud] [-f 8N1] [-c none|rtscts|xonxoff] [-l] [-p drop|coalesce|block] [-q depth] [-i plain|uring] [-m portmap.ini]\n"
+          "       [-e ascii|binary|delta|osc] [-F euler,quat,pos,angvel,accel,time] [-d field=decimals,...]\n"
+          "       [-Q bits] [-R degrees[,meters]] [-K frames] [-U host:port] [-O /prefix] [-P percent]\n"
+          "       [-A cpu[:prio]] [-W cpu[:prio]] [-M]\n", cmd);
+  fprintf(stderr, "  -b  any integer baud rate (default 38400)\n");
+  fprintf(stderr, "  -f  data bits, parity and stop bits (default 8N1)\n");
+  fprintf(stderr, "  -c  flow control (default none)\n");
+  fprintf(stderr, "  -l  low latency: no driver batching, 1 ms USB latency timer\n");
+  fprintf(stderr, "  -p  what to do when the serial link falls behind (default: drop oldest)\n");
+  fprintf(stderr, "  -q  frames to queue before the policy kicks in (default: %d)\n", TXQ_SLOTS);
+  fprintf(stderr, "  -i  how the writer talks to the port (default: plain write())\n");
+  fprintf(stderr, "  -m  send several stations out of several ports, see forward.ini\n");
+  fprintf(stderr, "      (default: tracker 1 station 1 to /dev/ttys004)\n");
+  fprintf(stderr, "  -e  ascii: comma separated lines ending in CRLF (default)\n");
+  fprintf(stderr, "      binary: COBS framed, CRC'd fixed-point samples, see frame.h\n");
+  fprintf(stderr, "      delta: keyframes plus quantized changes, for several stations on one slow link\n");
+  fprintf(stderr, "      osc: SLIP framed OSC bundles, a message per field\n");
+  fprintf(stderr, "  -F  fields to send (default: euler,pos)\n");
+  fprintf(stderr, "  -d  decimals per field in ascii lines, 0-%d\n", FMT_DECIMALS_MAX);
+  fprintf(stderr, "      (default: euler=2,quat=4,pos=3,angvel=3,accel=3,time=3)\n");
+  fprintf(stderr, "  -Q  binary quaternions packed smallest-three at %d-%d bits a component\n",
+          FRAME_QUAT_BITS_MIN, FRAME_QUAT_BITS_MAX);
+  fprintf(stderr, "      (default: four 16 bit components)\n");
+  fprintf(stderr, "  -R  delta resolution of angles and optionally positions (default: 0.01,0.0001)\n");
+  fprintf(stderr, "  -K  delta frames from one keyframe to the next (default: 180)\n");
+  fprintf(stderr, "  -U  also send every station's OSC bundles as UDP datagrams to host:port\n");
+  fprintf(stderr, "  -O  OSC addresses are /prefix/<n>/<field>, n counting stations in map order\n");
+  fprintf(stderr, "      (default: /ic4)\n");
+  fprintf(stderr, "  -P  fill at most this much of each serial link, giving up precision, fields\n");
+  fprintf(stderr, "      and then rate as needed, see plan.h (default: 90, 0 sends everything)\n");
+  fprintf(stderr, "  -A  pin the acquisition thread to a core and/or run it SCHED_FIFO at prio\n");
+  fprintf(stderr, "      (it sleeps until each record is due, so SCHED_FIFO mostly buys wakeup latency)\n");
+  fprintf(stderr, "  -W  same for the serial writer thread\n");
+  fprintf(stderr, "  -M  mlockall, so no page faults once running\n");
+  exit(1);
+}
+
+//==================================================================================================
+// acquisition thread: polls the trackers and hands every new station record to the output side
+// through a lock-free ring, so nothing downstream (formatting, the console, a stuck port) can
+// make it late
+//==================================================================================================
+
+typedef struct {
+  ISD_TRACKER_HANDLE* handles;
+  int ntrackers;
+  const port_map* map;
+  int nports;
+  spsc_ring* ring;
+  spsc_latest* latest;    // one per port
+  int extended;           // someone wants rates or accelerations, fill in pose_extended too
+  volatile int running;
+  volatile float kbits;   // ISD_GetCommInfo of the first port's tracker, for the status line
+  volatile int records;
+  volatile int rate[ISD_MAX_TRACKERS];  // RecordsPerSec of every tracker polled, for the planner
+  struct pace pace[ISD_MAX_TRACKERS];   // when to poll each, see pace.h
+} acquisition;
+
+// only the trackers someone is listening to get polled
+static int polled(const acquisition* a, int t) {
+  int p;
+  for (p = 0; p < a->nports && a->map[p].tracker != t; p++)
+    ;
+  return p < a->nports;
+}
+
+// every tracker is polled just after its next record is due rather than flat out, see pace.h
+static void* acquire_thread(void* arg) {
+  acquisition* a = (acquisition*)arg;
+  static ISD_TRACKING_DATA_TYPE data;
+  ISD_TRACKER_INFO_TYPE info;
+  struct pose_sample s;
+  struct pose_extended x;
+  int t, p, q;
+
+  memset(&s, 0, sizeof(s));
+  for (t = 1; t <= a->ntrackers; t++) pace_init(&a->pace[t-1], 0);
+  while (a->running) {
+    double due = -1;
+    for (t = 1; t <= a->ntrackers; t++)
+      if (polled(a, t) && (due < 0 || a->pace[t-1].due < due)) due = a->pace[t-1].due;
+    pace_sleep_until(due);
+
+    double now = pace_now();
+    for (t = 1; t <= a->ntrackers; t++) {
+      if (!polled(a, t) || a->pace[t-1].due > now) continue;
+
+      int fresh = 0;
+      double newest = 0;
+      ISD_GetTrackingData(a->handles[t-1], &data);
+      for (p = 0; p < a->nports; p++) {
+        if (a->map[p].tracker != t) continue;
+        ISD_STATION_DATA_TYPE* st = &data.Station[a->map[p].station-1];
+        if (!st->NewData) continue;
+        if (!fresh || pose_station_time(st) > newest) newest = pose_station_time(st);
+        fresh = 1;
+
+        pose_from_station(&s, a->extended ? &x : NULL, t, a->map[p].station, st);
+        spsc_latest_store(&a->latest[p], &s);
+
+        // a station sent out of several ports goes through the ring once, the consumer fans it out
+        for (q = 0; q < p; q++)
+          if (a->map[q].tracker == t && a->map[q].station == a->map[p].station) break;
+        if (q == p) spsc_push(a->ring, &s, &x);
+      }
+
+      ISD_GetCommInfo(a->handles[t-1], &info);
+      a->rate[t-1] = info.RecordsPerSec;
+      if (t == a->map[0].tracker) {
+        a->kbits = info.KBitsPerSec;
+        a->records = info.RecordsPerSec;
+      }
+      pace_set_rate(&a->pace[t-1], info.RecordsPerSec);
+      pace_update(&a->pace[t-1], fresh, newest);
+      pace_account(&a->pace[t-1]);
+    }
+  }
+  return NULL;
+}
+
+//==================================================================================================
+// text output, for consumers like Max that want lines: the selected fields comma separated and
+// CRLF terminated, the timestamp first, at most 16 * (FMT_FIXED_MAX + 1) + 1 bytes
+//==================================================================================================
+
+#define NFIELDS 6
+static const char* field_names[NFIELDS] = { "euler", "quat", "pos", "angvel", "accel", "time" };  // FRAME_* bit order
+static const int field_floats[NFIELDS] = { 3, 4, 3, 3, 3, 1 };
+
+static size_t ascii_line(char* out, const struct pose_sample* s, const struct pose_extended* x,
+                         unsigned fields, const int* decimals) {
+  char* p = out;
+  if (fields & FRAME_TIME) p = fmt_fixed_n(p, &s->time, 1, decimals[5], ',');
+  if (fields & FRAME_EULER) p = fmt_fixed_n(p, s->euler, 3, decimals[0], ',');
+  if (fields & FRAME_QUAT) p = fmt_fixed_n(p, s->quat, 4, decimals[1], ',');
+  if (fields & FRAME_POSITION) p = fmt_fixed_n(p, s->position, 3, decimals[2], ',');
+  if (fields & FRAME_ANGVEL) p = fmt_fixed_n(p, x->angvel, 3, decimals[3], ',');
+  if (fields & FRAME_ACCEL) p = fmt_fixed_n(p, x->accel, 3, decimals[4], ',');
+  p[-1] = '\r';
+  *p++ = '\n';
+  return p - out;
+}
+
+//==================================================================================================
+// OSC output: a bundle per sample with a message per field, /ic4/1/euler fff and so on. the
+// address and type tags are laid out once per station and field
+//==================================================================================================
+
+#define OSC_PACKET_MAX (OSC_BUNDLE_HEAD + NFIELDS * OSC_MESSAGE_MAX)
+
+static const float* sample_field(const struct pose_sample* s, const struct pose_extended* x, int f) {
+  switch (f) {
+  case 0: return s->euler;
+  case 1: return s->quat;
+  case 2: return s->position;
+  case 3: return x->angvel;
+  case 4: return x->accel;
+  default: return &s->time;
+  }
+}
+
+static int osc_templates(struct osc_template* t, const char* prefix, int n) {
+  char address[OSC_ADDRESS_MAX + 16];
+  int f;
+  for (f = 0; f < NFIELDS; f++) {
+    snprintf(address, sizeof(address), "%s/%d/%s", prefix, n, field_names[f]);
+    if (osc_template_init(&t[f], address, field_floats[f]) != 0) return -1;
+  }
+  return 0;
+}
+
+static size_t osc_packet(unsigned char* out, const struct osc_template* t, const struct pose_sample* s,
+                         const struct pose_extended* x, unsigned fields) {
+  struct osc_bundle b;
+  int f;
+  osc_bundle_begin(&b, out, OSC_PACKET_MAX);
+  for (f = 0; f < NFIELDS; f++)
+    if (fields & (1u << f)) osc_bundle_add(&b, &t[f], sample_field(s, x, f));
+  return b.len;
+}
+
+//==================================================================================================
+// link budget: each link gets the most of what was asked for that its baud rate can carry for
+// the records its stations make, see plan.h
+//==================================================================================================
+
+#define ASSUMED_RATE 180  // records/s a station makes until its tracker says, an IC4's rate
+
+// refits every link whose record rate moved by more than a tenth, rate per tracker (0: unknown).
+// prints the new plans, each after lead
+static void replan(plan_link* budget, plan_format* plan, const plan_format* want, int nlinks,
+                   const port_map* map, const int* link, int nports, const int* rate,
+                   const char* lead) {
+  int l, p;
+  for (l = 0; l < nlinks; l++) {
+    double records = 0;
+    for (p = 0; p < nports; p++)
+      if (link[p] == l) records += rate[map[p].tracker-1] > 0 ? rate[map[p].tracker-1] : ASSUMED_RATE;
+    if (budget[l].records > 0 && fabs(records - budget[l].records) <= 0.1 * budget[l].records)
+      continue;
+
+    budget[l].records = records;
+    plan_fit(&budget[l], want, &plan[l]);
+    for (p = 0; link[p] != l; p++)
+      ;
+    printf("%s", lead);
+    plan_print(stdout, map[p].device, &budget[l], want, &plan[l]);
+  }
+}
+
+// "euler=2,pos=4": decimals per field, the rest keep theirs
+static int parse_decimals(const char* s, int* decimals) {
+  while (*s) {
+    size_t n = strcspn(s, "=");
+    char* end;
+    int i;
+    for (i = 0; i < NFIELDS; i++)
+      if (strlen(field_names[i]) == n && strncmp(s, field_names[i], n) == 0) break;
+    if (i == NFIELDS || s[n] != '=') return -1;
+
+    long d = strtol(s + n + 1, &end, 10);
+    if (end == s + n + 1 || d < 0 || d > FMT_DECIMALS_MAX) return -1;
+    decimals[i] = d;
+    s = end;
+    if (*s == ',') s++;
+    else if (*s) return -1;
+  }
+  return 0;
+}
+
+// "0.01" or "0.01,0.0001": delta resolution of angles in degrees, and of positions in meters.
+// quaternion components get about the same angular resolution
+static int parse_resolution(const char* s, float* res) {
+  char* end;
+  float deg = strtof(s, &end);
+  if (end == s || deg <= 0) return -1;
+  res[0] = deg;
+  res[1] = deg * 3.14159265f / 180.0f / 2.0f;
+  if (*end == ',') {
+    s = end + 1;
+    float m = strtof(s, &end);
+    if (end == s || m <= 0) return -1;
+    res[2] = m;
+  }
+  return *end ? -1 : 0;
+}
+
+int main(int argc, char** argv) {
+  txq_policy policy = TXQ_DROP_OLDEST;
+  int depth = TXQ_SLOTS;
+  enum iob_backend backend = IOB_PLAIN;
+  const char* mapfile = NULL;
+  struct rt_request acq_rt, writer_rt;
+  int lock_memory = 0;
+  const char* osc_prefix = "/ic4";
+  const char* udp_dest = NULL;
+  int headroom = 90;
+  plan_format want = { PLAN_ASCII, FRAME_EULER | FRAME_POSITION, { 2, 4, 3, 3, 3, 3 } };
+  want.key_every = 180;
+  frame_delta_default_res(want.resolution);
+  rt_default(&acq_rt);
+  rt_default(&writer_rt);
+  struct serial_config cfg;
+  serial_default_config(&cfg);
+  cfg.baud = 38400;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:f:c:lp:q:i:m:e:F:d:Q:R:K:U:O:P:A:W:M")) != -1) {
+    switch (opt) {
+    case 'b':
+      cfg.baud = atoi(optarg);
+      if (cfg.baud <= 0) usage(argv[0]);
+      break;
+    case 'f':
+      if (serial_parse_framing(optarg, &cfg) != 0) usage(argv[0]);
+      break;
+    case 'c':
+      if (serial_parse_flow(optarg, &cfg) != 0) usage(argv[0]);
+      break;
+    case 'l':
+      cfg.low_latency = 1;
+      break;
+    case 'p':
+      if (txq_parse_policy(optarg, &policy) != 0) usage(argv[0]);
+      break;
+    case 'q':
+      depth = atoi(optarg);
+      break;
+    case 'i':
+      if (iob_parse_backend(optarg, &backend) != 0) usage(argv[0]);
+      break;
+    case 'm':
+      mapfile = optarg;
+      break;
+    case 'e':
+      if (strcmp(optarg, "binary") == 0) want.encoding = PLAN_BINARY;
+      else if (strcmp(optarg, "delta") == 0) want.encoding = PLAN_DELTA;
+      else if (strcmp(optarg, "osc") == 0) want.encoding = PLAN_OSC;
+      else if (strcmp(optarg, "ascii") == 0) want.encoding = PLAN_ASCII;
+      else usage(argv[0]);
+      break;
+    case 'F':
+      if (frame_parse_fields(optarg, &want.fields) != 0) usage(argv[0]);
+      break;
+    case 'Q':
+      want.quat_bits = atoi(optarg);
+      if (want.quat_bits < FRAME_QUAT_BITS_MIN || want.quat_bits > FRAME_QUAT_BITS_MAX) usage(argv[0]);
+      break;
+    case 'R':
+      if (parse_resolution(optarg, want.resolution) != 0) usage(argv[0]);
+      break;
+    case 'K':
+      want.key_every = atoi(optarg);
+      if (want.key_every < 1) usage(argv[0]);
+      break;
+    case 'U':
+      udp_dest = optarg;
+      break;
+    case 'O':
+      osc_prefix = optarg;
+      break;
+    case 'P':
+      headroom = atoi(optarg);
+      if (headroom < 0 || headroom > 100) usage(argv[0]);
+      break;
+    case 'd':
+      if (parse_decimals(optarg, want.decimals) != 0) usage(argv[0]);
+      break;
+    case 'A':
+      if (rt_parse(optarg, &acq_rt) != 0) usage(argv[0]);
+      break;
+    case 'W':
+      if (rt_parse(optarg, &writer_rt) != 0) usage(argv[0]);
+      break;
+    case 'M':
+      lock_memory = 1;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  want.osc_prefix_len = strlen(osc_prefix);
+  want.decimate = 1;
 
-int main() {
   int fd = posix_openpt(O_RDWR | O_NOCTTY);
   printf("%s\n", ptsname(fd));
-  
-  int serial = open("/dev/ttys004", O_RDWR| O_NOCTTY | O_NDELAY /*| O_SYNC */);
-  struct termios tty;
-  struct termios tty_old;
-  memset (&tty, 0, sizeof(tty));
-  if (tcgetattr(serial, &tty) != 0) {
-    //printf("Error" + errno + " from tcgetattr: " + strerror(errorno) + endl);
-    printf("you may need to elevate privileges\n");
-  }
-  tty_old = tty;
-  cfsetospeed(&tty, (speed_t)B38400);
-  cfsetispeed(&tty, (speed_t)B38400);
-  tty.c_cflag     &=  ~PARENB;            // Make 8n1
-  tty.c_cflag     &=  ~CSTOPB;
-  tty.c_cflag     &=  ~CSIZE;
-  tty.c_cflag     |=  CS8;
-
-  tty.c_cflag     &=  ~CRTSCTS;           // no flow control
-  tty.c_cc[VMIN]   =  1;                  // read doesn't block
-  tty.c_cc[VTIME]  =  5;                  // 0.5 seconds read timeout
-  tty.c_cflag     |=  CREAD | CLOCAL;     // turn on READ & ignore ctrl lines
-
-  cfmakeraw(&tty);
-
-  tcflush(serial, TCIFLUSH);
-  if (tcsetattr(serial, TCSANOW, &tty) != 0) {
-    printf("you definitely need to elevate privileges\n" );
-    //std::cout << "Error " << " from tcsetattr" << setd::endl;
+
+  // without a map, tracker 1 station 1 goes out of the one port we've always used
+  port_map map[OUTLOOP_MAX_PORTS];
+  int nports = 1;
+  int p, q;
+  if (mapfile) {
+    nports = ports_load(mapfile, map, OUTLOOP_MAX_PORTS);
+    if (nports < 1) return -1;
+  } else {
+    strcpy(map[0].device, "/dev/ttys004");
+    map[0].tracker = 1;
+    map[0].station = 1;
+  }
+
+  static struct osc_template osc[OUTLOOP_MAX_PORTS][NFIELDS];
+  for (p = 0; p < nports; p++) {
+    if (osc_templates(osc[p], osc_prefix, p + 1) != 0) {
+      printf("OSC prefix %s is too long\n", osc_prefix);
+      return -1;
+    }
+  }
+  // every bundle has to fit the queue's frames SLIP escaped at worst. float bytes 0xc0 and 0xdb are
+  // common (any -2.x starts with 0xc0), so count every byte of every float as escaped, on top of
+  // what escaping the addresses and type tags takes: that's the bundle of zeros, escaped
+  struct pose_sample probe;
+  struct pose_extended probe_ext;
+  memset(&probe, 0, sizeof(probe));
+  memset(&probe_ext, 0, sizeof(probe_ext));
+  unsigned char packet[OSC_PACKET_MAX];
+  unsigned char wire[OSC_SLIP_MAX(OSC_PACKET_MAX)];
+  int floats = 0, f;
+  for (f = 0; f < NFIELDS; f++)
+    if (want.fields & (1u << f)) floats += field_floats[f];
+  for (p = 0; p < nports && want.encoding == PLAN_OSC; p++) {
+    size_t n = osc_packet(packet, osc[p], &probe, &probe_ext, want.fields);
+    if (osc_slip_encode(packet, n, wire) + 4 * floats > TXQ_FRAME_MAX) {
+      printf("too many fields for one OSC bundle on serial, send fewer or use -U\n");
+      return -1;
+    }
+  }
+  int udp = -1;
+  if (udp_dest && (udp = osc_udp_open(udp_dest)) < 0) return -1;
+
+  // everything written to serial goes through a queue per device, served by one output thread,
+  // so acquisition never waits on the wire and one slow receiver can't hold up the others.
+  // stations sent out of the same device share its queue
+  static txqueue tx[OUTLOOP_MAX_PORTS];
+  txqueue* txp[OUTLOOP_MAX_PORTS];
+  int link[OUTLOOP_MAX_PORTS];  // map entry -> its device's queue
+  int slot[OUTLOOP_MAX_PORTS];  // map entry -> its place among the stations on that device
+  int nlinks = 0;
+  for (p = 0; p < nports; p++) {
+    for (q = 0; q < p && strcmp(map[q].device, map[p].device) != 0; q++)
+      ;
+    printf("Tracker%d.Station%d -> %s\n", map[p].tracker, map[p].station, map[p].device);
+    if (q < p) {
+      link[p] = link[q];
+      for (slot[p] = 0, q = 0; q < p; q++)
+        if (link[q] == link[p]) slot[p]++;
+      if (slot[p] >= FRAME_SLOTS) {
+        printf("at most %d stations per device\n", FRAME_SLOTS);
+        return -1;
+      }
+      continue;
+    }
+    link[p] = nlinks++;
+    slot[p] = 0;
+
+    int serial = open(map[p].device, O_RDWR| O_NOCTTY | O_NDELAY /*| O_SYNC */);
+    if (serial < 0 || serial_configure(serial, &cfg) != 0) {
+      printf("couldn't set up %s, you may need to elevate privileges\n", map[p].device);
+      return -1;
+    }
+    if (txq_init(&tx[link[p]], serial, policy, depth, cfg.baud, backend) != 0) {
+      printf("couldn't set up the queue for %s\n", map[p].device);
+      return -1;
+    }
+    txp[link[p]] = &tx[link[p]];
+    if (cfg.low_latency) {
+      // the driver may refuse either knob (no root, not a USB adapter), say what we got
+      struct serial_latency lat;
+      serial_get_latency(serial, &lat);
+      printf("  ASYNC_LOW_LATENCY %s, latency_timer ",
+             lat.async_low_latency < 0 ? "n/a" : lat.async_low_latency ? "on" : "off");
+      if (lat.timer_ms < 0) printf("n/a\n");
+      else printf("%d ms\n", lat.timer_ms);
+    }
+  }
+
+  // until the trackers report their rates every station is assumed to make ASSUMED_RATE records
+  static plan_link budget[OUTLOOP_MAX_PORTS];
+  static plan_format plan[OUTLOOP_MAX_PORTS];
+  int rate_seen[ISD_MAX_TRACKERS];
+  memset(rate_seen, 0, sizeof(rate_seen));
+  for (q = 0; q < nlinks; q++) {
+    budget[q].baud = cfg.baud;
+    budget[q].bits_per_byte = 1 + cfg.data_bits + (cfg.parity != 'N') + cfg.stop_bits;
+    budget[q].headroom = headroom;
+  }
+  replan(budget, plan, &want, nlinks, map, link, nports, rate_seen, "");
+
+  outloop out;
+  if (outloop_start(&out, txp, nlinks) != 0) {
+    printf("couldn't start the serial writer\n");
+    return -1;
   }
 
   Bool loop = FALSE;
   int i;
-  ISD_TRACKING_DATA_TYPE data;
-  ISD_TRACKER_HANDLE handle = 0;
-  ISD_TRACKER_INFO_TYPE tracker;
+  ISD_TRACKER_HANDLE handles[ISD_MAX_TRACKERS];
   int attributes = 3; // change based on what exactly is being sent
 
-  handle = ISD_OpenTracker((Hwnd)NULL, 0, FALSE, FALSE );
-  if ( handle > 0 ) {
+  memset(handles, 0, sizeof(handles));
+  int ntrackers = ISD_OpenAllTrackers((Hwnd)NULL, handles, FALSE, FALSE );
+  if ( ntrackers > 0 ) {
     printf( "\n Az El Rl X Y Z \n" );
     loop = TRUE;
   }
@@ -67,50 +502,175 @@ int main() {
     printf( "Tracker not found" );
     return -1;
   }
-  unsigned char out[50];
-  int precision=10;
-  char out2[precision];
-  char* comma = ',';
-  char* endl = '\r\n';
+  for (p = 0; p < nports; p++) {
+    if (map[p].tracker > ntrackers || map[p].station > ISD_MAX_STATIONS) {
+      printf( "Tracker%d.Station%d not found\n", map[p].tracker, map[p].station );
+      return -1;
+    }
+  }
+
+  static spsc_ring ring;
+  static spsc_latest latest[OUTLOOP_MAX_PORTS];
+  static acquisition acq;
+  pthread_t acq_thread;
+  if (spsc_init(&ring) != 0) return -1;
+  for (p = 0; p < nports; p++) spsc_latest_init(&latest[p]);
+  acq.handles = handles;
+  acq.ntrackers = ntrackers;
+  acq.map = map;
+  acq.nports = nports;
+  acq.ring = &ring;
+  acq.latest = latest;
+  acq.extended = (want.fields & (FRAME_ANGVEL | FRAME_ACCEL)) != 0;
+  acq.running = 1;
+  if (pthread_create(&acq_thread, NULL, acquire_thread, &acq) != 0) {
+    printf("couldn't start acquisition\n");
+    return -1;
+  }
+
+  // report what was granted before the status line takes over the console
+  rt_apply(acq_thread, "acquisition", &acq_rt);
+  rt_apply(out.thread, "serial writer", &writer_rt);
+  if (lock_memory) rt_lock_memory();
+  if (want.encoding == PLAN_BINARY && (want.fields & FRAME_QUAT) && want.quat_bits)
+    printf("quaternion: smallest three at %d bits, %zu bytes, at most %.4f deg off\n",
+           want.quat_bits, frame_quat_size(want.quat_bits), frame_quat_error(want.quat_bits));
+
+  char line[TXQ_FRAME_MAX];
+  unsigned char frame[FRAME_MAX];
+  unsigned long udp_dropped = 0;
+  unsigned seq[OUTLOOP_MAX_PORTS];
+  unsigned long records[OUTLOOP_MAX_PORTS];  // per map entry, for decimation
+  static struct frame_delta_encoder delta[OUTLOOP_MAX_PORTS];
+  unsigned long lost_seen[OUTLOOP_MAX_PORTS];
+  memset(seq, 0, sizeof(seq));
+  memset(records, 0, sizeof(records));
+  memset(lost_seen, 0, sizeof(lost_seen));
+  for (p = 0; p < nports; p++) {
+    const plan_format* f = &plan[link[p]];
+    frame_delta_init(&delta[p], slot[p], f->fields, f->resolution, f->key_every);
+  }
   while (loop) {
-    if ( handle > 0 ) {
-      ISD_GetTrackingData( handle, &data );
-      printf( "%7.2f %7.2f %7.2f %7.3f %7.3f %7.3f ",
-	      data.Station[0].Euler[0],
-	      data.Station[0].Euler[1],
-	      data.Station[0].Euler[2],
-	      data.Station[0].Position[0],
-	      data.Station[0].Position[1],
-	      data.Station[0].Position[2] );
-
-      sprintf(out, "%f", data.Station[0].Euler[0]);
-      strncpy(out2, out, precision-1);
-      out2[precision-2] = '\n';
-      out2[precision-1] = '\0';
-      write(serial, &out2, precision);
-      tcdrain(serial);
-      //write(serial, data.Station[0].Euler[0], sizeof(data.Station[0].Euler[0])+1);
-      //write(serial, &endl, 2);
-      //tcdrain(serial);
-      /*
-	for (int i = 0; i < sizeof(data.Station[0].Euler)/sizeof(float); i++) {
-	sprintf(out, "%f", data.Station[0].Euler[i]);
-	strncpy(out2, out, precision-1);
-	out2[precision-1] = '\0';
-	write(serial, &out2, precision);
-	tcdrain(serial);
-	write(serial, &comma, 1);
-	}
-	write(serial, &endl, 2);
-      */
-
-      ISD_GetCommInfo( handle, &tracker );
-      printf( "%5.2f Kb/s %d Rec/s \r", tracker.KBitsPerSec, tracker.RecordsPerSec );
-      fflush(0);
+    struct pose_sample s;
+    struct pose_extended x;
+    int got = 0;
+
+    while (spsc_pop(&ring, &s, &x)) {
+      got++;
+      for (p = 0; p < nports; p++) {
+        if (map[p].tracker != s.tracker || map[p].station != s.station) continue;
+
+        txqueue* t = &tx[link[p]];
+        const plan_format* f = &plan[link[p]];
+        size_t n = 0;
+        // udp isn't held to any serial link's budget, it gets every record and field asked for
+        if (udp >= 0) {
+          n = osc_packet(packet, osc[p], &s, &x, want.fields);
+          if (send(udp, packet, n, 0) < 0) udp_dropped++;
+        }
+        if (records[p]++ % f->decimate != 0) continue;
+
+        if (f->encoding == PLAN_OSC) {
+          if (udp < 0 || f->fields != want.fields) n = osc_packet(packet, osc[p], &s, &x, f->fields);
+          txq_push(t, wire, osc_slip_encode(packet, n, wire));
+          continue;
+        }
+        if (f->encoding != PLAN_ASCII) {
+          // sequence numbers count per station, so a receiver sees our drops as gaps too
+          struct frame_sample fs;
+          fs.tracker = s.tracker;
+          fs.station = s.station;
+          fs.seq = seq[p]++;
+          fs.time_ms = (unsigned)(s.time * 1000.0f) & 0xffff;
+          fs.fields = f->fields;
+          fs.quat_bits = f->quat_bits;
+          memcpy(fs.euler, s.euler, sizeof(fs.euler));
+          memcpy(fs.quat, s.quat, sizeof(fs.quat));
+          memcpy(fs.position, s.position, sizeof(fs.position));
+          if (s.flags & POSE_EXTENDED) {
+            memcpy(fs.angvel, x.angvel, sizeof(fs.angvel));
+            memcpy(fs.accel, x.accel, sizeof(fs.accel));
+          }
+          if (f->encoding == PLAN_BINARY) {
+            txq_push(t, frame, frame_encode(&fs, frame));
+            continue;
+          }
+
+          // a new plan with other fields starts over from a keyframe
+          if (delta[p].fields != (f->fields & FRAME_WIRE))
+            frame_delta_init(&delta[p], slot[p], f->fields, f->resolution, f->key_every);
+
+          // a frame the queue dropped or coalesced breaks every delta chain on that device
+          unsigned long lost = t->dropped + t->coalesced;
+          if (lost != lost_seen[link[p]]) {
+            lost_seen[link[p]] = lost;
+            for (q = 0; q < nports; q++)
+              if (link[q] == link[p]) frame_delta_resync(&delta[q]);
+          }
+          txq_push(t, frame, frame_delta_encode(&delta[p], &fs, frame));
+          continue;
+        }
+
+        txq_push(t, line, ascii_line(line, &s, &x, f->fields, f->decimals));
+      }
+    }
+    if (!got) spsc_wait(&ring, 100);
+
+    // the trackers' rates change with their stations and sync settings, follow them
+    for (i = 0; i < ntrackers && rate_seen[i] == acq.rate[i]; i++)
+      ;
+    if (i < ntrackers) {
+      for (i = 0; i < ntrackers; i++) rate_seen[i] = acq.rate[i];
+      replan(budget, plan, &want, nlinks, map, link, nports, rate_seen, "\n");
+    }
+
+    // the console only wants the newest pose, however far behind the ring is
+    if (!spsc_latest_load(&latest[0], &s)) continue;
+    printf( "%7.2f %7.2f %7.2f %7.3f %7.3f %7.3f ",
+	    s.euler[0], s.euler[1], s.euler[2],
+	    s.position[0], s.position[1], s.position[2] );
+
+    // totals over every port. every sample is one contiguous record, and records go to the fd
+    // in batches, so writes per sample should stay at or under 1; sys/sample is everything the
+    // output side does (writes, TIOCOUTQ, wakeups, epoll)
+    unsigned long written = 0, pushed = 0, dropped = 0, coalesced = 0;
+    int dead = 0;
+    unsigned long long writes = 0, syscalls = out.syscalls;
+    for (p = 0; p < nlinks; p++) {
+      written += tx[p].frames_written;
+      pushed += tx[p].pushed;
+      dropped += tx[p].dropped;
+      coalesced += tx[p].coalesced;
+      writes += tx[p].io.writes;
+      syscalls += tx[p].io.syscalls + tx[p].syscalls + tx[p].wakeups;
+      dead += out.dead[p];
     }
+    double per = written ? 1.0 / written : 0;
+
+    printf( "%5.2f Kb/s %d Rec/s ring %u ovf %lu %d ports tx %lu/%lu drop %lu coal %lu %s %.2f write %.2f sys/sample ",
+	    acq.kbits, acq.records, spsc_depth(&ring), (unsigned long)ring.overflows, nports,
+	    written, pushed, dropped, coalesced,
+	    iob_backend_name(tx[0].io.backend), writes * per, syscalls * per );
+    // what pacing costs and how late after a record was due it's picked up (mean/worst)
+    const struct pace* pc = &acq.pace[map[0].tracker-1];
+    printf("acq %.1f%% cpu late %.2f/%.2f ms miss %.0f%% ",
+           pc->cpu * 100, pc->late_mean * 1e3, pc->late_worst * 1e3, pc->miss_rate * 100);
+    if (udp >= 0) printf("udp drop %lu ", udp_dropped);
+    if (dead) printf("dead %d ", dead);
+    printf("\r");
+    fflush(0);
     //usleep(1/baudrate);
   }
 
-  ISD_CloseTracker(handle);
+  acq.running = 0;
+  pthread_join(acq_thread, NULL);
+  spsc_destroy(&ring);
+  outloop_stop(&out);
+  for (p = 0; p < nlinks; p++) {
+    txq_destroy(&tx[p]);
+    close(tx[p].fd);
+  }
+  if (udp >= 0) close(udp);
+  for (i = 0; i < ntrackers; i++) ISD_CloseTracker(handles[i]);
   return 0;
 }
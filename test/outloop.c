@@ -0,0 +1,187 @@
+//==================================================================================================
+// one thread serving every output port, see outloop.h
+//==================================================================================================
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
+#include "outloop.h"
+
+// interest in a port's fd becoming writable, only while it has bytes parked
+static void want_writable(outloop* l, int i, int on) {
+#if defined(__linux__)
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = on ? EPOLLOUT : 0;
+  ev.data.u32 = i;
+  l->syscalls++;
+  epoll_ctl(l->epfd, EPOLL_CTL_MOD, l->ports[i]->fd, &ev);
+#else
+  (void)l; (void)i; (void)on;
+#endif
+}
+
+// gives up on port i for good: out of the wait, and its queue drops everything from now on
+static void kill_port(outloop* l, int i) {
+  if (l->dead[i]) return;
+  l->dead[i] = 1;
+#if defined(__linux__)
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  l->syscalls++;
+  epoll_ctl(l->epfd, EPOLL_CTL_DEL, l->ports[i]->fd, &ev);
+#endif
+  txq_fail(l->ports[i]);
+}
+
+// waits for events, setting writable[i] for ports whose fd can take more and gone[i] for ones
+// that hung up or errored. epoll reports those whatever a port asked for, so they have to be
+// acted on or they wake the loop forever
+static void wait_events(outloop* l, const int* blocked, int* writable, int* gone, int timeout_ms) {
+  int i;
+#if defined(__linux__)
+  struct epoll_event ev[OUTLOOP_MAX_PORTS + 1];
+  int n = epoll_wait(l->epfd, ev, OUTLOOP_MAX_PORTS + 1, timeout_ms);
+  for (i = 0; i < n; i++) {
+    if ((int)ev[i].data.u32 >= l->n) continue;
+    if (ev[i].events & (EPOLLHUP | EPOLLERR)) gone[ev[i].data.u32] = 1;
+    else writable[ev[i].data.u32] = 1;
+  }
+#else
+  struct pollfd pfd[OUTLOOP_MAX_PORTS + 1];
+  int idx[OUTLOOP_MAX_PORTS + 1];
+  int n = 0;
+  pfd[n].fd = l->wake[0];
+  pfd[n].events = POLLIN;
+  idx[n++] = -1;
+  for (i = 0; i < l->n; i++) {
+    if (!blocked[i]) continue;
+    pfd[n].fd = l->ports[i]->fd;
+    pfd[n].events = POLLOUT;
+    idx[n++] = i;
+  }
+  if (poll(pfd, n, timeout_ms) > 0) {
+    for (i = 1; i < n; i++) {
+      if (pfd[i].revents & (POLLHUP | POLLERR | POLLNVAL)) gone[idx[i]] = 1;
+      else if (pfd[i].revents) writable[idx[i]] = 1;
+    }
+  }
+#endif
+  (void)blocked;
+  l->syscalls++;
+
+  // a short read means the pipe is empty, no need for the EAGAIN to prove it
+  char buf[64];
+  ssize_t got;
+  do {
+    l->syscalls++;
+    got = read(l->wake[0], buf, sizeof(buf));
+  } while (got == (ssize_t)sizeof(buf));
+}
+
+static void* loop_thread(void* arg) {
+  outloop* l = (outloop*)arg;
+  int blocked[OUTLOOP_MAX_PORTS];
+  int writable[OUTLOOP_MAX_PORTS];
+  int gone[OUTLOOP_MAX_PORTS];
+  int i;
+
+  memset(blocked, 0, sizeof(blocked));
+  while (l->running) {
+    long next_us = -1;
+
+    for (i = 0; i < l->n; i++) {
+      // a port waiting on its fd is left alone until the fd says it can take more
+      if (blocked[i] || l->dead[i]) continue;
+
+      long r = txq_service(l->ports[i]);
+      if (r == TXQ_FAILED) {
+        kill_port(l, i);
+      } else if (r < 0) {
+        blocked[i] = 1;
+        want_writable(l, i, 1);
+      } else if (r > 0 && (next_us < 0 || r < next_us)) {
+        next_us = r;
+      }
+    }
+
+    memset(writable, 0, sizeof(writable));
+    memset(gone, 0, sizeof(gone));
+    wait_events(l, blocked, writable, gone, next_us < 0 ? -1 : (int)((next_us + 999) / 1000));
+    l->wakeups++;
+
+    for (i = 0; i < l->n; i++) {
+      if (gone[i]) {
+        blocked[i] = 0;
+        kill_port(l, i);
+      } else if (blocked[i] && writable[i]) {
+        blocked[i] = 0;
+        want_writable(l, i, 0);
+      }
+    }
+  }
+
+  for (i = 0; i < l->n; i++)
+    if (!l->dead[i]) txq_service(l->ports[i]);
+  return NULL;
+}
+
+int outloop_start(outloop* l, txqueue** ports, int n) {
+  int i;
+
+  memset(l, 0, sizeof(*l));
+  if (n > OUTLOOP_MAX_PORTS) return -1;
+  if (pipe(l->wake) != 0) return -1;
+  fcntl(l->wake[0], F_SETFL, O_NONBLOCK);
+  fcntl(l->wake[1], F_SETFL, O_NONBLOCK);
+
+  l->n = n;
+  l->epfd = -1;
+  for (i = 0; i < n; i++) {
+    l->ports[i] = ports[i];
+    ports[i]->wake_fd = l->wake[1];
+  }
+
+#if defined(__linux__)
+  struct epoll_event ev;
+  l->epfd = epoll_create1(0);
+  if (l->epfd < 0) return -1;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u32 = n;
+  epoll_ctl(l->epfd, EPOLL_CTL_ADD, l->wake[0], &ev);
+  for (i = 0; i < n; i++) {
+    ev.events = 0;
+    ev.data.u32 = i;
+    epoll_ctl(l->epfd, EPOLL_CTL_ADD, ports[i]->fd, &ev);
+  }
+#endif
+
+  l->running = 1;
+  if (pthread_create(&l->thread, NULL, loop_thread, l) != 0) {
+    l->running = 0;
+    return -1;
+  }
+  return 0;
+}
+
+void outloop_stop(outloop* l) {
+  int i;
+  char c = 0;
+
+  l->running = 0;
+  write(l->wake[1], &c, 1);
+  pthread_join(l->thread, NULL);
+
+  for (i = 0; i < l->n; i++) l->ports[i]->wake_fd = -1;
+  if (l->epfd >= 0) close(l->epfd);
+  close(l->wake[0]);
+  close(l->wake[1]);
+}
@@ -0,0 +1,40 @@
+//==================================================================================================
+// one thread serving every output port
+//
+// each port has its own txqueue; the loop sleeps in epoll (poll off Linux) until a queue gets a
+// frame, a blocked port becomes writable, or a port's kernel queue should have drained, and
+// services only those. a slow receiver just fills its own queue.
+//
+// a port whose fd hangs up or errors, or whose writes fail for good, is dead: it's taken out of
+// the wait, never serviced again and its queue fails (txq_fail), so it can't keep the loop awake.
+//==================================================================================================
+
+#ifndef OUTLOOP_H
+#define OUTLOOP_H
+
+#include <pthread.h>
+
+#include "txqueue.h"
+
+#define OUTLOOP_MAX_PORTS 32
+
+typedef struct {
+  txqueue* ports[OUTLOOP_MAX_PORTS];
+  int n;
+  int wake[2];           // pipe the queues poke when they stop being empty
+  int epfd;
+  volatile int running;
+  pthread_t thread;
+
+  int dead[OUTLOOP_MAX_PORTS];  // given up on, see above
+  unsigned long wakeups; // loop iterations, for the status line
+  unsigned long syscalls;  // waits, wake pipe reads and epoll_ctl calls
+} outloop;
+
+// takes over the n queues' wakeups and starts the thread, returns 0 on success
+int outloop_start(outloop* l, txqueue** ports, int n);
+
+// gives the queues one last service and stops the thread; the queues stay the caller's
+void outloop_stop(outloop* l);
+
+#endif
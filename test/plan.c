@@ -0,0 +1,200 @@
+//==================================================================================================
+// link budget planner, see plan.h
+//==================================================================================================
+
+#include <math.h>
+#include <string.h>
+
+#include "plan.h"
+#include "../osc.h"
+
+static const char* field_names[PLAN_FIELDS] = { "euler", "quat", "pos", "angvel", "accel", "time" };
+static const int field_floats[PLAN_FIELDS] = { 3, 4, 3, 3, 3, 1 };
+
+// integer digits of the widest value each field normally takes: -179.99 degrees, -0.99, -9.99 m,
+// -99.9 rad/s and m/s^2, and an hour and more of tracker time
+static const int field_digits[PLAN_FIELDS] = { 3, 1, 1, 2, 2, 5 };
+
+// fewest decimals the planner takes ascii down to
+static const int decimals_floor[PLAN_FIELDS] = { 1, 3, 2, 1, 1, 2 };
+
+// given up in this order, quat only while euler stays
+static const unsigned drop_order[] = { FRAME_ACCEL, FRAME_ANGVEL, FRAME_TIME, FRAME_QUAT };
+
+static const char* encoding_names[] = { "ascii", "binary", "delta", "osc" };
+
+// bytes a second with the link flat out
+static double wire_rate(const plan_link* link) {
+  return (double)link->baud / link->bits_per_byte;
+}
+
+double plan_capacity(const plan_link* link) {
+  return wire_rate(link) * link->headroom / 100.0;
+}
+
+static int channels(unsigned fields) {
+  int f, n = 0;
+  for (f = 0; f < FRAME_FIELDS; f++)
+    if (fields & (1u << f)) n += field_floats[f];
+  return n;
+}
+
+static double ascii_bytes(const plan_format* f) {
+  int i, n = 0;
+  for (i = 0; i < PLAN_FIELDS; i++) {
+    if (!(f->fields & (1u << i))) continue;
+    int width = 1 + field_digits[i] + (f->decimals[i] ? 1 + f->decimals[i] : 0);
+    n += field_floats[i] * (width + 1);
+  }
+  return n + 1;  // the last comma becomes CRLF
+}
+
+static double binary_bytes(const plan_format* f) {
+  struct frame_sample s;
+  unsigned char out[FRAME_MAX];
+  memset(&s, 0, sizeof(s));
+  s.tracker = s.station = 1;
+  s.fields = f->fields;
+  s.quat_bits = f->quat_bits;
+  return frame_encode(&s, out);
+}
+
+static double delta_bytes(const plan_format* f) {
+  int n = channels(f->fields), k, wire = 0;
+  for (k = 0; k < FRAME_FIELDS; k++)
+    if (f->fields & (1u << k)) wire++;
+  double key = 5 + 4 * wire + 3 * n + 2 + 2;
+  double delta = 1 + 1 + 1.5 * n + 1 + 2;
+  return (key + (f->key_every - 1) * delta) / f->key_every;
+}
+
+static double osc_bytes(const plan_format* f) {
+  char address[OSC_ADDRESS_MAX];
+  struct osc_template t;
+  int i, n = OSC_BUNDLE_HEAD;
+  for (i = 0; i < PLAN_FIELDS; i++) {
+    if (!(f->fields & (1u << i))) continue;
+    // "/prefix/n/field", n assumed to be one digit
+    int len = f->osc_prefix_len + 3 + strlen(field_names[i]);
+    if (len >= OSC_ADDRESS_MAX) len = OSC_ADDRESS_MAX - 1;
+    memset(address, 'x', len);
+    address[len] = '\0';
+    osc_template_init(&t, address, field_floats[i]);
+    n += 4 + t.len + 4 * t.nargs;
+  }
+  // SLIP ENDs and escapes. a float's first byte is 0xc0 for every value in [-8, -2), so count one
+  // escape per float for it and the other three bytes at chance
+  return n + 2 + channels(f->fields) * (1 + 3 * 2 / 256.0);
+}
+
+double plan_bytes(const plan_format* f) {
+  switch (f->encoding) {
+  case PLAN_ASCII: return ascii_bytes(f);
+  case PLAN_BINARY: return binary_bytes(f);
+  case PLAN_DELTA: return delta_bytes(f);
+  case PLAN_OSC: return osc_bytes(f);
+  }
+  return 0;
+}
+
+// one step less precise, 0 if there's nothing left to give
+static int coarser(plan_format* f) {
+  int i, changed = 0;
+  switch (f->encoding) {
+  case PLAN_ASCII:
+    for (i = 0; i < PLAN_FIELDS; i++)
+      if ((f->fields & (1u << i)) && f->decimals[i] > decimals_floor[i]) {
+        f->decimals[i]--;
+        changed = 1;
+      }
+    return changed;
+  case PLAN_BINARY:
+    if (!(f->fields & FRAME_QUAT) || f->quat_bits == FRAME_QUAT_BITS_MIN) return 0;
+    f->quat_bits = f->quat_bits == 0 || f->quat_bits > 12 ? 12 : FRAME_QUAT_BITS_MIN;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+// one field fewer, 0 if only what can't go is left. ascii lines say nothing about which columns
+// they hold, so a receiver would misread every line after a replan took one away: ascii keeps them.
+// the last field on the wire always stays, or there'd be nothing to send
+static int fewer(plan_format* f) {
+  size_t i;
+  if (f->encoding == PLAN_ASCII) return 0;
+  for (i = 0; i < sizeof(drop_order) / sizeof(drop_order[0]); i++) {
+    unsigned bit = drop_order[i];
+    if (!(f->fields & bit)) continue;
+    if (bit == FRAME_QUAT && !(f->fields & FRAME_EULER)) continue;
+    if (!(f->fields & FRAME_WIRE & ~bit)) continue;
+    f->fields &= ~bit;
+    return 1;
+  }
+  return 0;
+}
+
+static int decimation(const plan_format* f, double budget) {
+  double over = plan_bytes(f) / budget;
+  return over > 1 ? (int)ceil(over) : 1;
+}
+
+// walks down the ladder of ever cheaper formats and stops at the first one that needs the least
+// decimation, so nothing is given up that wouldn't buy back rate
+void plan_fit(const plan_link* link, const plan_format* want, plan_format* got) {
+  *got = *want;
+  got->decimate = 1;
+  if (link->headroom <= 0 || link->records <= 0) return;
+
+  double budget = plan_capacity(link) / link->records;  // bytes per record
+  plan_format f = *want;
+  got->decimate = decimation(got, budget);
+  while (got->decimate > 1 && (coarser(&f) || fewer(&f))) {
+    f.decimate = decimation(&f, budget);
+    if (f.decimate < got->decimate) *got = f;
+  }
+}
+
+static void print_fields(FILE* out, unsigned fields) {
+  const char* sep = "";
+  int i;
+  for (i = 0; i < PLAN_FIELDS; i++) {
+    if (!(fields & (1u << i))) continue;
+    fprintf(out, "%s%s", sep, field_names[i]);
+    sep = ",";
+  }
+}
+
+void plan_print(FILE* out, const char* name, const plan_link* link, const plan_format* want,
+                const plan_format* got) {
+  double bytes = plan_bytes(got);
+  int i;
+
+  fprintf(out, "%s: %.0f rec/s, %s ", name, link->records, encoding_names[got->encoding]);
+  print_fields(out, got->fields);
+  fprintf(out, " %.1f B/rec", bytes);
+  if (got->decimate > 1) fprintf(out, ", 1 record in %d", got->decimate);
+  fprintf(out, ", %.0f%% of %.0f B/s", 100.0 * bytes * link->records / got->decimate / wire_rate(link),
+          wire_rate(link));
+  fprintf(out, "\n");
+
+  unsigned dropped = want->fields & ~got->fields;
+  int fewer_decimals = 0;
+  for (i = 0; i < PLAN_FIELDS; i++)
+    if (got->decimals[i] != want->decimals[i] && (got->fields & (1u << i))) fewer_decimals = 1;
+  if (!dropped && !fewer_decimals && got->quat_bits == want->quat_bits) return;
+
+  fprintf(out, "  to fit:");
+  if (got->quat_bits != want->quat_bits && (got->fields & FRAME_QUAT))
+    fprintf(out, " quat at %d bits (%.3f deg)", got->quat_bits, frame_quat_error(got->quat_bits));
+  if (fewer_decimals) {
+    fprintf(out, " decimals");
+    for (i = 0; i < PLAN_FIELDS; i++)
+      if (got->fields & (1u << i)) fprintf(out, " %s=%d", field_names[i], got->decimals[i]);
+  }
+  if (dropped) {
+    fprintf(out, " without ");
+    print_fields(out, dropped);
+  }
+  fprintf(out, "\n");
+}
@@ -0,0 +1,63 @@
+//==================================================================================================
+// link budget: fitting what the forwarder sends to what each serial link can carry
+//
+// a link moves baud / (start + data + parity + stop bits) bytes a second, and every station on
+// it costs its record rate times the bytes one record encodes to. when that comes to more than
+// the link can take, the queue only grows, so the planner gives things up, cheapest first:
+//
+//   1. precision: ascii drops decimals down to a floor, binary packs quaternions
+//      smallest-three at 12 and then 10 bits (delta and osc have nothing to give here)
+//   2. fields: accel, angvel, time, then quat if euler is going anyway, but never the last one
+//      left. not for ascii, whose lines carry nothing to tell a receiver the columns changed
+//   3. rate: only every nth record of each station goes out
+//
+// but only as far down that list as it buys back rate: a step that leaves the decimation where
+// it was isn't taken.
+//
+// sizes are exact for binary and osc, worst case for ascii, and for delta assume keyframes of
+// 3 bytes a value and deltas of 1.5, half again what a head in normal motion needs
+//==================================================================================================
+
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <stdio.h>
+
+#include "../frame.h"
+
+#define PLAN_FIELDS 6  // FRAME_* bits, time included
+
+typedef enum { PLAN_ASCII, PLAN_BINARY, PLAN_DELTA, PLAN_OSC } plan_encoding;
+
+typedef struct {
+  plan_encoding encoding;
+  unsigned fields;                 // FRAME_* bits
+  int decimals[PLAN_FIELDS];       // ascii, in FRAME_* bit order
+  int quat_bits;                   // binary, 0 for four s16
+  float resolution[FRAME_FIELDS];  // delta
+  int key_every;                   // delta
+  int osc_prefix_len;              // osc, strlen of the address prefix
+  int decimate;                    // 1: every record, n: every nth
+} plan_format;
+
+typedef struct {
+  int baud;
+  int bits_per_byte;  // start + data + parity + stop
+  int headroom;       // percent of the link to fill, 0 to send what's asked whatever it costs
+  double records;     // a second, every station on the link together
+} plan_link;
+
+// bytes per second the link can take at its headroom
+double plan_capacity(const plan_link* link);
+
+// bytes on the wire for one record in format f
+double plan_bytes(const plan_format* f);
+
+// the least reduced version of want that fits link, at worst decimated
+void plan_fit(const plan_link* link, const plan_format* want, plan_format* got);
+
+// one line on what link gets, and a second on what was given up for it if anything
+void plan_print(FILE* out, const char* name, const plan_link* link, const plan_format* want,
+                const plan_format* got);
+
+#endif
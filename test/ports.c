@@ -0,0 +1,85 @@
+//==================================================================================================
+// port map loader, see ports.h
+//==================================================================================================
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "ports.h"
+
+static char* trim(char* s) {
+  char* end;
+  while (isspace((unsigned char)*s)) s++;
+  end = s + strlen(s);
+  while (end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+  return s;
+}
+
+// "Tracker<t>" or "Tracker<t>.Station<s>", case-insensitive
+static int parse_key(const char* key, int* tracker, int* station) {
+  char* end;
+  if (strncasecmp(key, "Tracker", 7) != 0) return -1;
+  *tracker = strtol(key + 7, &end, 10);
+  *station = 1;
+  if (end == key + 7 || *tracker < 1) return -1;
+  if (*end == '\0') return 0;
+  if (*end != '.' || strncasecmp(end + 1, "Station", 7) != 0) return -1;
+  key = end + 8;
+  *station = strtol(key, &end, 10);
+  if (end == key || *end != '\0' || *station < 1) return -1;
+  return 0;
+}
+
+int ports_load(const char* path, port_map* map, int max) {
+  char line[512];
+  int n = 0, lineno = 0, i;
+  FILE* fp = fopen(path, "r");
+  if (!fp) {
+    fprintf(stderr, "can't open port map %s\n", path);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), fp)) {
+    char* s = trim(line);
+    char* eq;
+    port_map m;
+    lineno++;
+    if (*s == '\0' || *s == '#' || *s == ';') continue;
+
+    eq = strchr(s, '=');
+    if (!eq) goto bad;
+    *eq = '\0';
+    if (parse_key(trim(s), &m.tracker, &m.station) != 0) goto bad;
+    s = trim(eq + 1);
+    if (*s == '\0' || strlen(s) >= PORT_DEVICE_MAX) goto bad;
+    strcpy(m.device, s);
+
+    for (i = 0; i < n; i++) {
+      // one station can go out of several devices, and one device take several stations
+      if (map[i].tracker == m.tracker && map[i].station == m.station && strcmp(map[i].device, m.device) == 0) {
+        fprintf(stderr, "%s:%d: Tracker%d.Station%d is already mapped to %s\n", path, lineno, m.tracker,
+                m.station, m.device);
+        fclose(fp);
+        return -1;
+      }
+    }
+    if (n == max) {
+      fprintf(stderr, "%s:%d: more than %d ports\n", path, lineno, max);
+      fclose(fp);
+      return -1;
+    }
+    map[n++] = m;
+    continue;
+
+  bad:
+    fprintf(stderr, "%s:%d: expected Tracker<n>[.Station<n>] = <device>\n", path, lineno);
+    fclose(fp);
+    return -1;
+  }
+
+  fclose(fp);
+  return n;
+}
@@ -0,0 +1,21 @@
+//==================================================================================================
+// port map: which tracker/station goes out of which serial port (a port can take several)
+//
+// read from an ini file in the same spirit as isports.ini, see forward.ini
+//==================================================================================================
+
+#ifndef PORTS_H
+#define PORTS_H
+
+#define PORT_DEVICE_MAX 256
+
+typedef struct {
+  char device[PORT_DEVICE_MAX];
+  int tracker;   // 1-based, as in isports.ini
+  int station;   // 1-based
+} port_map;
+
+// fills up to max entries from path, returns how many or -1 (with a message) on error
+int ports_load(const char* path, port_map* map, int max);
+
+#endif
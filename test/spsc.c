@@ -0,0 +1,118 @@
+//==================================================================================================
+// lock-free acquisition hand-off, see spsc.h
+//==================================================================================================
+
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "spsc.h"
+
+#define SPSC_MASK  (SPSC_SLOTS - 1)
+#define SPSC_FRESH 4u  // set in spsc_latest.middle when it holds a sample nobody has loaded
+
+int spsc_init(spsc_ring* r) {
+  memset(r, 0, sizeof(*r));
+  if (pipe(r->wake) != 0) return -1;
+  fcntl(r->wake[0], F_SETFL, O_NONBLOCK);
+  fcntl(r->wake[1], F_SETFL, O_NONBLOCK);
+  return 0;
+}
+
+void spsc_destroy(spsc_ring* r) {
+  close(r->wake[0]);
+  close(r->wake[1]);
+}
+
+int spsc_push(spsc_ring* r, const struct pose_sample* s, const struct pose_extended* x) {
+  unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  unsigned int seq = r->offered++;
+
+  if (head - r->tail_cache == SPSC_SLOTS) {
+    r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (head - r->tail_cache == SPSC_SLOTS) {
+      atomic_fetch_add_explicit(&r->overflows, 1, memory_order_relaxed);
+      return -1;
+    }
+  }
+
+  r->slots[head & SPSC_MASK] = *s;
+  r->slots[head & SPSC_MASK].seq = seq;
+  if (s->flags & POSE_EXTENDED) r->ext[head & SPSC_MASK] = *x;
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+  // pairs with the store to sleeping in spsc_wait: either we see the consumer asleep,
+  // or it sees the new head before it goes to sleep
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&r->sleeping, memory_order_relaxed) &&
+      atomic_exchange_explicit(&r->sleeping, 0, memory_order_relaxed)) {
+    char c = 0;
+    write(r->wake[1], &c, 1);
+  }
+  return 0;
+}
+
+int spsc_pop(spsc_ring* r, struct pose_sample* s, struct pose_extended* x) {
+  unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+  if (tail == r->head_cache) {
+    r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (tail == r->head_cache) return 0;
+  }
+
+  *s = r->slots[tail & SPSC_MASK];
+  if ((s->flags & POSE_EXTENDED) && x) *x = r->ext[tail & SPSC_MASK];
+  atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+  return 1;
+}
+
+void spsc_wait(spsc_ring* r, int timeout_ms) {
+  unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  struct pollfd pfd;
+  char buf[64];
+
+  atomic_store_explicit(&r->sleeping, 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&r->head, memory_order_acquire) == tail) {
+    pfd.fd = r->wake[0];
+    pfd.events = POLLIN;
+    poll(&pfd, 1, timeout_ms);
+  }
+  atomic_store_explicit(&r->sleeping, 0, memory_order_relaxed);
+
+  while (read(r->wake[0], buf, sizeof(buf)) > 0)
+    ;
+}
+
+unsigned int spsc_depth(spsc_ring* r) {
+  return atomic_load_explicit(&r->head, memory_order_acquire) -
+         atomic_load_explicit(&r->tail, memory_order_acquire);
+}
+
+//==================================================================================================
+// latest-sample triple buffer: the producer owns back, the consumer owns front, and they swap
+// through middle, so neither ever waits for the other
+//==================================================================================================
+
+void spsc_latest_init(spsc_latest* l) {
+  memset(l, 0, sizeof(*l));
+  l->back = 0;
+  atomic_init(&l->middle, 1);
+  l->front = 2;
+}
+
+void spsc_latest_store(spsc_latest* l, const struct pose_sample* s) {
+  l->buf[l->back] = *s;
+  l->back = atomic_exchange_explicit(&l->middle, l->back | SPSC_FRESH, memory_order_acq_rel) & ~SPSC_FRESH;
+}
+
+int spsc_latest_load(spsc_latest* l, struct pose_sample* s) {
+  int fresh = 0;
+  if (atomic_load_explicit(&l->middle, memory_order_relaxed) & SPSC_FRESH) {
+    l->front = atomic_exchange_explicit(&l->middle, l->front, memory_order_acq_rel) & ~SPSC_FRESH;
+    fresh = 1;
+  }
+  *s = l->buf[l->front];
+  return fresh;
+}
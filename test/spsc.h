@@ -0,0 +1,75 @@
+//==================================================================================================
+// lock-free hand-off from the acquisition thread to the output side
+//
+// spsc_ring is a single-producer/single-consumer ring of pose samples (see pose.h), each with its
+// extended record in a parallel array that is only copied when the sample carries one. the producer never
+// blocks and never takes a lock: when the ring is full the new sample is counted as an overflow
+// and dropped, so a stalled consumer can't add jitter to acquisition. head and tail sit on their
+// own cache lines and each side keeps a private copy of the other's index, so the shared lines
+// only move between cores when the ring looks full or empty.
+//
+// spsc_latest is a triple buffer holding just the newest sample, for readers that don't care
+// about history (the console display). both store and load are a single atomic exchange.
+//==================================================================================================
+
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdatomic.h>
+
+#include "../pose.h"
+
+#define SPSC_SLOTS      256  // power of two
+#define SPSC_CACHE_LINE POSE_LINE
+
+typedef struct {
+  // producer's line
+  _Alignas(SPSC_CACHE_LINE) atomic_uint head;
+  unsigned int tail_cache;
+  unsigned int offered;
+  atomic_ulong overflows;
+
+  // consumer's line
+  _Alignas(SPSC_CACHE_LINE) atomic_uint tail;
+  unsigned int head_cache;
+
+  // only written when the consumer goes to sleep or is woken
+  _Alignas(SPSC_CACHE_LINE) atomic_int sleeping;
+  int wake[2];
+
+  struct pose_sample slots[SPSC_SLOTS];     // seq stamped by spsc_push, a gap means overflows
+  struct pose_extended ext[SPSC_SLOTS];
+} spsc_ring;
+
+typedef struct {
+  struct pose_sample buf[3];
+  _Alignas(SPSC_CACHE_LINE) atomic_uint middle;  // buffer between the two sides, | SPSC_FRESH
+  _Alignas(SPSC_CACHE_LINE) unsigned int back;   // producer's
+  _Alignas(SPSC_CACHE_LINE) unsigned int front;  // consumer's
+} spsc_latest;
+
+// 0 on success; the ring must not move afterwards (keep it static, it's cache-line aligned)
+int spsc_init(spsc_ring* r);
+void spsc_destroy(spsc_ring* r);
+
+// producer: copies s in, and x if s is flagged POSE_EXTENDED, returns 0, or -1 (counted in
+// overflows) when the ring is full
+int spsc_push(spsc_ring* r, const struct pose_sample* s, const struct pose_extended* x);
+
+// consumer: copies the oldest sample out, and its extended record into x if it has one, returns
+// 1, or 0 when the ring is empty
+int spsc_pop(spsc_ring* r, struct pose_sample* s, struct pose_extended* x);
+
+// consumer: sleeps until the producer pushes or timeout_ms passes (-1 forever)
+void spsc_wait(spsc_ring* r, int timeout_ms);
+
+// samples waiting, approximate when called from anywhere but the consumer
+unsigned int spsc_depth(spsc_ring* r);
+
+void spsc_latest_init(spsc_latest* l);
+void spsc_latest_store(spsc_latest* l, const struct pose_sample* s);
+
+// copies the newest sample out, returns 1 if it wasn't seen by the last load
+int spsc_latest_load(spsc_latest* l, struct pose_sample* s);
+
+#endif
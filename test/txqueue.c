@@ -0,0 +1,183 @@
+//==================================================================================================
+// asynchronous transmit queue, see txqueue.h
+//==================================================================================================
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "txqueue.h"
+
+#define TXQ_BATCH    8     // frames handed to the kernel per write
+#define TXQ_OUTQ_CAP 2048  // most bytes we ever leave in the kernel queue
+
+int txq_parse_policy(const char* name, txq_policy* policy) {
+  if (strcmp(name, "drop") == 0) *policy = TXQ_DROP_OLDEST;
+  else if (strcmp(name, "coalesce") == 0) *policy = TXQ_COALESCE_LATEST;
+  else if (strcmp(name, "block") == 0) *policy = TXQ_BLOCK;
+  else return -1;
+  return 0;
+}
+
+const char* txq_policy_name(txq_policy policy) {
+  switch (policy) {
+  case TXQ_DROP_OLDEST: return "drop";
+  case TXQ_COALESCE_LATEST: return "coalesce";
+  case TXQ_BLOCK: return "block";
+  }
+  return "?";
+}
+
+// bytes currently sitting in the kernel's output queue, 0 if the driver can't tell us
+static int outq_bytes(txqueue* q) {
+  int pending = 0;
+  q->syscalls++;
+  if (ioctl(q->fd, TIOCOUTQ, &pending) != 0) pending = 0;
+  q->outq = pending;
+  return pending;
+}
+
+long txq_service(txqueue* q) {
+  for (;;) {
+    // whatever the fd refused last time goes first
+    if (iob_pending(&q->io) > 0) {
+      int r = iob_flush(&q->io);
+      if (r == 1) return -1;
+      if (r < 0) return TXQ_FAILED;
+    }
+
+    pthread_mutex_lock(&q->lock);
+    if (q->count == 0) {
+      pthread_mutex_unlock(&q->lock);
+      return 0;
+    }
+    size_t first = q->slots[q->head].len;
+    pthread_mutex_unlock(&q->lock);
+
+    // only hand the kernel what fits under outq_max, the rest waits in our queue where the
+    // policy can still drop or coalesce it. come back roughly when the excess has drained
+    int room = q->outq_max - outq_bytes(q);
+    if (room < (int)first) {
+      long excess = (long)first - room;
+      long us = excess * 10 * 1000000L / q->baud;
+      return us < 1000 ? 1000 : us;
+    }
+
+    // frames are copied straight into the backend's (possibly registered) buffers
+    size_t len = 0;
+    int frames = 0;
+    pthread_mutex_lock(&q->lock);
+    while (q->count > 0 && frames < TXQ_BATCH) {
+      txq_frame* f = &q->slots[q->head];
+      if (len + f->len > (size_t)room) break;
+      iob_write(&q->io, f->data, f->len);
+      len += f->len;
+      frames++;
+      q->head = (q->head + 1) % q->depth;
+      q->count--;
+    }
+    pthread_cond_broadcast(&q->nonfull);
+    pthread_mutex_unlock(&q->lock);
+
+    int r = iob_flush(&q->io);
+    if (r >= 0) {
+      q->frames_written += frames;
+      q->bytes_written += len;
+    }
+    if (r < 0) return TXQ_FAILED;
+    if (r != 0) return -1;
+  }
+}
+
+int txq_init(txqueue* q, int fd, txq_policy policy, int depth, int baud, enum iob_backend backend) {
+  memset(q, 0, sizeof(*q));
+  q->fd = fd;
+  q->wake_fd = -1;
+  q->policy = policy;
+  q->depth = (depth < 1 || depth > TXQ_SLOTS) ? TXQ_SLOTS : depth;
+  q->baud = baud > 0 ? baud : 9600;
+  // ~20ms of wire time, but always room for a full frame, and under the usual 4K tty buffer so a
+  // write TIOCOUTQ allows doesn't come back short
+  q->outq_max = q->baud / 10 / 50;
+  if (q->outq_max > TXQ_OUTQ_CAP) q->outq_max = TXQ_OUTQ_CAP;
+  if (q->outq_max < TXQ_FRAME_MAX) q->outq_max = TXQ_FRAME_MAX;
+  q->running = 1;
+
+  // a receiver that stops reading must not stall the loop serving the other ports
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  if (iob_init(&q->io, fd, backend, TXQ_BATCH * TXQ_FRAME_MAX, 2, 1) != 0) return -1;
+  q->io.nonblock = 1;
+
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->nonfull, NULL);
+  return 0;
+}
+
+int txq_push(txqueue* q, const void* frame, size_t len) {
+  pthread_mutex_lock(&q->lock);
+  q->pushed++;
+  if (len > TXQ_FRAME_MAX || q->failed) {
+    q->dropped++;
+    pthread_mutex_unlock(&q->lock);
+    return -1;
+  }
+  if (q->count == q->depth) {
+    if (q->policy == TXQ_BLOCK) {
+      while (q->count == q->depth && q->running && !q->failed)
+        pthread_cond_wait(&q->nonfull, &q->lock);
+      if (q->count == q->depth) {  // stopped or failed while we waited
+        q->dropped++;
+        pthread_mutex_unlock(&q->lock);
+        return 0;
+      }
+    } else if (q->policy == TXQ_DROP_OLDEST) {
+      q->head = (q->head + 1) % q->depth;
+      q->count--;
+      q->dropped++;
+    } else {
+      // overwrite the newest frame in place, the writer hasn't taken it yet
+      txq_frame* f = &q->slots[(q->head + q->count - 1) % q->depth];
+      memcpy(f->data, frame, len);
+      f->len = len;
+      q->coalesced++;
+      pthread_mutex_unlock(&q->lock);
+      return 0;
+    }
+  }
+
+  txq_frame* f = &q->slots[(q->head + q->count) % q->depth];
+  memcpy(f->data, frame, len);
+  f->len = len;
+  q->count++;
+  int wake = q->count == 1 && q->wake_fd >= 0;
+  pthread_mutex_unlock(&q->lock);
+
+  if (wake) {
+    char c = 0;
+    q->wakeups++;
+    write(q->wake_fd, &c, 1);
+  }
+  return 0;
+}
+
+void txq_fail(txqueue* q) {
+  pthread_mutex_lock(&q->lock);
+  q->failed = 1;
+  q->dropped += q->count;
+  q->count = 0;
+  pthread_cond_broadcast(&q->nonfull);
+  pthread_mutex_unlock(&q->lock);
+}
+
+void txq_destroy(txqueue* q) {
+  pthread_mutex_lock(&q->lock);
+  q->running = 0;
+  pthread_cond_broadcast(&q->nonfull);
+  pthread_mutex_unlock(&q->lock);
+  iob_destroy(&q->io);
+
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->nonfull);
+}
@@ -0,0 +1,84 @@
+//==================================================================================================
+// asynchronous transmit queue for one serial output
+//
+// acquisition pushes encoded frames and returns immediately; the output loop (outloop.h) calls
+// txq_service() to keep the kernel's output queue (and so the UART FIFO) topped up to about
+// outq_max bytes, watching it with TIOCOUTQ instead of tcdrain()ing after every record. when the
+// link can't keep up the queue fills and the policy decides what gives.
+//==================================================================================================
+
+#ifndef TXQUEUE_H
+#define TXQUEUE_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "../iob.h"
+
+#define TXQ_SLOTS     64   // max frames waiting in user space
+#define TXQ_FRAME_MAX 320  // largest frame txq_push accepts
+
+typedef enum {
+  TXQ_DROP_OLDEST,      // discard the oldest queued frame to make room
+  TXQ_COALESCE_LATEST,  // the new frame replaces the newest queued one
+  TXQ_BLOCK             // wait for room (the only policy where txq_push can wait on the wire)
+} txq_policy;
+
+typedef struct {
+  size_t len;
+  unsigned char data[TXQ_FRAME_MAX];
+} txq_frame;
+
+typedef struct {
+  int fd;
+  txq_policy policy;
+  int depth;             // frames, <= TXQ_SLOTS
+  int baud;              // used to estimate how long the kernel queue takes to drain
+  int outq_max;          // bytes we let sit in the kernel queue
+  struct iob io;         // how batches reach the fd, plain write() or io_uring
+  int wake_fd;           // poked when the queue stops being empty, -1 for none
+
+  pthread_mutex_t lock;
+  pthread_cond_t nonfull;
+  int running;
+
+  txq_frame slots[TXQ_SLOTS];
+  int head, count;
+  int failed;            // the fd is gone or won't take writes any more, see txq_fail
+
+  // stats, read without the lock for display
+  unsigned long pushed;
+  unsigned long dropped;
+  unsigned long coalesced;
+  unsigned long frames_written;
+  unsigned long bytes_written;
+  // each counted by the one thread that makes the calls, so neither needs the lock
+  unsigned long syscalls;  // TIOCOUTQ, the output loop's; the fd writes are in io.syscalls
+  unsigned long wakeups;   // wake_fd writes, the pushing thread's
+  int outq;              // last TIOCOUTQ reading
+} txqueue;
+
+int txq_parse_policy(const char* name, txq_policy* policy);
+const char* txq_policy_name(txq_policy policy);
+
+// sets up a queue for fd and makes fd non-blocking, returns 0 on success
+int txq_init(txqueue* q, int fd, txq_policy policy, int depth, int baud, enum iob_backend backend);
+
+// queues one frame, returns 0 if queued, -1 if it was too big or the queue has failed (counted
+// as dropped)
+int txq_push(txqueue* q, const void* frame, size_t len);
+
+// hands the kernel as many queued frames as it has room for. never blocks; returns 0 when the
+// queue is empty, the microseconds until it's worth trying again when the kernel queue is full,
+// -1 when the fd has to become writable first, or TXQ_FAILED when a write failed for good
+#define TXQ_FAILED (-2)
+long txq_service(txqueue* q);
+
+// gives up on the queue: whatever is queued or pushed from now on is dropped, and no one waits
+// for room any more
+void txq_fail(txqueue* q);
+
+// wakes anyone blocked in txq_push and frees the queue; the fd stays open
+void txq_destroy(txqueue* q);
+
+#endif